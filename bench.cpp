@@ -0,0 +1,329 @@
+/*---------------------------------------------------------------------------*\
+ *  bench.cpp                                                                *
+ *  This file contains benchmarks of the harness itself: comparing output    *
+ *    with a Tester, running a trivial process with execute_process(),       *
+ *    pairing the files of a large suite with get_io(), and rendering a      *
+ *    Timer report of a test with many runs.  The test data is made up, in   *
+ *    a temporary directory removed afterwards.                              *
+ *  "make bench" builds and runs every benchmark; evaluate-bench run by      *
+ *    hand takes names, or the starts of names (eg. "tester/"), and runs     *
+ *    only the benchmarks they match.                                        *
+ *                                                                           *
+ *  Each benchmark is timed in rounds of some number of operations, chosen   *
+ *    so that a round takes at least a tenth of a second, and the median of *
+ *    five rounds is reported, one tab-separated line per benchmark after a  *
+ *    header line:                                                           *
+ *      # evaluate-bench 1                                                   *
+ *      bench <name> <operations> <ns/operation> <MB/s>                      *
+ *    <operations> is the number in a round, and <MB/s> the rate at which    *
+ *    output was compared, or "-" for benchmarks that compare none.  Names   *
+ *    are not changed once given, so results can be compared across          *
+ *    versions; a new column would be added at the end, and the version in   *
+ *    the header raised.                                                     *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+#include "discovery.h"
+#include "execute-process.h"
+#include "tester.h"
+#include "timer.h"
+using namespace std;
+namespace fs = boost::filesystem;
+
+static const double MIN_ROUND_SECONDS = 0.1;
+static const unsigned ROUNDS = 5;
+static const unsigned OUTPUT_BYTES = 4 << 20;
+static const unsigned SUITE_FILES = 100000;
+static const unsigned SUITE_SUBDIRS = 100;
+static const unsigned TIMESET_RUNS = 100000;
+
+static vector<string> wanted;
+
+
+static double now_seconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double time_operations(const function<void()> &operation, unsigned n)
+{
+    double start = now_seconds();
+    for (unsigned i = 0; i < n; ++i) operation();
+    return now_seconds() - start;
+}
+
+static bool selected(string name)
+{
+    if (wanted.empty()) return true;
+    for (unsigned i = 0; i < wanted.size(); ++i) {
+        if (name.compare(0, wanted[i].size(), wanted[i]) == 0) return true;
+    }
+    return false;
+}
+
+
+/*  run_bench()
+ *  Doubles the operations in a round until it takes long enough, then times
+ *  the rounds and prints the result.  _bytes_ is the output compared by one
+ *  operation, if any.
+ */
+static void run_bench(string name, double bytes,
+                      const function<void()> &operation)
+{
+    unsigned n = 1;
+    while (time_operations(operation, n) < MIN_ROUND_SECONDS
+           && n < (1u << 30)) {
+        n *= 2;
+    }
+    vector<double> rounds;
+    for (unsigned i = 0; i < ROUNDS; ++i) {
+        rounds.push_back(time_operations(operation, n) / n);
+    }
+    sort(rounds.begin(), rounds.end());
+    double median = rounds[ROUNDS / 2];
+    printf("bench\t%s\t%u\t%.0f\t", name.c_str(), n, median * 1e9);
+    if (bytes > 0) printf("%.1f\n", bytes / median / 1e6);
+    else printf("-\n");
+    fflush(stdout);
+}
+
+
+/*  Makes OUTPUT_BYTES or so of text that looks like program output: lines
+ *  of numbers and words.  The same text is made every time.
+ */
+static string sample_output()
+{
+    static const char *words[] = { "alpha", "beta", "gamma", "delta",
+                                   "epsilon", "zeta", "eta", "theta" };
+    string r_val;
+    unsigned seed = 12345;
+    while (r_val.size() < OUTPUT_BYTES) {
+        for (unsigned i = 0; i < 8; ++i) {
+            seed = seed * 1103515245 + 12345;
+            if (i) r_val += ' ';
+            if (seed & 0x10000) r_val += words[(seed >> 20) % 8];
+            else r_val += to_string((seed >> 8) % 100000);
+        }
+        r_val += '\n';
+    }
+    return r_val;
+}
+
+static void write_file(string path, const string &contents)
+{
+    ofstream out(path.c_str(), ios::binary);
+    out << contents;
+}
+
+static string replace_all(string s, char c, string with)
+{
+    string r_val;
+    for (unsigned i = 0; i < s.size(); ++i) {
+        if (s[i] == c) r_val += with;
+        else r_val += s[i];
+    }
+    return r_val;
+}
+
+
+static void bench_tester(string dir)
+{
+    string text = sample_output();
+    string expected = dir + "/expected";
+    write_file(expected, text);
+    write_file(dir + "/exact", text);
+    write_file(dir + "/spaced", replace_all(text, ' ', " \t "));
+    write_file(dir + "/commas", replace_all(text, ' ', ", "));
+    string last = text;
+    last[last.size() - 2] = '#';
+    write_file(dir + "/last", last);
+
+    struct Case {
+        const char *name;
+        const char *actual;
+        bool verbose;
+        int settings;   /* 0 exact, 1 ignore whitespace, 2 ignore commas */
+    } cases[] = {
+        { "tester/run/exact", "exact", false, 0 },
+        { "tester/run/ignore-whitespace", "spaced", false, 1 },
+        { "tester/run/ignore-chars", "commas", false, 2 },
+        { "tester/run/mismatch-at-end", "last", false, 0 },
+        { "tester/run_verbosely/exact", "exact", true, 0 },
+        { "tester/run_verbosely/ignore-whitespace", "spaced", true, 1 },
+        { "tester/run_verbosely/mismatch-at-end", "last", true, 0 }
+    };
+    for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        if (!selected(cases[i].name)) continue;
+        string actual = dir + "/" + cases[i].actual;
+        Tester tes;
+        tes.set_benchmark_file(expected).set_comparison_file(actual);
+        if (cases[i].settings == 1) tes.ignore_whitespace();
+        if (cases[i].settings == 2) tes.ignore_chars(",");
+        bool verbose = cases[i].verbose;
+        run_bench(cases[i].name, fs::file_size(actual), [&tes, verbose]() {
+            if (verbose) tes.run_verbosely();
+            else tes.run();
+        });
+    }
+}
+
+
+static void bench_execute_process()
+{
+    char true_name[] = "/bin/true";
+    char *argv[] = { true_name, NULL };
+    ProcessOptions options;
+    if (selected("execute_process/true")) {
+        run_bench("execute_process/true", 0, [&]() {
+            execute_process(true_name, argv, "/dev/null", "/dev/null",
+                            "/dev/null", options);
+        });
+    }
+    ProcessOptions limited;
+    limited.max_cpu_time = 10;
+    limited.max_real_time = 10;
+    if (selected("execute_process/true-with-limits")) {
+        run_bench("execute_process/true-with-limits", 0, [&]() {
+            execute_process(true_name, argv, "/dev/null", "/dev/null",
+                            "/dev/null", limited);
+        });
+    }
+}
+
+
+static void touch(string path)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd >= 0) close(fd);
+}
+
+static void bench_get_io(string dir)
+{
+    char name[32];
+    if (selected("get_io/flat-100k")) {
+        fs::create_directories(dir + "/flat/in");
+        fs::create_directories(dir + "/flat/out");
+        for (unsigned i = 0; i < SUITE_FILES; ++i) {
+            snprintf(name, sizeof(name), "/t%06u", i);
+            touch(dir + "/flat/in" + name + ".in");
+            touch(dir + "/flat/out" + name + ".out");
+        }
+        run_bench("get_io/flat-100k", 0, [&]() {
+            vector<string> inputs, outputs;
+            get_io(inputs, outputs, dir + "/flat/in", dir + "/flat/out",
+                   ".in", ".out", false);
+        });
+    }
+    if (selected("get_io/recursive-100k")) {
+        unsigned per_dir = SUITE_FILES / SUITE_SUBDIRS;
+        for (unsigned d = 0; d < SUITE_SUBDIRS; ++d) {
+            snprintf(name, sizeof(name), "/d%03u", d);
+            string in_dir = dir + "/tree/in" + name;
+            string out_dir = dir + "/tree/out" + name;
+            fs::create_directories(in_dir);
+            fs::create_directories(out_dir);
+            for (unsigned i = 0; i < per_dir; ++i) {
+                snprintf(name, sizeof(name), "/t%06u", i);
+                touch(in_dir + name + ".in");
+                touch(out_dir + name + ".out");
+            }
+        }
+        run_bench("get_io/recursive-100k", 0, [&]() {
+            vector<string> inputs, outputs;
+            get_io(inputs, outputs, dir + "/tree/in", dir + "/tree/out",
+                   ".in", ".out", true);
+        });
+    }
+}
+
+
+static void bench_timer()
+{
+    TimeSet set;
+    set.test_name = set.input_file = "bench.in";
+    set.output_file = "bench.out";
+    set.input_size = -1;
+    unsigned seed = 54321;
+    for (unsigned i = 0; i < TIMESET_RUNS; ++i) {
+        ProgramInfo run;
+        seed = seed * 1103515245 + 12345;
+        run.wall_sec = 0;
+        run.wall_usec = 100000 + (seed >> 8) % 50000;
+        run.user_sec = 0;
+        run.user_usec = run.wall_usec * 9 / 10;
+        run.sys_sec = 0;
+        run.sys_usec = run.wall_usec / 20;
+        run.max_rss_kb = 10000 + (seed >> 16) % 1000;
+        run.exit_code = 0;
+        add_run(set, run);
+    }
+
+    struct Case {
+        const char *name;
+        int settings;   /* 0 average, 1 statistics, 2 histograms, 3 all */
+    } cases[] = {
+        { "timer/report_time/average-100k", 0 },
+        { "timer/report_time/statistics-100k", 1 },
+        { "timer/report_time/histograms-100k", 2 },
+        { "timer/report_time/all-runs-100k", 3 }
+    };
+    for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        if (!selected(cases[i].name)) continue;
+        Timer tim;
+        tim.report_only_avg();
+        if (cases[i].settings == 1) tim.report_statistics().report_memory();
+        if (cases[i].settings == 2) tim.report_histograms(HISTOGRAM_AUTO);
+        if (cases[i].settings == 3) tim.report_all();
+        run_bench(cases[i].name, 0, [&tim, &set]() {
+            ostringstream out;
+            tim.set_output(&out);
+            tim.report_time(set);
+        });
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    wanted.assign(argv + 1, argv + argc);
+    string dir;
+    try {
+        dir = (fs::temp_directory_path()
+               / fs::unique_path("evaluate-bench-%%%%-%%%%")).native();
+        fs::create_directories(dir);
+    } catch (fs::filesystem_error &err) {
+        fprintf(stderr, "Error: %s\n", err.what());
+        return 1;
+    }
+    printf("# evaluate-bench 1\n");
+    int r_val = 0;
+    try {
+        bench_tester(dir);
+        bench_execute_process();
+        bench_get_io(dir);
+        bench_timer();
+    } catch (string err) {
+        fprintf(stderr, "Error: %s\n", err.c_str());
+        r_val = 1;
+    } catch (fs::filesystem_error &err) {
+        fprintf(stderr, "Error: %s\n", err.what());
+        r_val = 1;
+    }
+    boost::system::error_code ignored;
+    fs::remove_all(dir, ignored);
+    return r_val;
+}
@@ -0,0 +1,386 @@
+/*---------------------------------------------------------------------------*\
+ *  cache.cpp                                                                *
+ *  This implementation hashes with XXH64 (see xxhash.com), which reads     *
+ *    input 32 bytes at a time and is limited by memory bandwidth rather     *
+ *    than by the hash itself.  Files are read with read() in large blocks.  *
+ *  The cache file is plain text, one entry per line:                        *
+ *      file <hash> <size> <mtime_ns> <inode> <used> <path>                  *
+ *      result <key> <passed> <real> <user> <sys> <used>                     *
+ *    where <used> is when the entry was last used, in seconds since 1970.   *
+ *    Entries written without it, before it was kept, are taken as used     *
+ *    when loaded.                                                           *
+ *    It is replaced atomically (written to a new file, then renamed) so     *
+ *    that a run interrupted while saving cannot corrupt it.                 *
+ *  Files are hashed by up to one thread per CPU, each taking the next       *
+ *    unhashed file from a shared counter.                                   *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "cache.h"
+using namespace std;
+
+
+static const unsigned long long PRIME1 = 11400714785074694791ULL;
+static const unsigned long long PRIME2 = 14029467366897019727ULL;
+static const unsigned long long PRIME3 = 1609587929392839161ULL;
+static const unsigned long long PRIME4 = 9650029242287828579ULL;
+static const unsigned long long PRIME5 = 2870177450012600261ULL;
+
+static inline unsigned long long rotl(unsigned long long x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline unsigned long long read64(const unsigned char *p)
+{
+    unsigned long long x;
+    memcpy(&x, p, 8);
+    return x;
+}
+
+static inline unsigned long long read32(const unsigned char *p)
+{
+    unsigned int x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+static inline unsigned long long round64(unsigned long long acc,
+                                         unsigned long long input)
+{
+    acc += input * PRIME2;
+    return rotl(acc, 31) * PRIME1;
+}
+
+static inline unsigned long long merge_round(unsigned long long acc,
+                                             unsigned long long val)
+{
+    acc ^= round64(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+/*  An incremental XXH64: whole 32-byte stripes are consumed as they come,
+ *  and the remainder is kept until more arrives or the hash is finished.
+ */
+class Hasher
+{
+public:
+    Hasher(unsigned long long seed = 0)
+    {
+        v[0] = seed + PRIME1 + PRIME2;
+        v[1] = seed + PRIME2;
+        v[2] = seed;
+        v[3] = seed - PRIME1;
+        this->seed = seed;
+        total = 0;
+        buffered = 0;
+    }
+
+    void update(const void *data, size_t len)
+    {
+        const unsigned char *p = (const unsigned char *) data;
+        total += len;
+        if (buffered + len < 32) {
+            memcpy(buffer + buffered, p, len);
+            buffered += len;
+            return;
+        }
+        if (buffered) {
+            size_t fill = 32 - buffered;
+            memcpy(buffer + buffered, p, fill);
+            stripe(buffer);
+            p += fill;
+            len -= fill;
+            buffered = 0;
+        }
+        while (len >= 32) {
+            stripe(p);
+            p += 32;
+            len -= 32;
+        }
+        memcpy(buffer, p, len);
+        buffered = len;
+    }
+
+    unsigned long long finish() const
+    {
+        unsigned long long h;
+        if (total >= 32) {
+            h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12)
+              + rotl(v[3], 18);
+            for (int i = 0; i < 4; ++i) h = merge_round(h, v[i]);
+        } else {
+            h = seed + PRIME5;
+        }
+        h += total;
+        const unsigned char *p = buffer;
+        size_t len = buffered;
+        while (len >= 8) {
+            h ^= round64(0, read64(p));
+            h = rotl(h, 27) * PRIME1 + PRIME4;
+            p += 8;
+            len -= 8;
+        }
+        if (len >= 4) {
+            h ^= read32(p) * PRIME1;
+            h = rotl(h, 23) * PRIME2 + PRIME3;
+            p += 4;
+            len -= 4;
+        }
+        while (len > 0) {
+            h ^= (*p) * PRIME5;
+            h = rotl(h, 11) * PRIME1;
+            ++p;
+            --len;
+        }
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    unsigned long long v[4];
+    unsigned long long seed;
+    unsigned long long total;
+    unsigned char buffer[32];
+    size_t buffered;
+
+    void stripe(const unsigned char *p)
+    {
+        for (int i = 0; i < 4; ++i) v[i] = round64(v[i], read64(p + 8 * i));
+    }
+};
+
+static string to_hex(unsigned long long h)
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", h);
+    return text;
+}
+
+
+string hash_strings(const vector<string> &parts)
+{
+    Hasher hasher;
+    for (unsigned i = 0; i < parts.size(); ++i) {
+        unsigned long long len = parts[i].length();
+        hasher.update(&len, sizeof(len));
+        hasher.update(parts[i].data(), parts[i].length());
+    }
+    return to_hex(hasher.finish());
+}
+
+/*  Returns the hash of a file's contents, or the empty string if it cannot
+ *  be read.
+ */
+static string hash_file(const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return "";
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    Hasher hasher;
+    vector<char> block(1 << 18);
+    ssize_t got;
+    while ((got = read(fd, &block[0], block.size())) > 0) {
+        hasher.update(&block[0], got);
+    }
+    close(fd);
+    if (got < 0) return "";
+    return to_hex(hasher.finish());
+}
+
+
+
+ResultCache::ResultCache(string filename)
+{
+    this->filename = filename;
+}
+
+
+void ResultCache::load()
+{
+    ifstream in(filename.c_str());
+    string line;
+    long long now = time(NULL);
+    while (getline(in, line)) {
+        stringstream ss(line);
+        string kind;
+        ss >> kind;
+        if (kind == "file") {
+            FileEntry entry;
+            string path;
+            ss >> entry.hash >> entry.size >> entry.mtime_ns >> entry.inode;
+            ss.get();
+            getline(ss, path);
+            stringstream rest(path);
+            long long used;
+            entry.used = now;
+            if (rest >> used && rest.get() == ' ') {
+                entry.used = used;
+                getline(rest, path);
+            }
+            if (ss && path != "") files[path] = entry;
+        } else if (kind == "result") {
+            string key;
+            ResultEntry entry;
+            CachedResult &result = entry.result;
+            if (ss >> key >> result.passed >> result.real
+                   >> result.user >> result.sys) {
+                if (!(ss >> entry.used)) entry.used = now;
+                results[key] = entry;
+            }
+        }
+    }
+}
+
+
+/*  Returns the keys of _entries_ to keep: those used since _oldest_, and of
+ *  them, at most _limit_ of the most recently used.
+ */
+template <class Entry>
+static vector<string> keys_to_keep(const map<string, Entry> &entries,
+                                   long long oldest, unsigned limit)
+{
+    vector< pair<long long, string> > by_use;
+    typename map<string, Entry>::const_iterator e;
+    for (e = entries.begin(); e != entries.end(); ++e) {
+        if (e->second.used >= oldest) {
+            by_use.push_back(make_pair(-e->second.used, e->first));
+        }
+    }
+    if (by_use.size() > limit) {
+        nth_element(by_use.begin(), by_use.begin() + limit, by_use.end());
+        by_use.resize(limit);
+    }
+    vector<string> r_val;
+    for (unsigned i = 0; i < by_use.size(); ++i) {
+        r_val.push_back(by_use[i].second);
+    }
+    sort(r_val.begin(), r_val.end());
+    return r_val;
+}
+
+
+void ResultCache::save()
+{
+    long long oldest = time(NULL) - MAX_IDLE_DAYS * 24LL * 60 * 60;
+    vector<string> kept_files = keys_to_keep(files, oldest, MAX_FILES);
+    vector<string> kept_results = keys_to_keep(results, oldest,
+                                               MAX_RESULTS);
+    string temp = filename + ".tmp";
+    ofstream out(temp.c_str());
+    out.precision(9);
+    for (unsigned i = 0; i < kept_files.size(); ++i) {
+        const FileEntry &entry = files[kept_files[i]];
+        if (entry.hash == "") continue;
+        out << "file " << entry.hash << " " << entry.size << " "
+            << entry.mtime_ns << " " << entry.inode << " " << entry.used
+            << " " << kept_files[i] << "\n";
+    }
+    for (unsigned i = 0; i < kept_results.size(); ++i) {
+        const ResultEntry &entry = results[kept_results[i]];
+        out << "result " << kept_results[i] << " " << entry.result.passed
+            << " " << entry.result.real << " " << entry.result.user << " "
+            << entry.result.sys << " " << entry.used << "\n";
+    }
+    out.close();
+    if (out.fail() || rename(temp.c_str(), filename.c_str())) {
+        remove(temp.c_str());
+    }
+}
+
+
+/*  Files are first checked against their stored size, modification time,
+ *  and inode; only those that changed (or are new) are read and hashed.
+ */
+void ResultCache::hash_files(const vector<string> &paths)
+{
+    vector<string> stale;
+    vector<FileEntry> fresh;
+    long long now = time(NULL);
+    for (unsigned i = 0; i < paths.size(); ++i) {
+        struct stat st;
+        if (paths[i] == "") continue;
+        if (stat(paths[i].c_str(), &st)) {
+            files.erase(paths[i]);
+            continue;
+        }
+        FileEntry entry;
+        entry.size = st.st_size;
+        entry.mtime_ns = st.st_mtim.tv_sec * 1000000000ULL
+                       + st.st_mtim.tv_nsec;
+        entry.inode = st.st_ino;
+        entry.used = now;
+        map<string, FileEntry>::iterator known = files.find(paths[i]);
+        if (known != files.end() && known->second.size == entry.size
+            && known->second.mtime_ns == entry.mtime_ns
+            && known->second.inode == entry.inode) {
+            known->second.used = now;
+            continue;
+        }
+        if (known != files.end()) known->second.hash = "";
+        stale.push_back(paths[i]);
+        fresh.push_back(entry);
+    }
+    if (stale.empty()) return;
+
+    unsigned workers = thread::hardware_concurrency();
+    if (workers == 0) workers = 1;
+    if (workers > stale.size()) workers = stale.size();
+    atomic<unsigned> next(0);
+    vector<thread> pool;
+    for (unsigned w = 0; w < workers; ++w) {
+        pool.push_back(thread([&]() {
+            unsigned i;
+            while ((i = next++) < stale.size()) {
+                fresh[i].hash = hash_file(stale[i]);
+            }
+        }));
+    }
+    for (unsigned w = 0; w < workers; ++w) pool[w].join();
+    for (unsigned i = 0; i < stale.size(); ++i) files[stale[i]] = fresh[i];
+}
+
+
+/*  Returns the hash of a file given to hash_files(), or "-" for a file
+ *  that does not exist or could not be read.
+ */
+string ResultCache::file_hash(string path)
+{
+    map<string, FileEntry>::const_iterator known = files.find(path);
+    if (known == files.end() || known->second.hash == "") return "-";
+    return known->second.hash;
+}
+
+
+bool ResultCache::lookup(string key, CachedResult *result)
+{
+    map<string, ResultEntry>::iterator found = results.find(key);
+    if (found == results.end()) return false;
+    found->second.used = time(NULL);
+    *result = found->second.result;
+    return true;
+}
+
+
+void ResultCache::store(string key, const CachedResult &result)
+{
+    ResultEntry entry;
+    entry.result = result;
+    entry.used = time(NULL);
+    results[key] = entry;
+}
@@ -0,0 +1,77 @@
+/*---------------------------------------------------------------------------*\
+ *  cache.h                                                                  *
+ *  This file contains the interface for the ResultCache class, an on-disk   *
+ *    record of tests that have passed, so that unchanged tests need not be  *
+ *    run again.                                                             *
+ *  A test is identified by a key, which is a hash of everything that could  *
+ *    change its result: the bytes of the executable, its arguments, the     *
+ *    bytes of the input and expected files, and the testing options.  If    *
+ *    any of them change, so does the key, and the old result is ignored.    *
+ *                                                                           *
+ *  ResultCache::hash_files() hashes many files at once, in parallel.  The   *
+ *    size, modification time, and inode of each file hashed are stored in   *
+ *    the cache too, and a file whose are unchanged is not read again, so    *
+ *    checking the cache is much cheaper than running the tests.             *
+ *  ResultCache::lookup() and ResultCache::store() find and record results   *
+ *    by key.  Nothing is written to disk until ResultCache::save().         *
+ *  Since keys are never looked up again once anything in them changes, old  *
+ *    entries are dropped when saving: those unused for MAX_IDLE_DAYS, and   *
+ *    the least recently used beyond MAX_RESULTS results or MAX_FILES files. *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef CACHE_H_INCLUDED
+#define CACHE_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct CachedResult {
+    bool passed;
+    double real;            /* average times, in seconds */
+    double user;
+    double sys;
+};
+
+/*  Returns a printable 64-bit hash of _parts_, which are kept distinct, so
+ *    that eg. {"ab", "c"} and {"a", "bc"} hash differently.
+ */
+std::string hash_strings(const std::vector<std::string> &parts);
+
+static const unsigned MAX_IDLE_DAYS = 30;
+static const unsigned MAX_RESULTS = 200000;
+static const unsigned MAX_FILES = 400000;
+
+class ResultCache
+{
+public:
+    ResultCache(std::string filename);
+
+    void load();
+    void save();
+
+    void hash_files(const std::vector<std::string> &paths);
+    std::string file_hash(std::string path);
+
+    bool lookup(std::string key, CachedResult *result);
+    void store(std::string key, const CachedResult &result);
+
+private:
+    struct FileEntry {
+        std::string hash;
+        unsigned long long size;
+        unsigned long long mtime_ns;
+        unsigned long long inode;
+        long long used;         /* when last hashed or checked, as time() */
+    };
+    struct ResultEntry {
+        CachedResult result;
+        long long used;         /* when last looked up or stored */
+    };
+    std::string filename;
+    std::map<std::string, FileEntry> files;
+    std::map<std::string, ResultEntry> results;
+};
+
+#endif
@@ -0,0 +1,172 @@
+/*---------------------------------------------------------------------------*\
+ *  cgroup.cpp                                                               *
+ *  This implementation reads /proc/self/mountinfo to find where cgroup v2   *
+ *    is mounted, and /proc/self/cgroup to find the harness's own cgroup.    *
+ *    CPU time comes from cpu.stat, which every v2 cgroup has, and peak      *
+ *    memory from memory.peak, which needs the memory controller to be       *
+ *    enabled for the leaf.  The harness tries to enable it, but this only   *
+ *    works where its own cgroup has no other processes (or is the root).    *
+ *  Killing uses cgroup.kill where the kernel has it (5.14 and later), and   *
+ *    otherwise kills each process listed in cgroup.procs.                   *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "cgroup.h"
+using namespace std;
+
+
+/*  Returns the directory of the harness's own cgroup, or the empty string
+ *  if cgroup v2 is not mounted.  Found once, then remembered.
+ */
+static string own_cgroup()
+{
+    static bool searched = false;
+    static string r_val;
+    if (searched) return r_val;
+    searched = true;
+
+    string mount, line;
+    ifstream mountinfo("/proc/self/mountinfo");
+    while (getline(mountinfo, line)) {
+        string::size_type sep = line.find(" - ");
+        if (sep == string::npos) continue;
+        if (line.compare(sep + 3, 8, "cgroup2 ") != 0) continue;
+        stringstream fields(line);
+        string field;
+        for (int i = 0; i < 5 && fields >> field; ++i) {
+            // The fifth field is the mount point
+        }
+        mount = field;
+        break;
+    }
+    if (mount == "") return r_val;
+
+    ifstream cgroups("/proc/self/cgroup");
+    while (getline(cgroups, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            r_val = mount + line.substr(3);
+            break;
+        }
+    }
+    if (r_val != "" && r_val[r_val.length() - 1] == '/') {
+        r_val.erase(r_val.length() - 1);
+    }
+    return r_val;
+}
+
+static bool write_file(const string &path, const string &text)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool r_val = write(fd, text.c_str(), text.length())
+                 == (ssize_t) text.length();
+    close(fd);
+    return r_val;
+}
+
+
+string create_cgroup(string name)
+{
+    string parent = own_cgroup();
+    if (parent == "") return "";
+    static bool tried_memory = false;
+    if (!tried_memory) {
+        write_file(parent + "/cgroup.subtree_control", "+memory");
+        tried_memory = true;
+    }
+    string path = parent + "/" + name;
+    if (mkdir(path.c_str(), 0755) && errno != EEXIST) return "";
+    return path;
+}
+
+
+/*  Only async-signal-safe calls are made here, since it runs in a child of
+ *  a process that may have other threads.
+ */
+bool join_cgroup(const string &cgroup)
+{
+    char path[4096];
+    if (cgroup.length() + sizeof("/cgroup.procs") > sizeof(path)) {
+        return false;
+    }
+    strcpy(path, cgroup.c_str());
+    strcat(path, "/cgroup.procs");
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool r_val = write(fd, "0", 1) == 1;
+    close(fd);
+    return r_val;
+}
+
+
+bool read_cgroup_usage(string cgroup, CgroupUsage *usage)
+{
+    ifstream stat((cgroup + "/cpu.stat").c_str());
+    if (!stat.is_open()) return false;
+    string key;
+    unsigned long long value;
+    bool found = false;
+    usage->user_time = usage->sys_time = 0.0;
+    while (stat >> key >> value) {
+        if (key == "user_usec") {
+            usage->user_time = value / 1e6;
+            found = true;
+        } else if (key == "system_usec") {
+            usage->sys_time = value / 1e6;
+        }
+    }
+    usage->max_rss_kb = -1;
+    ifstream peak((cgroup + "/memory.peak").c_str());
+    if (peak >> value) usage->max_rss_kb = value / 1024;
+    return found;
+}
+
+
+vector<pid_t> cgroup_pids(string cgroup)
+{
+    vector<pid_t> r_val;
+    ifstream procs((cgroup + "/cgroup.procs").c_str());
+    pid_t pid;
+    while (procs >> pid) r_val.push_back(pid);
+    return r_val;
+}
+
+
+void kill_cgroup(string cgroup)
+{
+    if (write_file(cgroup + "/cgroup.kill", "1")) return;
+    for (int tries = 0; tries < 10; ++tries) {
+        ifstream procs((cgroup + "/cgroup.procs").c_str());
+        pid_t pid;
+        bool any = false;
+        while (procs >> pid) {
+            kill(pid, SIGKILL);
+            any = true;
+        }
+        if (!any) return;
+    }
+}
+
+
+/*  A cgroup can only be removed once its processes have fully exited, which
+ *  may take a moment after they are killed.
+ */
+void remove_cgroup(string cgroup)
+{
+    timespec step = { 0, 1000000 };
+    for (int tries = 0; tries < 1000; ++tries) {
+        if (rmdir(cgroup.c_str()) == 0 || errno == ENOENT) return;
+        if (errno != EBUSY) return;
+        nanosleep(&step, NULL);
+    }
+}
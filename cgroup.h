@@ -0,0 +1,53 @@
+/*---------------------------------------------------------------------------*\
+ *  cgroup.h                                                                 *
+ *  This file contains the interface for the cgroup module, a few functions  *
+ *    for running a process tree in its own cgroup v2 leaf, so that every    *
+ *    process in the tree can be accounted for and killed together, even    *
+ *    ones that have left their process group.                               *
+ *                                                                           *
+ *  A leaf is made beneath the cgroup the harness itself runs in, which      *
+ *    must be writable.  Where cgroup v2 is not mounted, or the harness may  *
+ *    not make cgroups, create_cgroup() returns the empty string and the     *
+ *    caller should fall back to process groups.                             *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef CGROUP_H_INCLUDED
+#define CGROUP_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+struct CgroupUsage {
+    double user_time;       /* seconds */
+    double sys_time;        /* seconds */
+    long max_rss_kb;        /* negative if the memory controller is off */
+};
+
+/*  Creates a new, empty leaf cgroup called _name_, and returns its path,
+ *    or the empty string if it could not be made.
+ */
+std::string create_cgroup(std::string name);
+
+/*  Moves the calling process into _cgroup_.  Meant to be called by a child
+ *    between fork() and exec().  Returns false on failure.
+ */
+bool join_cgroup(const std::string &cgroup);
+
+/*  Reads the CPU time and peak memory of every process that has been in
+ *    _cgroup_.  Returns false if they could not be read.
+ */
+bool read_cgroup_usage(std::string cgroup, CgroupUsage *usage);
+
+/*  Lists the processes now in _cgroup_.  Ones that have exited are not
+ *    listed, even before they are reaped.
+ */
+std::vector<pid_t> cgroup_pids(std::string cgroup);
+
+/*  Kills every process in _cgroup_, then removes it.
+ */
+void kill_cgroup(std::string cgroup);
+void remove_cgroup(std::string cgroup);
+
+#endif
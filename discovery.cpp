@@ -0,0 +1,240 @@
+/*---------------------------------------------------------------------------*\
+ *  discovery.cpp                                                            *
+ *  This implementation reads directories with the getdents64 system call,   *
+ *    many entries per call, and uses the file type each entry carries, so   *
+ *    that files need not be stat()ed one by one.  Only entries of unknown   *
+ *    type, and symbolic links, are stat()ed.  Symbolic links to             *
+ *    directories are not followed, so a link cannot make the search loop.  *
+ *  A recursive search keeps a queue of directories still to be read, which  *
+ *    the threads take from and add to until it is empty and none of them    *
+ *    is still reading.                                                      *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "discovery.h"
+using namespace std;
+
+
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/*  The state shared by the threads of one search.
+ */
+struct Search {
+    string root;
+    string suffix;
+    bool recursive;
+    mutex lock;
+    condition_variable changed;
+    deque<string> pending;
+    unsigned reading;
+    bool root_failed;
+    vector<string> found;
+};
+
+static bool has_suffix(const char *name, size_t name_len,
+                       const string &suffix)
+{
+    return name_len >= suffix.length()
+        && suffix.compare(0, string::npos, name + name_len - suffix.length(),
+                          suffix.length()) == 0;
+}
+
+/*  Returns _name_ in the directory _dir_; just _name_ if _dir_ is empty.
+ */
+static string join_path(const string &dir, const string &name)
+{
+    if (dir == "") return name;
+    if (dir[dir.length() - 1] == '/') return dir + name;
+    return dir + "/" + name;
+}
+
+/*  Reads the directory _rel_ (relative to the root of the search), adding
+ *  the stems of matching files to _found_ and subdirectories to _subdirs_.
+ *  Returns false if the directory could not be read.
+ */
+static bool read_directory(Search &search, const string &rel,
+                           vector<char> &buffer, vector<string> &found,
+                           vector<string> &subdirs)
+{
+    string path = join_path(search.root, rel);
+    string prefix = (rel == "") ? "" : rel + "/";
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    long got;
+    while ((got = syscall(SYS_getdents64, fd, &buffer[0], buffer.size()))
+           > 0) {
+        for (long pos = 0; pos < got; ) {
+            linux_dirent64 *entry = (linux_dirent64 *) &buffer[pos];
+            pos += entry->d_reclen;
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0'
+                                   || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                struct stat st;
+                if (fstatat(fd, name, &st, 0)) continue;
+                if (S_ISREG(st.st_mode)) type = DT_REG;
+                else if (S_ISDIR(st.st_mode) && type == DT_UNKNOWN) {
+                    type = DT_DIR;
+                }
+            }
+            if (type == DT_DIR) {
+                if (search.recursive) subdirs.push_back(prefix + name);
+            } else if (type == DT_REG) {
+                size_t name_len = strlen(name);
+                if (name_len > search.suffix.length()
+                    && has_suffix(name, name_len, search.suffix)) {
+                    found.push_back(prefix + string(name, name_len
+                                                   - search.suffix.length()));
+                }
+            }
+        }
+    }
+    close(fd);
+    return got == 0;
+}
+
+static void search_worker(Search &search)
+{
+    vector<char> buffer(1 << 16);
+    unique_lock<mutex> guard(search.lock);
+    while (true) {
+        search.changed.wait(guard, [&]() {
+            return !search.pending.empty() || search.reading == 0;
+        });
+        if (search.pending.empty()) break;
+        string rel = search.pending.front();
+        search.pending.pop_front();
+        ++search.reading;
+        guard.unlock();
+
+        vector<string> found, subdirs;
+        bool read = read_directory(search, rel, buffer, found, subdirs);
+
+        guard.lock();
+        if (!read && rel == "") search.root_failed = true;
+        search.found.insert(search.found.end(), found.begin(), found.end());
+        search.pending.insert(search.pending.end(), subdirs.begin(),
+                              subdirs.end());
+        --search.reading;
+        search.changed.notify_all();
+    }
+}
+
+
+vector<string> find_files_by_suffix(string dir, string suffix,
+                                    bool recursive)
+{
+    Search search;
+    search.root = (dir == "") ? "." : dir;
+    search.suffix = suffix;
+    search.recursive = recursive;
+    search.reading = 0;
+    search.root_failed = false;
+    search.pending.push_back("");
+
+    unsigned workers = recursive ? thread::hardware_concurrency() : 1;
+    if (workers == 0) workers = 1;
+    if (workers == 1) {
+        search_worker(search);
+    } else {
+        vector<thread> pool;
+        for (unsigned w = 0; w < workers; ++w) {
+            pool.push_back(thread(search_worker, ref(search)));
+        }
+        for (unsigned w = 0; w < workers; ++w) pool[w].join();
+    }
+    if (search.root_failed) {
+        throw string("cannot read directory \"") + search.root + "\"";
+    }
+    sort(search.found.begin(), search.found.end());
+    return search.found;
+}
+
+
+static const string &pair_stem(const pair<string, string> &stems)
+{
+    return (stems.first != "") ? stems.first : stems.second;
+}
+
+static bool stem_less(const pair<string, string> &a,
+                      const pair<string, string> &b)
+{
+    return pair_stem(a) < pair_stem(b);
+}
+
+
+vector< pair<string, string> > pair_by_stem(const vector<string> &first,
+                                            const vector<string> &second)
+{
+    unordered_map<string, unsigned> index;
+    index.reserve(second.size());
+    for (unsigned i = 0; i < second.size(); ++i) index[second[i]] = i;
+    vector<bool> matched(second.size(), false);
+
+    vector< pair<string, string> > r_val;
+    r_val.reserve(first.size() + second.size());
+    for (unsigned i = 0; i < first.size(); ++i) {
+        unordered_map<string, unsigned>::const_iterator found
+            = index.find(first[i]);
+        if (found == index.end()) {
+            r_val.push_back(make_pair(first[i], string()));
+        } else {
+            r_val.push_back(make_pair(first[i], first[i]));
+            matched[found->second] = true;
+        }
+    }
+    for (unsigned i = 0; i < second.size(); ++i) {
+        if (!matched[i]) r_val.push_back(make_pair(string(), second[i]));
+    }
+    sort(r_val.begin(), r_val.end(), stem_less);
+    return r_val;
+}
+
+
+/*  get_io()
+ *  Finds the files of each side with find_files_by_suffix(), pairs them
+ *  with pair_by_stem(), and puts the directories and suffixes back.
+ */
+void get_io(vector<string> &inputs, vector<string> &outputs, string input_dir,
+            string output_dir, string input_suffix, string output_suffix,
+            bool recursive)
+{
+    vector<string> in_stems, out_stems;
+    if (input_dir != "" || input_suffix != "") {
+        in_stems = find_files_by_suffix(input_dir, input_suffix, recursive);
+    }
+    if (output_dir != "" || output_suffix != "") {
+        out_stems = find_files_by_suffix(output_dir, output_suffix,
+                                         recursive);
+    }
+    vector< pair<string, string> > pairs = pair_by_stem(in_stems, out_stems);
+    for (unsigned i = 0; i < pairs.size(); ++i) {
+        inputs.push_back((pairs[i].first == "") ? ""
+                         : join_path(input_dir, pairs[i].first
+                                                + input_suffix));
+        outputs.push_back((pairs[i].second == "") ? ""
+                          : join_path(output_dir, pairs[i].second
+                                                  + output_suffix));
+    }
+}
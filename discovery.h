@@ -0,0 +1,56 @@
+/*---------------------------------------------------------------------------*\
+ *  discovery.h                                                              *
+ *  This file contains the interface for the discovery module, which finds   *
+ *    the input and output files of a test suite and pairs them up.          *
+ *                                                                           *
+ *  find_files_by_suffix() lists the files in a directory whose names end    *
+ *    in a suffix.  With _recursive_, subdirectories are searched too, each  *
+ *    by whichever of a few threads is free.  Each file is returned as its   *
+ *    "stem": its path relative to the directory, minus the suffix.  So,     *
+ *    eg. searching "tests" for ".in" might find "sort/big" for the file     *
+ *    tests/sort/big.in.  The stems are returned sorted.  A file named just  *
+ *    the suffix (eg. ".in") has no stem, and is skipped.                    *
+ *  pair_by_stem() pairs two such lists, matching equal stems.  A stem found *
+ *    in only one list is paired with the empty string.  Pairing is by hash  *
+ *    lookup, so it does not depend on the order of either list.             *
+ *  get_io() does both for the input and output files of a suite, joining   *
+ *    each stem back to the directory it was found in.                       *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef DISCOVERY_H_INCLUDED
+#define DISCOVERY_H_INCLUDED
+
+#include <string>
+#include <utility>
+#include <vector>
+
+std::vector<std::string> find_files_by_suffix(std::string dir,
+                                              std::string suffix,
+                                              bool recursive);
+
+/*  Returns pairs of stems, one from each list, in order of stem.
+ */
+std::vector< std::pair<std::string, std::string> >
+pair_by_stem(const std::vector<std::string> &first,
+             const std::vector<std::string> &second);
+
+/*  Given a vector for inputs and one for outputs, and directories and
+ *  suffixes identifying each, adds corresponding files to each vector.
+ *  "Corresponding" means having the same "filename" - the part of a file's
+ *  path not including its directory and its suffix.  So, eg.
+ *   input_dir/F.input_ext  matches  output_dir/F.output_ext
+ *  because "F" == "F"
+ *  Where a file is found without a match, the empty string is added as that
+ *  output's "match".
+ *  If recursive is set, subdirectories are searched too, and the relative
+ *  path takes part in the match, so that
+ *   input_dir/D/F.input_ext  matches  output_dir/D/F.output_ext
+ *  Pairs are added in order of that relative path.
+ */
+void get_io(std::vector<std::string> &inputs,
+            std::vector<std::string> &outputs, std::string input_dir,
+            std::string output_dir, std::string input_suffix,
+            std::string output_suffix, bool recursive);
+
+#endif
@@ -0,0 +1,158 @@
+/*---------------------------------------------------------------------------*\
+ *  elf-symbols.cpp                                                          *
+ *  This implementation reads only the headers and the symbol and string     *
+ *    tables of a file, with pread(), rather than the whole file.  An offset *
+ *    is turned into an address with the loadable segment that holds it,     *
+ *    and the address looked up by binary search among the functions.        *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "elf-symbols.h"
+using namespace std;
+
+
+static bool read_at(int fd, void *buffer, size_t size, uint64_t offset)
+{
+    char *into = (char *) buffer;
+    while (size > 0) {
+        ssize_t got = pread(fd, into, size, offset);
+        if (got <= 0) return false;
+        into += got;
+        size -= got;
+        offset += got;
+    }
+    return true;
+}
+
+/*  load()
+ *  Returns false, leaving no symbols, if the file cannot be read or is not
+ *  a 64-bit ELF file.
+ */
+bool ElfSymbols::load(string path)
+{
+    symbols.clear();
+    segments.clear();
+    demangled.clear();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    Elf64_Ehdr header;
+    if (!read_at(fd, &header, sizeof(header), 0)
+        || memcmp(header.e_ident, ELFMAG, SELFMAG) != 0
+        || header.e_ident[EI_CLASS] != ELFCLASS64
+        || header.e_shentsize != sizeof(Elf64_Shdr)
+        || header.e_phentsize != sizeof(Elf64_Phdr)) {
+        close(fd);
+        return false;
+    }
+    vector<Elf64_Phdr> programs(header.e_phnum);
+    vector<Elf64_Shdr> sections(header.e_shnum);
+    if ((header.e_phnum
+         && !read_at(fd, &programs[0], header.e_phnum * sizeof(Elf64_Phdr),
+                     header.e_phoff))
+        || (header.e_shnum
+            && !read_at(fd, &sections[0],
+                        header.e_shnum * sizeof(Elf64_Shdr),
+                        header.e_shoff))) {
+        close(fd);
+        return false;
+    }
+    for (unsigned i = 0; i < programs.size(); ++i) {
+        if (programs[i].p_type != PT_LOAD) continue;
+        Segment segment;
+        segment.offset = programs[i].p_offset;
+        segment.size = programs[i].p_filesz;
+        segment.address = programs[i].p_vaddr;
+        segments.push_back(segment);
+    }
+
+    bool has_symtab = false;
+    for (unsigned i = 0; i < sections.size(); ++i) {
+        if (sections[i].sh_type == SHT_SYMTAB) has_symtab = true;
+    }
+    unsigned table_type = has_symtab ? SHT_SYMTAB : SHT_DYNSYM;
+    for (unsigned i = 0; i < sections.size(); ++i) {
+        const Elf64_Shdr &table = sections[i];
+        if (table.sh_type != table_type || table.sh_link >= sections.size()
+            || table.sh_entsize != sizeof(Elf64_Sym)) {
+            continue;
+        }
+        const Elf64_Shdr &strtab = sections[table.sh_link];
+        vector<Elf64_Sym> entries(table.sh_size / sizeof(Elf64_Sym));
+        string names(strtab.sh_size, '\0');
+        if (entries.empty() || names.empty()
+            || !read_at(fd, &entries[0], entries.size() * sizeof(Elf64_Sym),
+                        table.sh_offset)
+            || !read_at(fd, &names[0], names.size(), strtab.sh_offset)) {
+            continue;
+        }
+        for (unsigned j = 0; j < entries.size(); ++j) {
+            const Elf64_Sym &entry = entries[j];
+            unsigned type = ELF64_ST_TYPE(entry.st_info);
+            if ((type != STT_FUNC && type != STT_GNU_IFUNC)
+                || entry.st_shndx == SHN_UNDEF || entry.st_value == 0
+                || entry.st_name >= names.size()) {
+                continue;
+            }
+            Symbol symbol;
+            symbol.start = entry.st_value;
+            symbol.size = entry.st_size;
+            symbol.name = names.c_str() + entry.st_name;
+            symbols.push_back(symbol);
+        }
+    }
+    close(fd);
+    sort(symbols.begin(), symbols.end(),
+         [](const Symbol &a, const Symbol &b) { return a.start < b.start; });
+    return true;
+}
+
+
+/*  name_at()
+ *  Returns the empty string if the offset is in no loaded segment, or in
+ *  none of the functions.  A function of unknown size is taken to run up to
+ *  the next one.
+ */
+string ElfSymbols::name_at(uint64_t offset) const
+{
+    uint64_t address = 0;
+    bool found = false;
+    for (unsigned i = 0; i < segments.size() && !found; ++i) {
+        if (offset >= segments[i].offset
+            && offset < segments[i].offset + segments[i].size) {
+            address = offset - segments[i].offset + segments[i].address;
+            found = true;
+        }
+    }
+    if (!found || symbols.empty()) return "";
+
+    unsigned low = 0, high = symbols.size();
+    while (low < high) {
+        unsigned mid = (low + high) / 2;
+        if (symbols[mid].start <= address) low = mid + 1;
+        else high = mid;
+    }
+    if (low == 0) return "";
+    unsigned index = low - 1;
+    const Symbol &symbol = symbols[index];
+    if (symbol.size != 0 && address >= symbol.start + symbol.size) return "";
+
+    map<unsigned, string>::const_iterator cached = demangled.find(index);
+    if (cached != demangled.end()) return cached->second;
+    string name = symbol.name;
+    int status;
+    char *readable = abi::__cxa_demangle(name.c_str(), NULL, NULL, &status);
+    if (readable != NULL) {
+        name = readable;
+        free(readable);
+    }
+    demangled[index] = name;
+    return name;
+}
@@ -0,0 +1,49 @@
+/*---------------------------------------------------------------------------*\
+ *  elf-symbols.h                                                            *
+ *  This file contains the interface for the ElfSymbols class, which reads   *
+ *    the function symbols of an ELF file (an executable or shared library)  *
+ *    so that addresses in it can be given as function names.                *
+ *                                                                           *
+ *  ElfSymbols::load() reads the symbol table of a file, or, if it has been  *
+ *    stripped, the dynamic symbol table, which names at least its exported  *
+ *    functions.  Only 64-bit files are read.                                *
+ *  ElfSymbols::name_at() names the function at an offset in the file, as    *
+ *    found in a mapping of it (eg. from /proc/<pid>/maps), so that it does  *
+ *    not matter where the file was loaded.  C++ names are demangled.        *
+ *                                                                           *
+ *  TO DO:                                                                   *
+ *   - Read 32-bit files                                                     *
+ *   - Follow .gnu_debuglink to separate debug files                         *
+\*---------------------------------------------------------------------------*/
+#ifndef ELF_SYMBOLS_H_INCLUDED
+#define ELF_SYMBOLS_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class ElfSymbols
+{
+public:
+    bool load(std::string path);
+    std::string name_at(uint64_t offset) const;
+
+private:
+    struct Symbol {
+        uint64_t start;
+        uint64_t size;
+        std::string name;
+    };
+    struct Segment {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t address;
+    };
+
+    std::vector<Symbol> symbols;        /* by start */
+    std::vector<Segment> segments;
+    mutable std::map<unsigned, std::string> demangled;
+};
+
+#endif
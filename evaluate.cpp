@@ -3,9 +3,15 @@
  *  Written By: Colin Hamilton, Tufts University                             *
  *  This file should be supplied with a Makefile.  The "make" command should *
  *    compile it.  If the Makefile is not there, you can run                 *
- *    g++ evaluate.cpp execute-process.cpp timer.cpp tester.cpp \            *
+ *    g++ evaluate.cpp evaluator.cpp execute-process.cpp timer.cpp \         *
+ *        tester.cpp scaling.cpp statistics.cpp cgroup.cpp cache.cpp \       *
+ *        discovery.cpp results.cpp history.cpp worker.cpp watch.cpp \       *
+ *        process-loop.cpp trace.cpp profile.cpp elf-symbols.cpp \           *
+ *        syscall-names.cpp \                                                *
  *        -lboost_program_options -lboost_filesystem -lboost_system \        *
+ *        -pthread \                                                         *
  *        -o evaluate                                                        *
+ *    after making syscall-table.h as the Makefile does.                     *
  *                                                                           *
  *  As that command indicates, this program relies on three boost libraries: *
  *    boost::program_options, boost::filesystem, and boost::system.          *
@@ -13,21 +19,37 @@
  *    http://www.boost.org                                                   *
  *                                                                           *
  *  This main file primarily evaluates program options and finds specified   *
- *    files.  The evaluate() function contains the core of the program,      *
- *    and relies on functions from the execute-process, timer, and tester    *
- *    modules.                                                               *
+ *    files.  The tests themselves are run and checked by an Evaluator (see  *
+ *    evaluator.h); the evaluate() function drives it test by test, adding   *
+ *    what only the command line does: the result cache, the journal, the    *
+ *    history, and the timing report.                                        *
  *                                                                           *
  *  TO DO:                                                                   *
  *   - Move much of this file into a separate module                         *
 \*---------------------------------------------------------------------------*/
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <sched.h>
 #include <boost/program_options.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
 #include "execute-process.h"
 #include "timer.h"
 #include "tester.h"
+#include "scaling.h"
+#include "cache.h"
+#include "discovery.h"
+#include "evaluator.h"
+#include "results.h"
+#include "history.h"
+#include "worker.h"
+#include "watch.h"
+#include "trace.h"
+#include "profile.h"
 using namespace std;
 
 
@@ -42,7 +64,9 @@ const string DESCRIPTION =
 
 const string USAGE_INFORMATION =
     "Usage: evaluate [options] executable\n"
-    "Or:    evaluate [options] -- executable arguments";
+    "Or:    evaluate [options] -- executable arguments\n"
+    "Or:    evaluate merge results-file...\n"
+    "Or:    evaluate --worker --listen socket";
 
 struct ProgramOptions {
     string program_name;
@@ -51,6 +75,7 @@ struct ProgramOptions {
     vector<string> outputs;
     string input_dir;
     string output_dir;
+    bool recursive;
     string copy_dir;
     string copy_suffix;
     string input_suffix;
@@ -59,6 +84,9 @@ struct ProgramOptions {
     string ignore_chars;
     string timing_header;
     string timing_footer;
+    string size_source;
+    string histogram;
+    string cpu_affinity;
     bool just_test;
     bool just_time;
     bool be_quiet;
@@ -70,34 +98,140 @@ struct ProgramOptions {
     bool ignore_space;
     bool cp_fail;
     bool cp_all;
+    bool scaling;
+    bool online;
+    bool stats;
+    bool subtract_overhead;
+    bool drop_caches;
+    bool use_cgroup;
+    bool memory;
     unsigned times;
-    unsigned max_cpu;
-    unsigned max_real;
+    unsigned calibrate;
+    unsigned warmup;
+    unsigned fifo_priority;
+    int nice;
+    double max_cpu;
+    double max_real;
     unsigned time_precision;
     unsigned spacing;
     unsigned max_width;
+    double predict_n;
+    ProcessOptions process;
+    string error_suffix;
+    string code_suffix;
+    string cache_file;
+    int expect_exit;
+    bool incremental;
+    bool cached_times;
+    string results_file;
+    string history_file;
+    unsigned shard_index;
+    unsigned shard_count;
+    bool worker;
+    string listen;
+    vector<string> connect;
+    bool fail_fast;
+    string order;
+    bool watch;
+    string journal_file;
+    bool resume;
+    string trace_file;
+    string profile_dir;
+    unsigned profile_frequency;
+    bool measure_io;
+    bool count_syscalls;
+    unsigned memory_timeline_ms;
+    string sweep_env;
+    string sweep_arg;
+    vector<string> matrix;
+};
+
+/*  One parameter a sweep or matrix varies: an environment variable, or,
+ *  when placeholder is set, the text put in place of it in the program's
+ *  arguments.
+ */
+struct SweepDimension {
+    string name;
+    string placeholder;
+    vector<string> values;
+};
+
+/*  Keeps the command line's record of the runs an Evaluator makes: their
+ *  times, in the TimeSet of the current test, and their lines in the results
+ *  file and the journal.  Counts the checks passed in successful.
+ */
+class RunRecorder : public EvaluationObserver
+{
+public:
+    RunRecorder(ProgramOptions *opts, ResultLog &log, ResultLog &journal,
+                unsigned &successful);
+
+    TimeSet *times;
+
+    void on_run_complete(const TestOutcome &test, unsigned repetition,
+                         const ProgramInfo &run);
+    void on_verdict(const TestOutcome &test, unsigned repetition,
+                    const Verdict &verdict);
+
+private:
+    ProgramOptions *opts;
+    ResultLog &log;
+    ResultLog &journal;
+    unsigned &successful;
+    ProgramInfo last_run;
 };
 
 void parse_command_line_args(int argc, char *argv[], ProgramOptions *opts);
 void verify_args(ProgramOptions *opts);
 string unescape(string s, char control = '\\');
-void get_io(vector<string> &inputs, vector<string> &outputs, string input_dir,
-            string output_dir, string input_suffix, string output_suffix);
-
-char **vector_to_argv(string name, vector<string> *vect);
-void evaluate(string name, vector<string> args,
-              vector<string> inputs, vector<string> outputs,
-              ProgramOptions *opts,
-              Timer &tim, Tester &tes);
-string make_temp_file();
-void copy_output(string source, string dest_dir, string dest_ext,
-                 string dest_name, bool print);
-void run_one_test(string name, char **argv, string in, string temp_in,
-                  string out, string temp_out,
-                  vector<ProgramInfo> &result_list, ProgramOptions *opts,
-                  bool print_test, unsigned &successful, Tester &tes);
-bool report_test_results(Tester &tes, string input_name, int exit_code,
-                         ProgramOptions *opts, unsigned &successful);
+vector<int> parse_cpu_list(string list);
+vector<string> split_commas(string list);
+vector<SweepDimension> sweep_dimensions(ProgramOptions *opts);
+
+vector<TimeSet> evaluate(string name, vector<string> args,
+                         vector<string> inputs, vector<string> outputs,
+                         ProgramOptions *opts,
+                         Timer &tim, Tester &tes);
+void find_tests(ProgramOptions *opts, vector<string> &inputs,
+                vector<string> &outputs);
+void watch_tests(ProgramOptions *opts, Timer &tim, Tester &tes);
+void sweep(vector<string> inputs, vector<string> outputs,
+           ProgramOptions *opts, Timer &tim, Tester &tes);
+void configure_evaluator(Evaluator &ev, string name,
+                         const vector<string> &args, ProgramOptions *opts,
+                         Tester &tes);
+void configure_reporter(TextReporter &reporter, ProgramOptions *opts);
+void calibrate(ProgramOptions *opts, Timer &tim);
+string history_name(string in, string out);
+void select_shard(vector<string> &inputs, vector<string> &outputs,
+                  unsigned index, unsigned count, string history_file);
+int merge_results(int argc, char *argv[]);
+void evaluate_remote(string name, vector<string> args,
+                     vector<string> inputs, vector<string> outputs,
+                     ProgramOptions *opts, Timer &tim, Tester &tes);
+string shared_path(string path);
+void order_tests(vector<string> &inputs, vector<string> &outputs,
+                 string order, string history_file);
+void report_stop(unsigned not_run);
+void hash_test_files(ResultCache &cache, const Evaluator &ev, string name,
+                     const vector<string> &inputs,
+                     const vector<string> &outputs);
+string test_key(ResultCache &cache, const Evaluator &ev, string name,
+                const vector<string> &args, string in, string out,
+                ProgramOptions *opts, Tester &tes);
+bool report_cached_test(string in, const CachedResult &cached,
+                        TimeSet &result_set, ProgramOptions *opts);
+string journal_fingerprint(string name, const vector<string> &args,
+                           ProgramOptions *opts, Tester &tes);
+void open_journal(ResultLog &journal, string name, const vector<string> &args,
+                  ProgramOptions *opts, Tester &tes,
+                  map< pair<string, string>, LoggedTest > &journaled);
+void save_profile(Profiler &profiler, const TestOutcome &test,
+                  TimeSet &times, ProgramOptions *opts);
+bool replay_journaled_run(string in, const LoggedTest &logged,
+                          unsigned repetition, bool print_test,
+                          TimeSet &result_set, ResultLog &log,
+                          ProgramOptions *opts, unsigned &successful);
 
 int main(int argc, char *argv[])
 {
@@ -105,7 +239,19 @@ int main(int argc, char *argv[])
     Tester tes;
     vector<string> inputs, outputs;
     ProgramOptions opts;
+    if (argc > 1 && string(argv[1]) == "merge") {
+        return merge_results(argc - 1, argv + 1);
+    }
     parse_command_line_args(argc, argv, &opts);
+    supervise_processes();
+    if (opts.worker) {
+        try {
+            serve_jobs(opts.listen);
+        } catch (string err) {
+            cerr << "Error: " << err << endl;
+        }
+        return 1;
+    }
     if (opts.ignore_space) tes.ignore_whitespace();
     tes.ignore_chars(opts.ignore_chars);
     if (opts.all_times) {
@@ -114,14 +260,66 @@ int main(int argc, char *argv[])
     } else if (opts.avg_time) {
         tim.report_only_avg();
     }
+    if (opts.stats) tim.report_statistics();
+    if (opts.memory) tim.report_memory();
+    if (opts.histogram == "auto") tim.report_histograms(HISTOGRAM_AUTO);
+    if (opts.histogram == "linear") tim.report_histograms(HISTOGRAM_LINEAR);
+    if (opts.histogram == "log") tim.report_histograms(HISTOGRAM_LOG);
+    if (opts.warmup) {
+        tim.add_condition("Warmup runs",
+                          boost::lexical_cast<string>(opts.warmup));
+    }
+    if (opts.cpu_affinity != "") {
+        tim.add_condition("CPU affinity", opts.cpu_affinity);
+    }
+    if (opts.fifo_priority) {
+        tim.add_condition("Scheduling", "SCHED_FIFO, priority "
+                          + boost::lexical_cast<string>(opts.fifo_priority));
+    }
+    if (opts.nice) {
+        tim.add_condition("Niceness", "adjusted by "
+                          + boost::lexical_cast<string>(opts.nice));
+    }
+    if (opts.use_cgroup) {
+        tim.add_condition("Process trees", "run in cgroups where possible");
+    }
+    if (opts.drop_caches) {
+        tim.add_condition("Input files", "dropped from the page cache "
+                          "before each run");
+    }
     tim.precision_after_decimal(opts.time_precision).spacing(opts.spacing)
        .line_width(opts.max_width).set_header(opts.timing_header)
        .set_footer(opts.timing_footer);
 
-    get_io(opts.inputs, opts.outputs, opts.input_dir, opts.output_dir,
-           opts.input_suffix, opts.output_suffix);
-    evaluate(opts.program_name, opts.args, opts.inputs, opts.outputs,
-             &opts, tim, tes);
+    if (opts.watch) {
+        watch_tests(&opts, tim, tes);
+        return 1;
+    }
+    if (opts.trace_file != "") start_tracing();
+    try {
+        find_tests(&opts, inputs, outputs);
+    } catch (string err) {
+        cerr << "Error: " << err << endl;
+        exit(1);
+    }
+    if (opts.sweep_env != "" || opts.sweep_arg != ""
+        || !opts.matrix.empty()) {
+        sweep(inputs, outputs, &opts, tim, tes);
+    } else if (opts.connect.empty()) {
+        evaluate(opts.program_name, opts.args, inputs, outputs,
+                 &opts, tim, tes);
+    } else {
+        evaluate_remote(opts.program_name, opts.args, inputs, outputs,
+                        &opts, tim, tes);
+    }
+    if (opts.trace_file != "") {
+        try {
+            write_trace(opts.trace_file);
+        } catch (string err) {
+            cerr << "Error: " << err << endl;
+            return 1;
+        }
+    }
 
     return 0;
 }
@@ -144,10 +342,17 @@ void parse_command_line_args(int argc, char *argv[], ProgramOptions *opts)
         ("help,h", po::value<string>()->implicit_value(""),
              "Produce help message")
         ("version,v", "Produce version, origin, and legal information")
-        ("program", po::value<string>(&(opts->program_name))->required(),
+        ("program", po::value<string>(&(opts->program_name)),
             "Specify executable to run")
         ("arg", po::value< vector<string> >(&(opts->args)),
             "Specify arguments to pass to the executable")
+        ("worker", po::bool_switch(&(opts->worker)),
+            "Run tests sent by other evaluate processes, instead")
+        ("listen", po::value<string>(&(opts->listen)),
+            "Specify the Unix socket on which a worker listens")
+        ("connect", po::value< vector<string> >(&(opts->connect)),
+            "Send tests to the worker listening on this socket; give it "
+            "again for each test to run there at a time")
     ;
     general.add_options()
         ("input-file,f", po::value< vector<string> >(&(opts->inputs)),
@@ -162,6 +367,59 @@ void parse_command_line_args(int argc, char *argv[], ProgramOptions *opts)
             "Specify the suffix (eg. an extension) identifying input files")
         ("output-ext,E", po::value<string>(&(opts->output_suffix)),
             "Specify the suffix (eg. an extension) identifying output files")
+        ("recursive", po::bool_switch(&(opts->recursive)),
+            "Search subdirectories of the input and output directories too")
+        ("shard-index", po::value<unsigned>(&(opts->shard_index))
+                            ->default_value(0),
+            "Run only this shard of the tests, counting from 0")
+        ("shard-count", po::value<unsigned>(&(opts->shard_count))
+                            ->default_value(1),
+            "Split the tests into this many shards of about equal time")
+        ("history", po::value<string>(&(opts->history_file)),
+            "Specify a file recording each test's last verdict and time, "
+            "used to balance shards (which do not update it)")
+        ("results", po::value<string>(&(opts->results_file)),
+            "Write a machine-readable record of every run and verdict to "
+            "this file")
+        ("journal", po::value<string>(&(opts->journal_file)),
+            "Record every finished run in this file, synced to disk as the "
+            "tests go, so that the run can be resumed")
+        ("resume", po::bool_switch(&(opts->resume)),
+            "Skip the runs already recorded in the --journal file, and "
+            "report them as if they had been run again")
+        ("trace", po::value<string>(&(opts->trace_file)),
+            "Write a timeline of the harness's own work and of every run "
+            "to this file, in Chrome trace format (eg. for Perfetto)")
+        ("profile", po::value<string>(&(opts->profile_dir)),
+            "Sample where each test's program spends its CPU time, and write "
+            "its call stacks to <input>.folded in this directory, for flame "
+            "graph tools; with -m, list its hottest functions as well")
+        ("profile-frequency",
+            po::value<unsigned>(&(opts->profile_frequency))
+                ->default_value(999),
+            "Take this many --profile samples per second of CPU time")
+        ("io", po::bool_switch(&(opts->measure_io)),
+            "Measure what each run reads and writes, and in how many system "
+            "calls, from /proc/<pid>/io")
+        ("count-syscalls", po::bool_switch(&(opts->count_syscalls)),
+            "Make one more run of each test, untimed and under ptrace, and "
+            "report the system calls it made most often")
+        ("memory-timeline", po::value<unsigned>(&(opts->memory_timeline_ms))
+                                ->default_value(0),
+            "Sample each run's resident memory every this many milliseconds "
+            "while it runs, and draw the highest run's over time")
+        ("sweep-env", po::value<string>(&(opts->sweep_env)),
+            "Given NAME=v1,v2,..., run the tests once with each value of "
+            "the environment variable NAME, and report how the times scale")
+        ("sweep-arg", po::value<string>(&(opts->sweep_arg)),
+            "Given v1,v2,..., run the tests once with each value in place "
+            "of {} in the program's arguments, and report how the times "
+            "scale")
+        ("matrix", po::value< vector<string> >(&(opts->matrix)),
+            "Given NAME=v1,v2,..., which may be repeated, run the tests once "
+            "for every combination of values, each in place of {NAME} in "
+            "the program's arguments or else as the environment variable "
+            "NAME, and compare the combinations")
         ("test,s", po::bool_switch(&(opts->just_test)),
             "Only run tests, do not time")
         ("time,m", po::bool_switch(&(opts->just_time)),
@@ -188,18 +446,62 @@ void parse_command_line_args(int argc, char *argv[], ProgramOptions *opts)
             "Save outputs of failed tests")
         ("copy-all,Y", po::bool_switch(&(opts->cp_all)),
             "Save outputs of all tests")
+        ("error-ext", po::value<string>(&(opts->error_suffix))
+                            ->default_value(".err"),
+            "Specify the suffix identifying files of expected error output")
+        ("code-ext", po::value<string>(&(opts->code_suffix))
+                            ->default_value(".code"),
+            "Specify the suffix identifying files of expected exit codes")
+        ("expect-exit", po::value<int>(&(opts->expect_exit))
+                            ->default_value(-1),
+            "Expect every test to exit with this code (-1 for any)")
+        ("watch", po::bool_switch(&(opts->watch)),
+            "Keep running, and evaluate again the tests affected whenever "
+            "the executable or test files change")
+        ("fail-fast", po::bool_switch(&(opts->fail_fast)),
+            "Stop at the first test that fails")
+        ("order", po::value<string>(&(opts->order)),
+            "Run tests in order of their history: failed-first, "
+            "slowest-first, or fastest-first")
+        ("incremental", po::bool_switch(&(opts->incremental)),
+            "Skip tests that passed before, if neither the executable nor "
+            "their files have changed")
+        ("cache-file", po::value<string>(&(opts->cache_file))
+                            ->default_value(".evaluate-cache"),
+            "Specify the file recording results for --incremental")
+        ("cached-times", po::bool_switch(&(opts->cached_times)),
+            "Report the recorded times of tests skipped by --incremental")
         ("copy-dir,p", po::value<string>(&(opts->copy_dir)),
             "Specify a directory in which to save copies of test output")
         ("copy-ext,P", po::value<string>(&(opts->copy_suffix)),
             "Specify a suffix (eg. an extension) to identify output copies")
     ;
     timing.add_options()
-        ("max-cpu,x", po::value<unsigned>(&(opts->max_cpu))
+        ("max-cpu,x", po::value<double>(&(opts->max_cpu))
+                            ->default_value(0),
+            "Set a CPU time limit for each test in seconds, eg. 0.15 "
+            "(0 for no limit)")
+        ("max-real,X", po::value<double>(&(opts->max_real))
                             ->default_value(0),
-            "Set a CPU time limit for each test in seconds (0 for no limit)")
-        ("max-real,X", po::value<unsigned>(&(opts->max_real))
+            "Set a real-time limit for each test in seconds, eg. 0.15 "
+            "(0 for no limit)")
+        ("warmup", po::value<unsigned>(&(opts->warmup))
                             ->default_value(0),
-            "Set a real-time limit for each test in seconds (0 for no limit)")
+            "Specify number of unmeasured runs before each test")
+        ("cpu-affinity", po::value<string>(&(opts->cpu_affinity)),
+            "Run tests only on these CPUs (eg. 0-3,8)")
+        ("fifo", po::value<unsigned>(&(opts->fifo_priority))
+                            ->default_value(0),
+            "Run tests under SCHED_FIFO at this priority (0 to not)")
+        ("nice", po::value<int>(&(opts->nice))->default_value(0),
+            "Adjust the niceness of tests by this amount")
+        ("drop-caches-for-input", po::bool_switch(&(opts->drop_caches)),
+            "Drop each input file from the page cache before it is run")
+        ("cgroup", po::bool_switch(&(opts->use_cgroup)),
+            "Run each test in its own cgroup, to account for and kill "
+            "every process it starts")
+        ("memory", po::bool_switch(&(opts->memory)),
+            "Report the peak memory of each test")
         ("precision,p", po::value<unsigned>(&(opts->time_precision))
                             ->default_value(4),
             "Set decimal precision for timing output")
@@ -218,6 +520,29 @@ void parse_command_line_args(int argc, char *argv[], ProgramOptions *opts)
             "Specify a header for each item in timing report")
         ("footer,R", po::value<string>(&(opts->timing_footer)),
             "Specify a footer for each item in timing report")
+        ("stats", po::bool_switch(&(opts->stats)),
+            "Report the standard deviation, median, and 90th percentile "
+            "of each time")
+        ("histogram", po::value<string>(&(opts->histogram))
+                            ->implicit_value("auto"),
+            "Draw a histogram of each time's runs (auto/linear/log)")
+        ("online", po::bool_switch(&(opts->online)),
+            "Report each test's times as soon as it finishes")
+        ("calibrate", po::value<unsigned>(&(opts->calibrate))
+                            ->default_value(0),
+            "Measure harness overhead over this many runs of a trivial "
+            "program")
+        ("subtract-overhead", po::bool_switch(&(opts->subtract_overhead)),
+            "Subtract the measured harness overhead from reported times")
+        ("scaling", po::bool_switch(&(opts->scaling)),
+            "Fit the times of all tests against their input sizes")
+        ("size-from", po::value<string>(&(opts->size_source))
+                            ->default_value("auto"),
+            "Specify how to find input sizes for --scaling "
+            "(auto/name/sidecar/bytes)")
+        ("predict-n", po::value<double>(&(opts->predict_n))
+                            ->default_value(0),
+            "Predict the real time at this input size when scaling")
     ;
     all.add(program).add(general).add(testing).add(timing);
     p_desc.add("program", 1);
@@ -273,6 +598,98 @@ void parse_command_line_args(int argc, char *argv[], ProgramOptions *opts)
  */
 void verify_args(ProgramOptions *opts)
 {
+    if (opts->worker) {
+        if (opts->listen == "") {
+            cerr << "Error in arguments: a worker needs a socket to "
+                 << "--listen on" << endl;
+            exit(1);
+        }
+        return;
+    }
+    if (opts->program_name == "") {
+        cerr << "Error in arguments: the option '--program' is required "
+             << "but missing" << endl;
+        cerr << "(For help, use the --help or -h options)" << endl;
+        exit(1);
+    }
+    if (opts->watch && (!opts->connect.empty() || opts->shard_count > 1)) {
+        cerr << "Error in arguments: --watch cannot be used with --connect "
+             << "or shards" << endl;
+        exit(1);
+    }
+    if (opts->resume && opts->journal_file == "") {
+        cerr << "Error in arguments: --resume needs a --journal to resume "
+             << "from" << endl;
+        exit(1);
+    }
+    if (opts->journal_file != "" && (opts->watch || !opts->connect.empty())) {
+        cerr << "Error in arguments: --journal cannot be used with --watch "
+             << "or --connect" << endl;
+        exit(1);
+    }
+    if (opts->trace_file != "" && opts->watch) {
+        cerr << "Error in arguments: --trace cannot be used with --watch"
+             << endl;
+        exit(1);
+    }
+    if (opts->profile_dir != "" && (opts->watch || !opts->connect.empty())) {
+        cerr << "Error in arguments: --profile cannot be used with --watch "
+             << "or --connect" << endl;
+        exit(1);
+    }
+    if ((opts->measure_io || opts->count_syscalls
+         || opts->memory_timeline_ms)
+        && (opts->watch || !opts->connect.empty())) {
+        cerr << "Error in arguments: --io, --count-syscalls, and "
+             << "--memory-timeline cannot be used with --watch or --connect"
+             << endl;
+        exit(1);
+    }
+    if (opts->order != "" && opts->order != "failed-first"
+        && opts->order != "slowest-first" && opts->order != "fastest-first") {
+        cerr << "Error in arguments: the order must be failed-first, "
+             << "slowest-first, or fastest-first" << endl;
+        exit(1);
+    }
+    if (opts->order != "" && opts->history_file == "") {
+        opts->history_file = ".evaluate-history";
+    }
+    bool sweeping = opts->sweep_env != "" || opts->sweep_arg != ""
+                    || !opts->matrix.empty();
+    if ((opts->sweep_env != "") + (opts->sweep_arg != "")
+        + !opts->matrix.empty() > 1) {
+        cerr << "Error in arguments: only one of --sweep-env, --sweep-arg, "
+             << "and --matrix can be given" << endl;
+        exit(1);
+    }
+    if (sweeping
+        && (opts->watch || !opts->connect.empty() || opts->incremental
+            || opts->journal_file != "" || opts->history_file != ""
+            || opts->results_file != "")) {
+        cerr << "Error in arguments: a sweep or --matrix cannot be used "
+             << "with --watch, --connect, --incremental, --journal, "
+             << "--history, --order, or --results" << endl;
+        exit(1);
+    }
+    if (sweeping) {
+        try {
+            sweep_dimensions(opts);
+        } catch (string err) {
+            cerr << "Error in arguments: " << err << endl;
+            exit(1);
+        }
+    }
+    if (opts->profile_frequency == 0) {
+        cerr << "Error in arguments: --profile-frequency must be positive"
+             << endl;
+        exit(1);
+    }
+    if (!opts->connect.empty() && (opts->incremental || opts->online
+                                   || opts->warmup || opts->calibrate)) {
+        cerr << "Error in arguments: --incremental, --online, --warmup, "
+             << "and --calibrate cannot be used with --connect" << endl;
+        exit(1);
+    }
     if (!opts->just_test && !opts->just_time) {
         opts->just_test = opts->just_time = true;
     }
@@ -283,8 +700,8 @@ void verify_args(ProgramOptions *opts)
         cerr << "Error in arguments: cannot be both quiet and loud!" << endl;
         exit(1);
     }
-    if (opts->cp_fail || opts->cp_all &&
-        (opts->copy_dir == "" || opts->copy_suffix == "")) {
+    if ((opts->cp_fail || opts->cp_all)
+        && opts->copy_dir == "" && opts->copy_suffix == "") {
         cerr << "To copy test outputs, please specify a directory or "
              << "extension for the copied files" << endl;
         exit(1);
@@ -293,6 +710,11 @@ void verify_args(ProgramOptions *opts)
         (opts->copy_dir != "" || opts->copy_suffix != "")) {
         opts->cp_fail = true;
     }
+    if (!opts->connect.empty() && (opts->cp_fail || opts->cp_all)) {
+        cerr << "Error in arguments: outputs cannot be copied from runs "
+             << "made with --connect" << endl;
+        exit(1);
+    }
     unsigned in_size = opts->inputs.size();
     unsigned out_size = opts->outputs.size();
     while (in_size < out_size) {
@@ -309,6 +731,54 @@ void verify_args(ProgramOptions *opts)
             exit(1);
         }
     }
+    if (sweeping && !opts->just_time) {
+        cerr << "Error in arguments: cannot sweep without timing" << endl;
+        exit(1);
+    }
+    if (opts->scaling && !opts->just_time) {
+        cerr << "Error in arguments: cannot fit scaling without timing"
+             << endl;
+        exit(1);
+    }
+    if (opts->shard_count == 0 || opts->shard_index >= opts->shard_count) {
+        cerr << "Error in arguments: the shard index must be less than "
+             << "the shard count" << endl;
+        exit(1);
+    }
+    if (opts->incremental && !opts->just_test) {
+        cerr << "Error in arguments: --incremental needs tests to be "
+             << "evaluated" << endl;
+        exit(1);
+    }
+    if (opts->subtract_overhead && opts->calibrate == 0) {
+        opts->calibrate = 20;
+    }
+    if (opts->histogram != "" && opts->histogram != "auto"
+        && opts->histogram != "linear" && opts->histogram != "log") {
+        cerr << "Error in arguments: histogram scale must be "
+             << "auto, linear, or log" << endl;
+        exit(1);
+    }
+    try {
+        parse_size_source(opts->size_source);
+    } catch (string err) {
+        cerr << "Error in arguments: " << err << endl;
+        exit(1);
+    }
+    try {
+        opts->process.cpus = parse_cpu_list(opts->cpu_affinity);
+    } catch (string err) {
+        cerr << "Error in arguments: " << err << endl;
+        exit(1);
+    }
+    opts->process.max_cpu_time = opts->max_cpu;
+    opts->process.max_real_time = opts->max_real;
+    opts->process.nice = opts->nice;
+    opts->process.fifo_priority = opts->fifo_priority;
+    opts->process.drop_input_cache = opts->drop_caches;
+    opts->process.use_cgroup = opts->use_cgroup;
+    opts->process.measure_io = opts->measure_io;
+    opts->process.memory_interval = opts->memory_timeline_ms / 1000.0;
     opts->timing_header = unescape(opts->timing_header);
     opts->timing_footer = unescape(opts->timing_footer);
 }
@@ -337,7 +807,6 @@ string unescape(string s, char control)
             case 't':  c = '\t'; break;
             case 'v':  c = '\v'; break;
             case '0':  c = '\0'; break;
-            case control: c = control; break;
             default:
                 c = *(it - 1);
             }
@@ -348,241 +817,952 @@ string unescape(string s, char control)
 }
 
 
-/*  vector_to_argv()
- *  Takes the name of a program and a vector of its arguments, as strings,
- *    and converts them into standard argv format (that expected by the exec
- *    family of functions).  That is, it is a NULL-terminated array of
- *    null-terminated character arrays, where the first contains the name
- *    of the program, and the rest contain the program's arguments.
+/*  parse_cpu_list()
+ *  Reads a list of CPUs in the form used by taskset and the kernel, eg.
+ *  "0-3,8,10-11", and returns the CPUs it names.  Throws a string
+ *  describing the error if the list is malformed.
+ */
+vector<int> parse_cpu_list(string list)
+{
+    vector<int> cpus;
+    stringstream ss(list);
+    string range;
+    while (getline(ss, range, ',')) {
+        int first, last;
+        char dash, extra;
+        stringstream rs(range);
+        if (!(rs >> first)) {
+            throw string("invalid CPU list \"") + list + "\"";
+        }
+        last = first;
+        if (rs >> dash && (dash != '-' || !(rs >> last))) {
+            throw string("invalid CPU list \"") + list + "\"";
+        }
+        if (rs >> extra || first < 0 || last < first
+            || last >= CPU_SETSIZE) {
+            throw string("invalid CPU list \"") + list + "\"";
+        }
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+
+/*  split_commas()
+ *  Splits a comma-separated list into its items.  Returns nothing if any
+ *  item is empty.
+ */
+vector<string> split_commas(string list)
+{
+    vector<string> items;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item == "") return vector<string>();
+        items.push_back(item);
+    }
+    if (list == "" || list[list.size() - 1] == ',') return vector<string>();
+    return items;
+}
+
+
+/*  configure_evaluator()
+ *  Sets up ev to run the program name with args as the options in opts
+ *  say, checking outputs with tes.  No tests are added.  Runs are not kept
+ *  by ev, since the command line makes its own record of them.
+ */
+void configure_evaluator(Evaluator &ev, string name,
+                         const vector<string> &args, ProgramOptions *opts,
+                         Tester &tes)
+{
+    ev.set_tester(tes).set_program(name).set_args(args)
+      .set_repetitions(opts->times).set_warmup_runs(opts->warmup)
+      .set_process_options(opts->process)
+      .set_file_extensions(opts->input_suffix, opts->output_suffix)
+      .set_error_extension(opts->error_suffix)
+      .set_code_extension(opts->code_suffix)
+      .expect_exit_code(opts->expect_exit)
+      .set_copy_directory(opts->copy_dir)
+      .set_copy_extension(opts->copy_suffix)
+      .dont_keep_runs();
+    if (!opts->just_test) ev.check_no_runs();
+    else if (opts->all_tests) ev.check_all_runs();
+    if (opts->fail_fast) ev.stop_at_first_failure();
+    if (opts->cp_all) ev.save_all_outputs();
+    if (opts->cp_fail) ev.save_failed_outputs();
+    if (opts->be_quiet) ev.be_quiet();
+    if (opts->be_verbose) ev.be_verbose();
+    if (opts->print_ec) ev.print_exit_code();
+}
+
+
+/*  configure_reporter()
+ *  Sets up reporter to report as the options in opts say.
+ */
+void configure_reporter(TextReporter &reporter, ProgramOptions *opts)
+{
+    if (opts->be_quiet) reporter.be_quiet();
+    if (opts->be_verbose) reporter.be_verbose();
+    if (opts->print_ec) reporter.print_exit_code();
+}
+
+
+/*  hash_test_files()
+ *  Hashes, in one parallel pass, every file that the keys of these tests
+ *  depend on: the executable, and each test's input and expected files.
+ */
+void hash_test_files(ResultCache &cache, const Evaluator &ev, string name,
+                     const vector<string> &inputs,
+                     const vector<string> &outputs)
+{
+    vector<string> paths;
+    paths.push_back(name);
+    for (unsigned i = 0; i < inputs.size(); ++i) {
+        Expectations expect = ev.expectations(inputs[i], outputs[i]);
+        if (inputs[i] != "--") paths.push_back(inputs[i]);
+        paths.push_back(outputs[i]);
+        paths.push_back(expect.err_file);
+    }
+    cache.hash_files(paths);
+}
+
+
+/*  test_key()
+ *  Returns the key under which the result of a test is cached.  It covers
+ *  everything that could change whether the test passes.  The files must
+ *  already have been hashed by hash_test_files().
+ */
+string test_key(ResultCache &cache, const Evaluator &ev, string name,
+                const vector<string> &args, string in, string out,
+                ProgramOptions *opts, Tester &tes)
+{
+    Expectations expect = ev.expectations(in, out);
+    vector<string> parts;
+    parts.push_back(cache.file_hash(name));
+    parts.push_back(boost::lexical_cast<string>(args.size()));
+    parts.insert(parts.end(), args.begin(), args.end());
+    parts.push_back((in == "--") ? "stdin" : cache.file_hash(in));
+    parts.push_back(cache.file_hash(out));
+    parts.push_back(cache.file_hash(expect.err_file));
+    parts.push_back(boost::lexical_cast<string>(expect.exit_code));
+    parts.push_back(tes.settings());
+    parts.push_back(boost::lexical_cast<string>(opts->max_cpu));
+    parts.push_back(boost::lexical_cast<string>(opts->max_real));
+    parts.insert(parts.end(), opts->process.environment.begin(),
+                 opts->process.environment.end());
+    return hash_strings(parts);
+}
+
+
+/*  report_cached_test()
+ *  Reports a test skipped because it passed before, and, if requested, adds
+ *  its recorded times to result_set.  Returns false, reporting nothing, if
+ *  the recorded result cannot be used.  Tests on stdin are never skipped.
+ */
+bool report_cached_test(string in, const CachedResult &cached,
+                        TimeSet &result_set, ProgramOptions *opts)
+{
+    if (!cached.passed || in == "--") return false;
+    if (!opts->be_quiet) {
+        cout << "On input " << display_name(in) << endl;
+        cout << "> Passed (cached)" << endl;
+    }
+    if (opts->cached_times) {
+        ProgramInfo run;
+        run.wall_sec = (unsigned) cached.real;
+        run.wall_usec = (unsigned) ((cached.real - run.wall_sec) * 1e6);
+        run.user_sec = (unsigned) cached.user;
+        run.user_usec = (unsigned) ((cached.user - run.user_sec) * 1e6);
+        run.sys_sec = (unsigned) cached.sys;
+        run.sys_usec = (unsigned) ((cached.sys - run.sys_sec) * 1e6);
+        run.max_rss_kb = 0;
+        run.exit_code = 0;
+        add_run(result_set, run);
+    }
+    return true;
+}
+
+
+/*  calibrate()
+ *  Measures the harness overhead with the same redirections as a test on
+ *  no input, reports it, and has tim subtract it if requested.
  */
-char **vector_to_argv(string name, vector<string> *vect)
-{
-    vector<char *> temp_vect;
-    char *copy = new char[name.size()];
-    temp_vect.push_back(strcpy(copy, name.c_str()));
-    unsigned end = vect->size();
-    for (unsigned i = 0; i < end; ++i) {
-        copy = new char[vect->at(i).size()];
-        temp_vect.push_back(strcpy(copy, vect->at(i).c_str()));
-    }
-    temp_vect.push_back(NULL);
-    char **argv = new char *[temp_vect.size()];
-    end = temp_vect.size();
-    for (unsigned i = 0; i < end; ++i) {
-        argv[i] = temp_vect[i];
-    }
-    return argv;
+void calibrate(ProgramOptions *opts, Timer &tim)
+{
+    namespace fs = boost::filesystem;
+    TimeSet overhead;
+    overhead.input_size = -1;
+    string temp_in = make_temp_file();
+    string temp_out = make_temp_file();
+    string temp_err = make_temp_file();
+    vector<ProgramInfo> runs;
+    string error;
+    try {
+        runs = measure_overhead(opts->calibrate, temp_in, temp_out, temp_err);
+    } catch (string err) {
+        error = err;
+    }
+    fs::remove(temp_in);
+    fs::remove(temp_out);
+    fs::remove(temp_err);
+    if (error != "") {
+        cout << ">>> Error: calibration failed: " << error << endl;
+        return;
+    }
+    for (unsigned i = 0; i < runs.size(); ++i) {
+        add_run(overhead, runs[i], false);
+    }
+    overhead.test_name = "a no-op program";
+    if (opts->subtract_overhead) tim.subtract_overhead(overhead);
+    tim.report_calibration(overhead);
+}
+
+
+RunRecorder::RunRecorder(ProgramOptions *opts, ResultLog &log,
+                         ResultLog &journal, unsigned &successful)
+    : log(log), journal(journal), successful(successful)
+{
+    this->opts = opts;
+    times = NULL;
+}
+
+/*  The run is kept only if all times are to be reported, or drawn in a
+ *  histogram.  The journal gets the verdict of a checked run before the run
+ *  itself, so that a checked run found in it always has its verdict too.
+ */
+void RunRecorder::on_run_complete(const TestOutcome &test,
+                                  unsigned repetition, const ProgramInfo &run)
+{
+    TraceSpan span("record", "harness");
+    add_run(*times, run, opts->all_times || opts->histogram != "");
+    log.log_run(test.input_file, test.output_file, repetition, run);
+    bool checked = opts->just_test && (opts->all_tests || repetition == 0);
+    if (checked) {
+        last_run = run;
+    } else {
+        journal.log_run(test.input_file, test.output_file, repetition, run);
+    }
+}
+
+void RunRecorder::on_verdict(const TestOutcome &test, unsigned repetition,
+                             const Verdict &verdict)
+{
+    TraceSpan span("record", "harness");
+    successful += verdict.passed;
+    log.log_verdict(test.input_file, test.output_file, verdict.passed);
+    journal.log_verdict(test.input_file, test.output_file, verdict.passed);
+    journal.log_run(test.input_file, test.output_file, repetition, last_run);
 }
 
 
-/*  get_files_by_suffix()
- *  Given an output vector, a directory, and a suffix to search for, adds
- *  all files of the form
- *      dir/*suffix       where * means wildcard
- *  to the output vector.
- *  Note that each path pushed is the path MINUS THE SUFFIX.  This is to aid
- *  in finding matches between files whose names are perfect matches aside
- *  from the suffix.  It is simple enough to add the suffix back, should a
- *  user wish to do so.
+/*  save_profile()
+ *  Writes the samples taken of one test to the --profile directory, named
+ *  after its input as saved outputs are, and keeps its hottest functions
+ *  for the timing report.  The profiler is then cleared for the next test.
+ *  The first reason that a program could not be profiled is given once.
  */
-void get_files_by_suffix(vector<boost::filesystem::path> &output,
-                         string dir, string suffix)
+void save_profile(Profiler &profiler, const TestOutcome &test,
+                  TimeSet &times, ProgramOptions *opts)
 {
     namespace fs = boost::filesystem;
-    fs::directory_iterator end;
-    fs::directory_iterator i;
-    if (dir != "") {
-        fs::path d(dir);
-        if (d.is_absolute()) i = fs::directory_iterator(d);
-        else i = fs::directory_iterator(fs::current_path() / d);
-    }
-    unsigned suffix_len = suffix.length();
-    for ( ; i != end; ++i) {
-        string path = i->path().generic_string();
-        unsigned path_len = path.length();
-        if (path_len >= suffix_len) {
-            if (path.substr(path_len - suffix_len) == suffix) {
-                output.push_back(path.substr(0, path_len - suffix_len));
-            }
+    static bool warned = false;
+    if (profiler.error() != "" && !warned) {
+        cerr << "Warning: " << profiler.error() << endl;
+        warned = true;
+    }
+    string in = test.input_file;
+    string name = (in != "" && in != "--") ? fs::path(in).filename().native()
+                : fs::path(test.output_file).filename().native();
+    if (name != "") {
+        try {
+            profiler.write_folded((fs::path(opts->profile_dir)
+                                   / (name + ".folded")).native());
+        } catch (string err) {
+            cerr << "Error: " << err << endl;
         }
     }
+    times.hot_functions = profiler.hot_functions(5);
+    profiler.clear();
 }
 
 
-/*  get_io()
- *  Given a vector for inputs and one for outputs, and directories and
- *  suffixes identifying each, adds corresponding files to each vector.
- *  "Corresponding" means having the same "filename" - the part of a file's
- *  path not including its directory and its suffix.  So, eg.
- *   input_dir/F.input_ext  matches  output_dir/F.output_ext
- *  because "F" == "F"
- *  Where a file is found without a match, the empty string is added as that
- *  output's "match".
+/*  journal_fingerprint()
+ *  Returns a hash of everything a journal's runs depend on beyond the
+ *  tests themselves: the executable, its arguments and environment, the
+ *  limits and scheduling it runs under, and how its output is checked.
  */
-void get_io(vector<string> &inputs, vector<string> &outputs, string input_dir,
-            string output_dir, string input_suffix, string output_suffix)
+string journal_fingerprint(string name, const vector<string> &args,
+                           ProgramOptions *opts, Tester &tes)
 {
-    namespace fs = boost::filesystem;
-    vector<fs::path> temp_in, temp_out;
-    if (input_dir != "" || input_suffix != "") {
-        get_files_by_suffix(temp_in, input_dir, input_suffix);
-    }
-    if (output_dir != "" || output_suffix != "") {
-        get_files_by_suffix(temp_out, output_dir, output_suffix);
-    }
-    unsigned i_len = temp_in.size();
-    unsigned o_len = temp_out.size();
-    unsigned i = 0, j = 0;
-    /*  Look for file names that correspond.  Add names in parallel to the
-     *  vectors.  If names are found without a match, push the empty string
-     *  to the other vector.
-     */
-    while (i < i_len || j < o_len) {
-        fs::path cur_in = (i < i_len) ? temp_in[i] : "";
-        fs::path cur_out = (j < o_len) ? temp_out[j] : "";
-        if (cur_in.filename() == cur_out.filename()) {
-            inputs.push_back(cur_in.generic_string() + input_suffix);
-            outputs.push_back(cur_out.generic_string() + output_suffix);
-            ++i, ++j;
-        } else if (cur_in.filename() < cur_out.filename()
-                   && cur_in.filename() != "") {
-            inputs.push_back(cur_in.generic_string() + input_suffix);
-            outputs.push_back("");
-            ++i;
-        } else {
-            outputs.push_back(cur_out.generic_string() + output_suffix);
-            inputs.push_back("");
-            ++j;
+    ResultCache hashes("");
+    hashes.hash_files(vector<string>(1, name));
+    vector<string> parts;
+    parts.push_back(hashes.file_hash(name));
+    parts.push_back(boost::lexical_cast<string>(args.size()));
+    parts.insert(parts.end(), args.begin(), args.end());
+    parts.push_back(tes.settings());
+    parts.push_back(opts->error_suffix);
+    parts.push_back(opts->code_suffix);
+    parts.push_back(boost::lexical_cast<string>(opts->expect_exit));
+    parts.push_back(boost::lexical_cast<string>(opts->max_cpu));
+    parts.push_back(boost::lexical_cast<string>(opts->max_real));
+    parts.push_back(boost::lexical_cast<string>(opts->nice));
+    parts.push_back(boost::lexical_cast<string>(opts->fifo_priority));
+    parts.push_back(boost::lexical_cast<string>(opts->use_cgroup));
+    parts.push_back(boost::lexical_cast<string>(opts->drop_caches));
+    for (unsigned i = 0; i < opts->process.cpus.size(); ++i) {
+        parts.push_back(boost::lexical_cast<string>(opts->process.cpus[i]));
+    }
+    parts.push_back(boost::lexical_cast<string>(
+                        opts->process.environment.size()));
+    parts.insert(parts.end(), opts->process.environment.begin(),
+                 opts->process.environment.end());
+    return hash_strings(parts);
+}
+
+
+/*  open_journal()
+ *  Opens the journal named in opts, if there is one.  When resuming, the
+ *  runs it already holds are first read into journaled, by input and
+ *  output file, and the journal is added to; otherwise it is started anew.
+ *  A journal that does not exist yet, or holds nothing, is simply started.
+ *  A journal is begun with the fingerprint of the program and settings
+ *  (see journal_fingerprint()), and one with a different fingerprint is
+ *  not resumed: a string is thrown instead.
+ */
+void open_journal(ResultLog &journal, string name, const vector<string> &args,
+                  ProgramOptions *opts, Tester &tes,
+                  map< pair<string, string>, LoggedTest > &journaled)
+{
+    if (opts->journal_file == "") return;
+    string fingerprint = journal_fingerprint(name, args, opts, tes);
+    bool resuming = false;
+    if (opts->resume && boost::filesystem::exists(opts->journal_file)) {
+        vector<LoggedTest> tests;
+        read_result_log(opts->journal_file, tests);
+        string found = read_log_fingerprint(opts->journal_file);
+        if (found != fingerprint && (found != "" || !tests.empty())) {
+            throw string("cannot resume journal \"") + opts->journal_file
+                  + "\": it was made with a different program, arguments, "
+                  + "limits or checking options";
+        }
+        for (unsigned i = 0; i < tests.size(); ++i) {
+            journaled[make_pair(tests[i].input_file, tests[i].output_file)]
+                = tests[i];
         }
+        resuming = found != "";
     }
+    journal.open(opts->journal_file, resuming);
+    journal.sync_every(32, 1.0);
+    if (!resuming) journal.log_fingerprint(fingerprint);
 }
 
 
-/*  report_test_results()
- *  Uses the provided Tester to print the results of running input_name.
- *  Uses opts to decide how to print, and will update successful if it was.
- *  Note: specify the Tester's comparison and benchmark files BEFORE calling
- *  this function.
+/*  replay_journaled_run()
+ *  Takes the given repetition of a test from its journal entry instead of
+ *  running it, adding it to result_set and log as a RunRecorder would,
+ *  and, if print_test is true, reporting the verdict the journal holds.  A
+ *  test that failed in any checked run before is reported as failed in
+ *  each.  Returns false if the repetition was not journaled, so must be
+ *  run.
  */
-bool report_test_results(Tester &tes, string input_name, int exit_code,
-                         ProgramOptions *opts, unsigned &successful)
-{
-    bool passed = false;
-    if (opts->be_quiet) {
-        if (!tes.run()) {
-            cout << "Failed on input " << input_name;
-            if (opts->print_ec) {
-                cout << " with exit code " << exit_code;
-            }
-            cout << endl;
+bool replay_journaled_run(string in, const LoggedTest &logged,
+                          unsigned repetition, bool print_test,
+                          TimeSet &result_set, ResultLog &log,
+                          ProgramOptions *opts, unsigned &successful)
+{
+    map<unsigned, ProgramInfo>::const_iterator run
+        = logged.runs.find(repetition);
+    if (run == logged.runs.end()) return false;
+    string input_name = display_name(in);
+    if (!opts->be_quiet) cout << "On input " << input_name << endl;
+    add_run(result_set, run->second,
+            opts->all_times || opts->histogram != "");
+    log.log_run(in, logged.output_file, repetition, run->second);
+    if (print_test) {
+        log.log_verdict(in, logged.output_file, logged.verdict == 1);
+        if (logged.verdict == 1) {
+            if (!opts->be_quiet) cout << "> Passed (journaled)" << endl;
+            ++successful;
+        } else if (opts->be_quiet) {
+            cout << "Failed on input " << input_name << " (journaled)"
+                 << endl;
         } else {
-            passed = true;
+            cout << ">> Failed before resuming" << endl;
         }
-    } else {
-        string result = tes.run_verbosely();
-        if (result != "") {
-            cout << ">> " << result;
-            if (opts->print_ec) {
-                cout << endl << ">> exit code: " << exit_code;
-            }
-            if (result == "Passed") passed = true;
+    }
+    return true;
+}
+
+
+/*  history_name()
+ *  Returns the name by which a test is known in the history file: the path
+ *  of its input, or of its expected output if it has no input file.
+ */
+string history_name(string in, string out)
+{
+    return (in == "" || in == "--") ? out : in;
+}
+
+
+/*  select_shard()
+ *  Divides the tests into count shards, and keeps only those in the shard
+ *  numbered index.  Every test is weighed by its median time in the history
+ *  file, or, if it has none, by the median of the weights that are known.
+ *  Tests are dealt out heaviest first, each to the shard with the least
+ *  weight so far, so that the shards take about as long as each other.
+ *  Ties are broken by name, so that every shard divides the tests alike.
+ */
+void select_shard(vector<string> &inputs, vector<string> &outputs,
+                  unsigned index, unsigned count, string history_file)
+{
+    TestHistory history(history_file);
+    if (history_file != "") history.load();
+    unsigned len = inputs.size();
+    vector<double> weights(len, -1.0);
+    vector<double> known;
+    for (unsigned i = 0; i < len; ++i) {
+        TestRecord record;
+        if (history.lookup(history_name(inputs[i], outputs[i]), &record)
+            && record.median_real >= 0) {
+            weights[i] = record.median_real;
+            known.push_back(record.median_real);
+        }
+    }
+    double guess = 1.0;
+    if (!known.empty()) {
+        nth_element(known.begin(), known.begin() + known.size() / 2,
+                    known.end());
+        guess = known[known.size() / 2];
+    }
+    vector< pair<double, string> > order;
+    for (unsigned i = 0; i < len; ++i) {
+        if (weights[i] < 0) weights[i] = guess;
+        order.push_back(make_pair(-weights[i],
+                                  history_name(inputs[i], outputs[i])
+                                  + '\n' + outputs[i]));
+    }
+    vector<unsigned> by_weight(len);
+    for (unsigned i = 0; i < len; ++i) by_weight[i] = i;
+    sort(by_weight.begin(), by_weight.end(),
+         [&](unsigned a, unsigned b) { return order[a] < order[b]; });
+
+    vector<double> loads(count, 0.0);
+    vector<unsigned> shard(len);
+    for (unsigned i = 0; i < len; ++i) {
+        unsigned lightest = 0;
+        for (unsigned s = 1; s < count; ++s) {
+            if (loads[s] < loads[lightest]) lightest = s;
+        }
+        shard[by_weight[i]] = lightest;
+        loads[lightest] += weights[by_weight[i]];
+    }
+    vector<string> kept_in, kept_out;
+    for (unsigned i = 0; i < len; ++i) {
+        if (shard[i] != index) continue;
+        kept_in.push_back(inputs[i]);
+        kept_out.push_back(outputs[i]);
+    }
+    inputs.swap(kept_in);
+    outputs.swap(kept_out);
+}
+
+
+/*  order_tests()
+ *  Puts the tests in the given order, by what the history file records of
+ *  them:
+ *   failed-first   tests that failed last time, then new tests, then the
+ *                  rest;
+ *   slowest-first  by median real time, longest first, with new tests
+ *                  counted as slowest;
+ *   fastest-first  by median real time, shortest first, with new tests
+ *                  counted as slowest.
+ *  Tests that are otherwise equal keep the order they were found in.
+ */
+void order_tests(vector<string> &inputs, vector<string> &outputs,
+                 string order, string history_file)
+{
+    TestHistory history(history_file);
+    history.load();
+    unsigned len = inputs.size();
+    vector< pair<double, unsigned> > keys;
+    for (unsigned i = 0; i < len; ++i) {
+        TestRecord record;
+        bool known = history.lookup(history_name(inputs[i], outputs[i]),
+                                    &record);
+        double key;
+        if (order == "failed-first") {
+            key = !known ? 1 : (record.verdict == 0) ? 0 : 2;
         } else {
-            if (opts->be_verbose) {
-                cout << "> Passed";
-                if (opts->print_ec) {
-                    cout << " with exit code " << exit_code;
-                }
+            double time = known ? record.median_real : HUGE_VAL;
+            key = (order == "slowest-first") ? -time : time;
+        }
+        keys.push_back(make_pair(key, i));
+    }
+    sort(keys.begin(), keys.end());
+    vector<string> sorted_in, sorted_out;
+    for (unsigned i = 0; i < len; ++i) {
+        sorted_in.push_back(inputs[keys[i].second]);
+        sorted_out.push_back(outputs[keys[i].second]);
+    }
+    inputs.swap(sorted_in);
+    outputs.swap(sorted_out);
+}
+
+
+/*  report_stop()
+ *  Reports that testing stopped early, because of --fail-fast.
+ */
+void report_stop(unsigned not_run)
+{
+    cout << "Stopped after a failure; " << not_run
+         << ((not_run == 1) ? " test was" : " tests were") << " not run"
+         << endl;
+}
+
+
+/*  merge_results()
+ *  Runs the "merge" command: reads the results files written by --results
+ *  (eg. by each shard of a suite), and reports them together, as a single
+ *  run would have: any failures, the number of tests passed, and the times
+ *  of every test.  If a history file is given, the merged verdicts and times
+ *  are recorded in it.
+ */
+int merge_results(int argc, char *argv[])
+{
+    namespace fs = boost::filesystem;
+    namespace po = boost::program_options;
+    vector<string> files;
+    string history_file;
+    po::options_description merge("Merge options");
+    po::positional_options_description p_desc;
+    po::variables_map args;
+    merge.add_options()
+        ("results-file", po::value< vector<string> >(&files)->required(),
+            "Specify results files to merge")
+        ("history", po::value<string>(&history_file),
+            "Record the merged verdicts and times in this history file")
+    ;
+    p_desc.add("results-file", -1);
+    try {
+        po::store(po::command_line_parser(argc, argv).
+                  options(merge).positional(p_desc).run(), args);
+        po::notify(args);
+    } catch (exception &err) {
+        cerr << "Error in arguments: " << err.what() << endl;
+        cerr << merge << endl;
+        return 1;
+    }
+    vector<LoggedTest> tests;
+    try {
+        for (unsigned i = 0; i < files.size(); ++i) {
+            read_result_log(files[i], tests);
+        }
+    } catch (string err) {
+        cerr << "Error: " << err << endl;
+        return 1;
+    }
+    TestHistory history(history_file);
+    if (history_file != "") history.load();
+    vector<TimeSet> results;
+    unsigned checked = 0, successful = 0;
+    for (unsigned i = 0; i < tests.size(); ++i) {
+        string input_name = (tests[i].input_file == "") ? "/no input/"
+                          : (tests[i].input_file == "--") ? "/stdin/"
+                          : fs::path(tests[i].input_file).filename().native();
+        if (tests[i].verdict >= 0) {
+            ++checked;
+            successful += tests[i].verdict;
+            if (tests[i].verdict == 0) {
+                cout << "Failed on input " << input_name << endl;
             }
-            passed = true;
         }
-        cout << endl;
+        if (tests[i].runs.empty()) continue;
+        TimeSet these_tests;
+        these_tests.input_file = tests[i].input_file;
+        these_tests.output_file = tests[i].output_file;
+        these_tests.test_name = fs::path(tests[i].input_file)
+                                .filename().native();
+        these_tests.input_size = -1;
+        map<unsigned, ProgramInfo>::const_iterator run;
+        for (run = tests[i].runs.begin(); run != tests[i].runs.end(); ++run) {
+            add_run(these_tests, run->second);
+        }
+        results.push_back(these_tests);
+        string test = history_name(tests[i].input_file,
+                                   tests[i].output_file);
+        TestRecord record;
+        if (!history.lookup(test, &record)) record.verdict = -1;
+        if (tests[i].verdict >= 0) record.verdict = tests[i].verdict;
+        record.median_real = these_tests.real.median.value();
+        history.record(test, record);
     }
-    successful += passed;
-    return passed;
+    if (history_file != "") history.save();
+    if (checked) {
+        cout << "Final: Passed (" << successful << "/" << checked << ")"
+             << endl;
+    }
+    if (!results.empty()) {
+        Timer tim;
+        tim.report_times(results);
+    }
+    return 0;
 }
 
 
-/*  make_temp_file()
- *  Creates a new temporary file, and returns a string specifying its path.
- *  It is the client's responsibility to remove this file.
+/*  shared_path()
+ *  Returns path made absolute, if it names a file here, so that a worker
+ *  running elsewhere finds the same file.  Other paths (eg. a program to
+ *  be found on the worker's PATH) are left alone.
  */
-string make_temp_file()
+string shared_path(string path)
 {
     namespace fs = boost::filesystem;
-    string r_val = fs::temp_directory_path().native()
-                 + fs::unique_path().native() + ".eval";
-    fclose(fopen(r_val.c_str(), "w"));
-    return r_val;
+    if (path == "" || !fs::exists(path)) return path;
+    return fs::absolute(path).generic_string();
 }
 
 
-/*  copy_output()
- *  Copies the file from the path source, to a new path, specified by the
- *  three dest_ parameters.  The final parameter specifies whether to print
- *  upon successful copying.
+/*  evaluate_remote()
+ *  Does what evaluate() does, but has every run carried out by the workers
+ *  given with --connect.  All the runs are sent out first, and the results
+ *  are reported in order once every run has come back.
  */
-void copy_output(string source, string dest_dir, string dest_ext,
-                 string dest_name, bool print)
+void evaluate_remote(string name, vector<string> args,
+                     vector<string> inputs, vector<string> outputs,
+                     ProgramOptions *opts, Timer &tim, Tester &tes)
 {
     namespace fs = boost::filesystem;
-    if ((dest_dir == "" && dest_ext == "") || dest_name == "") return;
-    fs::path destination = (dest_dir == "") ? fs::current_path() : dest_dir;
-    destination /= dest_name + dest_ext;
-    fs::copy_file(source, destination, fs::copy_option::overwrite_if_exists);
-    if (print) {
-        cout << "Output copied to " << destination.native() << endl;
+    unsigned len = inputs.size();
+    if (len != outputs.size()) {
+        throw string("differing amounts of inputs and outputs");
+    }
+    SizeSource size_source = parse_size_source(opts->size_source);
+    Evaluator ev;
+    configure_evaluator(ev, name, args, opts, tes);
+    vector<Job> jobs;
+    for (unsigned i = 0; i < len; ++i) {
+        if (inputs[i] == "--") {
+            cerr << "Error: standard input cannot be sent to workers" << endl;
+            exit(1);
+        }
+        Expectations expect = ev.expectations(inputs[i], outputs[i]);
+        Job job;
+        job.program = shared_path(name);
+        job.args = args;
+        job.input_file = shared_path(inputs[i]);
+        job.output_file = shared_path(outputs[i]);
+        job.err_file = shared_path(expect.err_file);
+        job.exit_code = expect.exit_code;
+        job.ignore_space = opts->ignore_space;
+        job.ignore_chars = opts->ignore_chars;
+        job.max_cpu_time = opts->max_cpu;
+        job.max_real_time = opts->max_real;
+        job.cpus = opts->process.cpus;
+        job.nice = opts->process.nice;
+        job.fifo_priority = opts->process.fifo_priority;
+        job.use_cgroup = opts->process.use_cgroup;
+        job.drop_input_cache = opts->process.drop_input_cache;
+        job.environment = opts->process.environment;
+        for (unsigned j = 0; j < opts->times; ++j) {
+            job.check = opts->just_test && (opts->all_tests || j == 0);
+            jobs.push_back(job);
+        }
+    }
+    vector<JobResult> job_results;
+    run_remote_jobs(opts->connect, jobs, job_results, opts->fail_fast);
+
+    ResultLog log;
+    if (opts->results_file != "") {
+        try {
+            log.open(opts->results_file, false);
+        } catch (string err) {
+            cerr << "Error: " << err << endl;
+            exit(1);
+        }
+    }
+    if (opts->just_time) tim.report_conditions();
+    TextReporter reporter;
+    configure_reporter(reporter, opts);
+    vector<TimeSet> results;
+    unsigned successful = 0, not_run = 0;
+    for (unsigned i = 0; i < len; ++i) {
+        if (job_results[i * opts->times].cancelled) {
+            ++not_run;
+            continue;
+        }
+        TimeSet these_tests;
+        these_tests.input_file = inputs[i];
+        these_tests.output_file = outputs[i];
+        these_tests.test_name = fs::path(inputs[i]).filename().native();
+        these_tests.input_size = opts->scaling
+                               ? input_size(inputs[i], size_source) : -1;
+        TestOutcome test;
+        test.index = i;
+        test.input_file = inputs[i];
+        test.output_file = outputs[i];
+        test.verdict = -1;
+        for (unsigned j = 0; j < opts->times; ++j) {
+            const JobResult &result = job_results[i * opts->times + j];
+            bool print_test = jobs[i * opts->times + j].check;
+            if (result.cancelled) continue;
+            reporter.on_run_start(test, j);
+            if (!result.ran) {
+                reporter.on_run_error(test, j, result.error);
+                continue;
+            }
+            add_run(these_tests, result.info,
+                    opts->all_times || opts->histogram != "");
+            log.log_run(inputs[i], outputs[i], j, result.info);
+            if (print_test) {
+                /*  The error stream is not sent back by workers, so it is
+                 *  never shown.
+                 */
+                Verdict verdict;
+                verdict.passed = result.passed;
+                verdict.exit_code = result.info.exit_code;
+                verdict.failures = result.failures;
+                verdict.expect.exit_code = jobs[i * opts->times + j]
+                                               .exit_code;
+                reporter.on_verdict(test, j, verdict);
+                successful += result.passed;
+                log.log_verdict(inputs[i], outputs[i], result.passed);
+            }
+        }
+        results.push_back(these_tests);
+    }
+    if (not_run) report_stop(not_run);
+    if (opts->just_test) {
+        cout << "Final: Passed (" << successful << "/" << len << ")" << endl;
+    }
+    if (opts->just_time) {
+        tim.report_times(results);
+        if (opts->scaling) tim.report_scaling(results, opts->predict_n);
     }
 }
 
 
-/*  run_one_test()
- *  Given information about a process to run, runs a single test.
- *  If print_test is true, prints the results and updates successful.
- *  If the program runs without an error, the results are pushed onto
- *  result_list.  Otherwise, the error is reported.
+/*  find_tests()
+ *  Fills inputs and outputs with the tests to run: those listed, and those
+ *  found in the input and output directories, narrowed to one shard and
+ *  put in order if that was asked for.  Throws a string on failure.
  */
-void run_one_test(string name, char **argv, string in, string temp_in,
-                  string out, string temp_out,
-                  vector<ProgramInfo> &result_list, ProgramOptions *opts,
-                  bool print_test, unsigned &successful, Tester &tes)
+void find_tests(ProgramOptions *opts, vector<string> &inputs,
+                vector<string> &outputs)
 {
-    namespace fs = boost::filesystem;
-    ProgramInfo result;
-    string input_name, input_file;
-    if (in == "") {
-        input_name = "/no input/";
-        input_file = temp_in;
-    } else if (in == "--") {
-        input_name = "/stdin/";
-        input_file = "";
-    } else {
-        input_name = fs::path(in).filename().native();
-        input_file = in;
+    TraceSpan span("find tests", "harness");
+    inputs = opts->inputs;
+    outputs = opts->outputs;
+    get_io(inputs, outputs, opts->input_dir, opts->output_dir,
+           opts->input_suffix, opts->output_suffix, opts->recursive);
+    if (opts->shard_count > 1) {
+        select_shard(inputs, outputs, opts->shard_index, opts->shard_count,
+                     opts->history_file);
     }
-    if (!opts->be_quiet) {
-        cout << "On input " << input_name << endl;
-        cout.flush();
+    if (opts->order != "") {
+        order_tests(inputs, outputs, opts->order, opts->history_file);
     }
+}
+
+
+/*  watch_tests()
+ *  Evaluates every test, then waits for the executable or the test files
+ *  to change, and evaluates again only the tests affected, showing their
+ *  previous and latest times side by side.  A test is affected if its key
+ *  (see test_key()) has changed, so a new executable affects every test.
+ *  The tests are found again only when files are added or removed, and
+ *  files are hashed again only when their size or modification time
+ *  changes.  Runs until killed.
+ */
+void watch_tests(ProgramOptions *opts, Timer &tim, Tester &tes)
+{
+    vector<string> inputs, outputs;
+    Evaluator ev;
+    configure_evaluator(ev, opts->program_name, opts->args, opts, tes);
+    ResultCache hashes("");
+    map< pair<string, string>, string > keys;
+    vector<TimeSet> previous;
+    bool rediscover = true;
     try {
-        result = execute_process(name, argv, input_file, temp_out, "",
-                                 opts->max_cpu, opts->max_real);
-        result_list.push_back(result);
-        if (print_test) {
-            tes.set_benchmark_file(out).set_comparison_file(temp_out);
-            bool good = report_test_results(tes, input_name, result.exit_code,
-                                            opts, successful);
-            if (opts->cp_all || (!good && opts->cp_fail)) {
-                string output_name = (input_name == "/stdin/"
-                                      || input_name == "")
-                                   ? fs::path(out).filename().native()
-                                   : input_name;
-                copy_output(temp_out, opts->copy_dir, opts->copy_suffix,
-                            output_name, opts->be_verbose);
+        FileWatcher watcher;
+        watcher.watch_file(opts->program_name);
+        if (opts->input_dir != "" || opts->input_suffix != "") {
+            watcher.watch_directory(opts->input_dir, opts->recursive);
+        }
+        if (opts->output_dir != "" || opts->output_suffix != "") {
+            watcher.watch_directory(opts->output_dir, opts->recursive);
+        }
+        while (true) {
+            if (rediscover) {
+                find_tests(opts, inputs, outputs);
+                for (unsigned i = 0; i < inputs.size(); ++i) {
+                    Expectations expect = ev.expectations(inputs[i],
+                                                          outputs[i]);
+                    if (inputs[i] != "" && inputs[i] != "--") {
+                        watcher.watch_file(inputs[i]);
+                    }
+                    if (outputs[i] != "") watcher.watch_file(outputs[i]);
+                    if (expect.err_file != "") {
+                        watcher.watch_file(expect.err_file);
+                    }
+                }
             }
+            hash_test_files(hashes, ev, opts->program_name, inputs,
+                            outputs);
+            vector<string> run_in, run_out;
+            for (unsigned i = 0; i < inputs.size(); ++i) {
+                string key = test_key(hashes, ev, opts->program_name,
+                                      opts->args, inputs[i], outputs[i],
+                                      opts, tes);
+                string &last = keys[make_pair(inputs[i], outputs[i])];
+                if (key == last) continue;
+                last = key;
+                run_in.push_back(inputs[i]);
+                run_out.push_back(outputs[i]);
+            }
+            if (!run_in.empty()) {
+                vector<TimeSet> latest = evaluate(opts->program_name,
+                                                  opts->args, run_in,
+                                                  run_out, opts, tim, tes);
+                if (opts->just_time && !previous.empty()) {
+                    tim.report_comparison(previous, latest);
+                }
+                for (unsigned i = 0; i < latest.size(); ++i) {
+                    unsigned j = 0;
+                    while (j < previous.size()
+                           && (previous[j].input_file
+                                   != latest[i].input_file
+                               || previous[j].output_file
+                                   != latest[i].output_file)) {
+                        ++j;
+                    }
+                    if (j == previous.size()) previous.push_back(latest[i]);
+                    else previous[j] = latest[i];
+                }
+            }
+            cout << "Watching for changes..." << endl;
+            watcher.wait(300);
+            rediscover = watcher.files_added_or_removed();
         }
     } catch (string err) {
-        if (opts->be_quiet) cout << "On input " << input_name;
-        cout << ">>> Error: " << err << endl;
+        cerr << "Error: " << err << endl;
+    }
+}
+
+
+/*  sweep_dimensions()
+ *  Returns the parameters that --sweep-env, --sweep-arg, or --matrix vary,
+ *  in the order given.  Throws a string describing the error if one is
+ *  malformed, or names a variable twice.
+ */
+vector<SweepDimension> sweep_dimensions(ProgramOptions *opts)
+{
+    vector<SweepDimension> dimensions;
+    vector<string> specs = opts->matrix;
+    if (opts->sweep_env != "") specs.push_back(opts->sweep_env);
+    for (unsigned i = 0; i < specs.size(); ++i) {
+        size_t equals = specs[i].find('=');
+        SweepDimension dimension;
+        if (equals != string::npos) {
+            dimension.name = specs[i].substr(0, equals);
+            dimension.values = split_commas(specs[i].substr(equals + 1));
+        }
+        if (dimension.name == "" || dimension.values.empty()) {
+            throw string("expected NAME=v1,v2,... but found \"") + specs[i]
+                  + "\"";
+        }
+        for (unsigned j = 0; j < dimensions.size(); ++j) {
+            if (dimensions[j].name == dimension.name) {
+                throw string("\"") + dimension.name + "\" is varied twice";
+            }
+        }
+        string placeholder = "{" + dimension.name + "}";
+        for (unsigned j = 0; j < opts->args.size(); ++j) {
+            if (!opts->matrix.empty()
+                && opts->args[j].find(placeholder) != string::npos) {
+                dimension.placeholder = placeholder;
+            }
+        }
+        dimensions.push_back(dimension);
+    }
+    if (opts->sweep_arg != "") {
+        SweepDimension dimension;
+        dimension.placeholder = "{}";
+        dimension.values = split_commas(opts->sweep_arg);
+        for (unsigned i = 0; i < opts->args.size(); ++i) {
+            if (opts->args[i].find("{}") == string::npos) continue;
+            if (dimension.name != "") dimension.name += " ";
+            dimension.name += opts->args[i];
+        }
+        if (dimension.name == "" || dimension.values.empty()) {
+            throw string("--sweep-arg takes v1,v2,... and needs {} in the "
+                         "program's arguments");
+        }
+        dimensions.push_back(dimension);
+    }
+    return dimensions;
+}
+
+
+/*  sweep()
+ *  Evaluates the tests once for each combination of the values of the swept
+ *  parameters, the last varying fastest, each pass reported as usual under
+ *  a condition naming its values.  Then reports how the times changed over
+ *  the values of a --sweep-env or --sweep-arg, or compares the combinations
+ *  of a --matrix.  The tests are found once, for every pass, and the
+ *  overhead is measured once, before the first, for tim and every pass.
+ */
+void sweep(vector<string> inputs, vector<string> outputs,
+           ProgramOptions *opts, Timer &tim, Tester &tes)
+{
+    vector<SweepDimension> dimensions = sweep_dimensions(opts);
+    if (opts->calibrate && opts->just_time) calibrate(opts, tim);
+    vector<unsigned> chosen(dimensions.size(), 0);
+    vector<string> configurations;
+    vector< vector<TimeSet> > passes;
+    bool done = false;
+    while (!done) {
+        ProgramOptions pass = *opts;
+        pass.calibrate = 0;
+        vector<string> args = opts->args;
+        string setting;
+        for (unsigned d = 0; d < dimensions.size(); ++d) {
+            const SweepDimension &dimension = dimensions[d];
+            string value = dimension.values[chosen[d]];
+            if (setting != "") setting += " ";
+            if (dimension.placeholder == "") {
+                pass.process.environment.push_back(dimension.name + "="
+                                                   + value);
+                setting += dimension.name + "=" + value;
+                continue;
+            }
+            for (unsigned i = 0; i < args.size(); ++i) {
+                size_t at;
+                while ((at = args[i].find(dimension.placeholder))
+                       != string::npos) {
+                    args[i].replace(at, dimension.placeholder.size(), value);
+                }
+            }
+            if (dimension.placeholder == "{}") setting += value;
+            else setting += dimension.name + "=" + value;
+        }
+        Timer pass_tim = tim;
+        pass_tim.add_condition(opts->matrix.empty() ? "Sweep" : "Matrix",
+                               setting);
+        configurations.push_back(setting);
+        passes.push_back(evaluate(opts->program_name, args, inputs, outputs,
+                                  &pass, pass_tim, tes));
+
+        done = true;
+        for (int d = dimensions.size() - 1; d >= 0 && done; --d) {
+            if (++chosen[d] < dimensions[d].values.size()) done = false;
+            else chosen[d] = 0;
+        }
+    }
+    if (opts->matrix.empty()) {
+        tim.report_sweep(dimensions[0].name, dimensions[0].values, passes);
+    } else {
+        tim.report_matrix(configurations, passes);
     }
 }
 
@@ -590,11 +1770,14 @@ void run_one_test(string name, char **argv, string in, string temp_in,
 /*  evaluate()
  *  Runs the specified program on specified outputs using the specified
  *  options.
+ *  Normally the times of every test are reported together at the end.  When
+ *  reporting online, each test is reported as soon as it finishes, and only
+ *  what --scaling needs (the summaries, not the runs) is kept afterwards.
  */
-void evaluate(string name, vector<string> args,
-              vector<string> inputs, vector<string> outputs,
-              ProgramOptions *opts,
-              Timer &tim, Tester &tes)
+vector<TimeSet> evaluate(string name, vector<string> args,
+                         vector<string> inputs, vector<string> outputs,
+                         ProgramOptions *opts,
+                         Timer &tim, Tester &tes)
 {
     namespace fs = boost::filesystem;
     vector<TimeSet> results;
@@ -602,29 +1785,138 @@ void evaluate(string name, vector<string> args,
     if (len != outputs.size()) {
         throw string("differing amounts of inputs and outputs");
     }
-    char **argv = vector_to_argv(name, &args);
     unsigned successful = 0;
-    string temp_input = make_temp_file();
-    string temp_output = make_temp_file();
+    SizeSource size_source = parse_size_source(opts->size_source);
+    ResultLog log, journal;
+    map< pair<string, string>, LoggedTest > journaled;
+    try {
+        if (opts->results_file != "") log.open(opts->results_file, false);
+        open_journal(journal, name, args, opts, tes, journaled);
+    } catch (string err) {
+        cerr << "Error: " << err << endl;
+        exit(1);
+    }
+    Evaluator ev;
+    configure_evaluator(ev, name, args, opts, tes);
+    ev.add_corresponding_files(inputs, outputs);
+    RunRecorder recorder(opts, log, journal, successful);
+    ev.print_results().add_observer(&recorder);
+    Profiler profiler(opts->profile_frequency);
+    if (opts->profile_dir != "") {
+        ProcessOptions profiled = opts->process;
+        profiled.profiler = &profiler;
+        ev.set_process_options(profiled);
+        boost::system::error_code err;
+        fs::create_directories(opts->profile_dir, err);
+    }
+    /*  Shards only read the history, since they may share one file; the
+     *  merged results can be recorded in it afterwards.
+     */
+    bool update_history = opts->history_file != "" && opts->shard_count == 1;
+    TestHistory history(opts->history_file);
+    if (update_history) history.load();
+    ResultCache cache(opts->cache_file);
+    if (opts->incremental) {
+        cache.load();
+        hash_test_files(cache, ev, name, inputs, outputs);
+    }
+    if (opts->just_time) tim.report_conditions();
+    if (opts->calibrate && opts->just_time) calibrate(opts, tim);
     for (unsigned i = 0; i < len; ++i) {
+        TraceSpan test_span("test", "test", inputs[i]);
         TimeSet these_tests;
         these_tests.input_file = inputs[i];
         these_tests.output_file = outputs[i];
         these_tests.test_name = fs::path(inputs[i]).filename().native();
+        these_tests.input_size = opts->scaling
+                               ? input_size(inputs[i], size_source) : -1;
+        string key;
+        CachedResult cached;
+        if (opts->incremental) {
+            key = test_key(cache, ev, name, args, inputs[i], outputs[i],
+                           opts, tes);
+            if (cache.lookup(key, &cached)
+                && report_cached_test(inputs[i], cached, these_tests,
+                                      opts)) {
+                ++successful;
+                if (opts->just_time && these_tests.real.stats.count()) {
+                    results.push_back(these_tests);
+                }
+                continue;
+            }
+        }
+        unsigned passed_before = successful;
+        recorder.times = &these_tests;
+        TestOutcome test = ev.begin_test(i);
+        LoggedTest logged;
+        logged.verdict = -1;
+        map< pair<string, string>, LoggedTest >::const_iterator found
+            = journaled.find(make_pair(inputs[i], outputs[i]));
+        if (found != journaled.end()) logged = found->second;
+        bool all_journaled = true;
         for (unsigned j = 0; j < opts->times; ++j) {
-            run_one_test(name, argv, inputs[i], temp_input,
-                         outputs[i], temp_output, these_tests.runs, opts,
-                         opts->just_test && (opts->all_tests || j == 0),
-                         successful, tes);
+            if (!logged.runs.count(j)) all_journaled = false;
+        }
+        for (unsigned j = 0; j < opts->warmup && !all_journaled; ++j) {
+            ev.warm_up(test);
+        }
+        bool failed = false;
+        for (unsigned j = 0; j < opts->times && !failed; ++j) {
+            unsigned before = successful;
+            bool print_test = opts->just_test && (opts->all_tests || j == 0);
+            if (!replay_journaled_run(inputs[i], logged, j, print_test,
+                                      these_tests, log, opts, successful)) {
+                ev.run_test(test, j, print_test);
+            }
+            failed = opts->fail_fast && print_test && successful == before;
+        }
+        ev.end_test(test);
+        if (opts->profile_dir != "") {
+            save_profile(profiler, test, these_tests, opts);
+        }
+        if (opts->count_syscalls) {
+            these_tests.syscalls = ev.count_syscalls(test);
+        }
+        unsigned checked = opts->all_tests ? opts->times : 1;
+        bool passed = successful - passed_before == checked;
+        if (update_history && these_tests.real.stats.count()) {
+            string test = history_name(inputs[i], outputs[i]);
+            TestRecord record;
+            if (!history.lookup(test, &record)) record.verdict = -1;
+            if (opts->just_test) record.verdict = passed;
+            record.median_real = these_tests.real.median.value();
+            history.record(test, record);
+        }
+        if (opts->incremental) {
+            cached.passed = passed;
+            cached.real = these_tests.real.stats.mean();
+            cached.user = these_tests.user.stats.mean();
+            cached.sys = these_tests.sys.stats.mean();
+            cache.store(key, cached);
+        }
+        if (opts->online && opts->just_time) {
+            tim.report_time(these_tests);
+            if (opts->scaling) {
+                vector<ProgramInfo>().swap(these_tests.runs);
+                results.push_back(these_tests);
+            }
+        } else {
+            results.push_back(these_tests);
+        }
+        if (failed) {
+            report_stop(len - i - 1);
+            break;
         }
-        results.push_back(these_tests);
     }
     if (opts->just_test) {
         cout << "Final: Passed (" << successful << "/" << len << ")" << endl;
     }
+    if (opts->incremental) cache.save();
+    if (update_history) history.save();
     if (opts->just_time) {
-        tim.report_times(results);
+        TraceSpan span("report times", "harness");
+        if (!opts->online) tim.report_times(results);
+        if (opts->scaling) tim.report_scaling(results, opts->predict_n);
     }
-    fs::remove(temp_input);
-    fs::remove(temp_output);
+    return results;
 }
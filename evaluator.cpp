@@ -1,35 +1,212 @@
-
-#include <iostream>
+/*---------------------------------------------------------------------------*\
+ *  evaluator.cpp                                                            *
+ *  Each Evaluator has three temporary files, made when it first runs a      *
+ *    test and removed when it is destroyed: an empty file given as input to *
+ *    tests without one, and files for the output and error stream of the    *
+ *    latest run, which are checked and copied from there.  So an            *
+ *    Evaluator runs one test at a time, and cannot be copied.               *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
 #include "evaluator.h"
+#include "trace.h"
 using namespace std;
 
-Evaluator::Evaluator()
+
+EvaluationObserver::~EvaluationObserver()
+{
+    // Intentionally empty
+}
+
+void EvaluationObserver::on_test_start(const TestOutcome &)
+{
+    // Intentionally empty
+}
+
+void EvaluationObserver::on_run_start(const TestOutcome &, unsigned)
+{
+    // Intentionally empty
+}
+
+void EvaluationObserver::on_run_complete(const TestOutcome &, unsigned,
+                                         const ProgramInfo &)
+{
+    // Intentionally empty
+}
+
+void EvaluationObserver::on_run_error(const TestOutcome &, unsigned,
+                                      const string &)
 {
     // Intentionally empty
 }
 
+void EvaluationObserver::on_verdict(const TestOutcome &, unsigned,
+                                    const Verdict &)
+{
+    // Intentionally empty
+}
+
+void EvaluationObserver::on_test_end(const TestOutcome &)
+{
+    // Intentionally empty
+}
+
+
+TextReporter::TextReporter(ostream &out)
+{
+    this->out = &out;
+    quiet = false;
+    verbose = false;
+    print_ec = false;
+}
+
+TextReporter &TextReporter::be_quiet()
+{
+    quiet = true;
+    return *this;
+}
+
+TextReporter &TextReporter::be_verbose()
+{
+    verbose = true;
+    return *this;
+}
+
+TextReporter &TextReporter::print_exit_code()
+{
+    print_ec = true;
+    return *this;
+}
+
+void TextReporter::on_run_start(const TestOutcome &test, unsigned)
+{
+    TraceSpan span("report", "harness");
+    if (!quiet) {
+        *out << "On input " << display_name(test.input_file) << endl;
+        out->flush();
+    }
+}
+
+void TextReporter::on_run_error(const TestOutcome &test, unsigned,
+                                const string &error)
+{
+    TraceSpan span("report", "harness");
+    if (quiet) *out << "On input " << display_name(test.input_file);
+    *out << ">>> Error: " << error << endl;
+}
+
+
+/*  Prints a verdict.  Quietly, only a failure is mentioned; otherwise each
+ *  reason for a failure is given, and the test's error stream is shown if
+ *  it was not itself checked, or if being verbose.
+ */
+void TextReporter::on_verdict(const TestOutcome &test, unsigned,
+                              const Verdict &verdict)
+{
+    TraceSpan span("report", "harness");
+    if (quiet) {
+        if (!verdict.passed) {
+            *out << "Failed on input " << display_name(test.input_file);
+            if (print_ec) *out << " with exit code " << verdict.exit_code;
+            *out << endl;
+        }
+    } else {
+        if (!verdict.passed) {
+            for (unsigned i = 0; i < verdict.failures.size(); ++i) {
+                if (i > 0) *out << endl;
+                *out << ">> " << verdict.failures[i];
+            }
+            if (print_ec) *out << endl << ">> exit code: " << verdict.exit_code;
+        } else if (verdict.output_result == "Passed") {
+            *out << ">> " << verdict.output_result;
+            if (print_ec) *out << endl << ">> exit code: " << verdict.exit_code;
+        } else if (verbose) {
+            *out << "> Passed";
+            if (print_ec) *out << " with exit code " << verdict.exit_code;
+        }
+        *out << endl;
+        if ((!verdict.passed && verdict.expect.err_file == "") || verbose) {
+            print_error_stream(verdict.expect.captured_err);
+        }
+    }
+    if (verbose && verdict.copied_to != "") {
+        *out << "Output copied to " << verdict.copied_to << endl;
+    }
+}
+
+
+/*  Prints the first few lines of a test's captured error stream, if it
+ *  wrote anything, so that it can be seen without being interleaved with
+ *  the report.
+ */
+void TextReporter::print_error_stream(string captured_err)
+{
+    const unsigned MAX_LINES = 10;
+    if (captured_err == "") return;
+    ifstream err(captured_err.c_str());
+    string line;
+    unsigned count = 0;
+    while (getline(err, line)) {
+        if (count++ == MAX_LINES) {
+            *out << ">> stderr: ..." << endl;
+            break;
+        }
+        *out << ">> stderr: " << line << endl;
+    }
+}
+
+
+Evaluator::Evaluator()
+{
+    init();
+}
+
 Evaluator::Evaluator(Timer tim)
 {
-    Evaluator();
+    init();
     set_timer(tim);
 }
 
 Evaluator::Evaluator(Tester tes)
 {
-    Evaluator();
+    init();
     set_tester(tes);
 }
 
 Evaluator::Evaluator(Timer tim, Tester tes)
 {
-    Evaluator();
+    init();
     set_timer(tim);
     set_tester(tes);
 }
 
+void Evaluator::init()
+{
+    copy_all = false;
+    copy_failed = false;
+    quiet = false;
+    repetitions = 1;
+    warmup_runs = 0;
+    checking_all = false;
+    checking_none = false;
+    stopping = false;
+    keeping_runs = true;
+    expected_exit = -1;
+    async_failed = false;
+}
+
 Evaluator::~Evaluator()
 {
-    // Intentionally empty
+    namespace fs = boost::filesystem;
+    boost::system::error_code ignored;
+    if (temp_input != "") fs::remove(temp_input, ignored);
+    if (temp_output != "") fs::remove(temp_output, ignored);
+    if (temp_error != "") fs::remove(temp_error, ignored);
 }
 
 Evaluator &Evaluator::set_timer(Timer tim)
@@ -45,9 +222,513 @@ Evaluator &Evaluator::set_tester(Tester tes)
 }
 
 
-void Evaluator::evaluate()
+/*  Runs every test, each as many times as set, after any warmup runs, and
+ *  returns what came of them.  If stopping at the first failure, the tests
+ *  after the first to fail a check are not run, and have no outcome.
+ */
+vector<TestOutcome> Evaluator::evaluate()
+{
+    vector<TestOutcome> r_val;
+    for (unsigned i = 0; i < test_count(); ++i) {
+        TestOutcome test = begin_test(i);
+        for (unsigned j = 0; j < warmup_runs; ++j) warm_up(test);
+        bool failed = false;
+        for (unsigned j = 0; j < repetitions && !failed; ++j) {
+            bool check = !checking_none && (checking_all || j == 0);
+            failed = !run_test(test, j, check) && check && stopping;
+        }
+        end_test(test);
+        r_val.push_back(test);
+        if (failed) break;
+    }
+    return r_val;
+}
+
+
+/*  The state of a test being evaluated in the background.
+ */
+struct Evaluator::AsyncTest {
+    TestOutcome outcome;
+    promise<TestOutcome> done;
+    unsigned warmups_left;
+    unsigned next;
+    string output_file;
+    string err_file;
+};
+
+
+/*  Evaluates every test as evaluate() does, but in the background, on the
+ *  shared ProcessLoop, and returns at once with a future for each test's
+ *  outcome.  The runs of one test are made in order, but those of
+ *  different tests at the same time, as many as the loop allows.  If
+ *  stopping at the first failure, a failed check ends every test: their
+ *  outcomes hold the runs made so far.
+ *  Observers are called on the loop's thread.  Should one of them, or the
+ *  harness, throw while a test is going, the test ends there, its future
+ *  holding the exception.  The Evaluator must not be changed or destroyed,
+ *  nor another evaluation begun, until every future is ready.
+ */
+vector< future<TestOutcome> > Evaluator::evaluate_async()
+{
+    make_temp_files();
+    async_failed = false;
+    vector< future<TestOutcome> > r_val;
+    for (unsigned i = 0; i < test_count(); ++i) {
+        shared_ptr<AsyncTest> test(new AsyncTest);
+        test->outcome.index = i;
+        test->outcome.input_file = inputs[i];
+        test->outcome.output_file = outputs[i];
+        test->outcome.verdict = -1;
+        test->warmups_left = warmup_runs;
+        test->next = 0;
+        r_val.push_back(test->done.get_future());
+        ProcessLoop::shared().post([this, test]() {
+            try {
+                test->output_file = make_temp_file();
+                test->err_file = make_temp_file();
+                for (unsigned j = 0; j < observers.size(); ++j) {
+                    observers[j]->on_test_start(test->outcome);
+                }
+                continue_async(test);
+            } catch (...) {
+                abandon_async(test);
+            }
+        });
+    }
+    return r_val;
+}
+
+
+/*  Submits the next run of a background test, or, if it has no more, ends
+ *  it.  Called on the loop's thread.
+ */
+void Evaluator::continue_async(shared_ptr<AsyncTest> test)
+{
+    namespace fs = boost::filesystem;
+    if (test->next == repetitions || (stopping && async_failed)) {
+        for (unsigned i = 0; i < observers.size(); ++i) {
+            observers[i]->on_test_end(test->outcome);
+        }
+        boost::system::error_code ignored;
+        fs::remove(test->output_file, ignored);
+        fs::remove(test->err_file, ignored);
+        test->done.set_value(test->outcome);
+        return;
+    }
+    ProcessLoop &loop = ProcessLoop::shared();
+    if (test->warmups_left) {
+        --test->warmups_left;
+        ProcessOptions options = process;
+        options.drop_input_cache = false;
+        options.profiler = NULL;
+        loop.submit(program_name, argv_words(), input_path(test->outcome),
+                    test->output_file, test->err_file, options,
+                    [this, test](const ProcessResult &) {
+                        try {
+                            continue_async(test);
+                        } catch (...) {
+                            abandon_async(test);
+                        }
+                    });
+        return;
+    }
+    unsigned repetition = test->next++;
+    bool check = !checking_none && (checking_all || repetition == 0);
+    loop.submit(program_name, argv_words(), input_path(test->outcome),
+                test->output_file, test->err_file, process,
+                [this, test, repetition, check](const ProcessResult &result) {
+                    try {
+                        if (!record_run(test->outcome, repetition, check,
+                                        result, test->output_file,
+                                        test->err_file)
+                            && check) {
+                            async_failed = true;
+                        }
+                        continue_async(test);
+                    } catch (...) {
+                        abandon_async(test);
+                    }
+                },
+                [this, test, repetition]() {
+                    for (unsigned i = 0; i < observers.size(); ++i) {
+                        observers[i]->on_run_start(test->outcome,
+                                                   repetition);
+                    }
+                });
+}
+
+
+/*  Ends a background test on the exception being handled, which its
+ *  future then holds.  Called on the loop's thread, from a catch block.
+ */
+void Evaluator::abandon_async(shared_ptr<AsyncTest> test)
+{
+    namespace fs = boost::filesystem;
+    boost::system::error_code ignored;
+    if (test->output_file != "") fs::remove(test->output_file, ignored);
+    if (test->err_file != "") fs::remove(test->err_file, ignored);
+    try {
+        test->done.set_exception(current_exception());
+    } catch (future_error &) {
+        // Intentionally empty: the test had already ended
+    }
+}
+
+
+/*  Reports the times of the tests with the Timer, as the evaluate command
+ *  does.  Only the runs that were kept can be reported.
+ */
+void Evaluator::report_times(const vector<TestOutcome> &tests)
+{
+    namespace fs = boost::filesystem;
+    vector<TimeSet> sets(tests.size());
+    for (unsigned i = 0; i < tests.size(); ++i) {
+        sets[i].input_file = tests[i].input_file;
+        sets[i].output_file = tests[i].output_file;
+        sets[i].test_name = fs::path(tests[i].input_file).filename().native();
+        sets[i].input_size = -1;
+        for (unsigned j = 0; j < tests[i].runs.size(); ++j) {
+            add_run(sets[i], tests[i].runs[j]);
+        }
+    }
+    tim.report_times(sets);
+}
+
+
+unsigned Evaluator::test_count() const
+{
+    return inputs.size();
+}
+
+
+/*  Starts the test numbered _index_, telling the observers.  Throws a
+ *  string if there is no such test.
+ */
+TestOutcome Evaluator::begin_test(unsigned index)
+{
+    if (index >= test_count()) {
+        throw string("no test numbered ")
+              + boost::lexical_cast<string>(index);
+    }
+    TestOutcome test;
+    test.index = index;
+    test.input_file = inputs[index];
+    test.output_file = outputs[index];
+    test.verdict = -1;
+    for (unsigned i = 0; i < observers.size(); ++i) {
+        observers[i]->on_test_start(test);
+    }
+    return test;
+}
+
+
+/*  Points an argv, in the form the exec family of functions expects, at
+ *  _words_, which must outlive it.
+ */
+static vector<char *> make_argv(vector<string> &words)
+{
+    vector<char *> argv;
+    for (unsigned i = 0; i < words.size(); ++i) argv.push_back(&words[i][0]);
+    argv.push_back(NULL);
+    return argv;
+}
+
+
+/*  Runs a test without measuring or checking it, to warm the caches.  Any
+ *  error is left for the measured runs to report.
+ */
+void Evaluator::warm_up(const TestOutcome &test)
+{
+    make_temp_files();
+    ProcessOptions options = process;
+    options.drop_input_cache = false;
+    options.profiler = NULL;
+    vector<string> words = argv_words();
+    vector<char *> argv = make_argv(words);
+    try {
+        execute_process(program_name, &argv[0], input_path(test),
+                        temp_output, temp_error, options);
+    } catch (string err) {
+        // Intentionally empty
+    }
+}
+
+
+/*  count_syscalls()
+ *  Returns the system calls made by the run, by name, or nothing if it
+ *  could not be made.  The run is not checked or reported.
+ */
+map<string, unsigned long> Evaluator::count_syscalls(const TestOutcome &test)
+{
+    make_temp_files();
+    ProcessOptions options = process;
+    options.drop_input_cache = false;
+    options.profiler = NULL;
+    options.count_syscalls = true;
+    vector<string> words = argv_words();
+    vector<char *> argv = make_argv(words);
+    try {
+        return execute_process(program_name, &argv[0], input_path(test),
+                               temp_output, temp_error, options).syscalls;
+    } catch (string err) {
+        return map<string, unsigned long>();
+    }
+}
+
+
+/*  Makes one run of a test, adding it to the test's outcome, and, if
+ *  _check_ is set, checks it.  Returns true if the run was made and, if
+ *  checked, passed.
+ */
+bool Evaluator::run_test(TestOutcome &test, unsigned repetition, bool check)
+{
+    make_temp_files();
+    for (unsigned i = 0; i < observers.size(); ++i) {
+        observers[i]->on_run_start(test, repetition);
+    }
+    vector<string> words = argv_words();
+    vector<char *> argv = make_argv(words);
+    ProcessResult result;
+    try {
+        result.info = execute_process(program_name, &argv[0],
+                                      input_path(test), temp_output,
+                                      temp_error, process);
+        result.ran = true;
+    } catch (string err) {
+        result.ran = false;
+        result.error = err;
+    }
+    return record_run(test, repetition, check, result, temp_output,
+                      temp_error);
+}
+
+
+/*  Adds a run of a test, whose output and error stream were written to
+ *  _output_file_ and _err_file_, to the test's outcome, telling the
+ *  observers, and checks it if _check_ is set.  Returns true if the run was
+ *  made and, if checked, passed.
+ */
+bool Evaluator::record_run(TestOutcome &test, unsigned repetition, bool check,
+                           const ProcessResult &result, string output_file,
+                           string err_file)
+{
+    if (!result.ran) {
+        test.errors.push_back(result.error);
+        for (unsigned i = 0; i < observers.size(); ++i) {
+            observers[i]->on_run_error(test, repetition, result.error);
+        }
+        return false;
+    }
+    const ProgramInfo &run = result.info;
+    if (keeping_runs) test.runs.push_back(run);
+    for (unsigned i = 0; i < observers.size(); ++i) {
+        observers[i]->on_run_complete(test, repetition, run);
+    }
+    if (!check) return true;
+
+    Verdict verdict = judge(test, run.exit_code, output_file, err_file);
+    if (!verdict.passed && test.verdict != 0) {
+        test.failures = verdict.failures;
+        test.verdict = 0;
+    } else if (verdict.passed && test.verdict == -1) {
+        test.verdict = 1;
+    }
+    if (copy_all || (copy_failed && !verdict.passed)) {
+        string error;
+        verdict.copied_to = copy_output(test, output_file, &error);
+        if (error != "") {
+            test.errors.push_back(error);
+            for (unsigned i = 0; i < observers.size(); ++i) {
+                observers[i]->on_run_error(test, repetition, error);
+            }
+        }
+    }
+    for (unsigned i = 0; i < observers.size(); ++i) {
+        observers[i]->on_verdict(test, repetition, verdict);
+    }
+    return verdict.passed;
+}
+
+
+void Evaluator::end_test(const TestOutcome &test)
+{
+    for (unsigned i = 0; i < observers.size(); ++i) {
+        observers[i]->on_test_end(test);
+    }
+}
+
+
+/*  Checks a run of a test, whose output and error stream are in
+ *  _output_file_ and _err_file_: its output, its error stream if one is
+ *  expected, and its exit code if one is expected.
+ */
+Verdict Evaluator::judge(const TestOutcome &test, int exit_code,
+                         string output_file, string err_file) const
+{
+    TraceSpan span("compare", "harness");
+    Verdict verdict;
+    verdict.exit_code = exit_code;
+    verdict.expect = expectations(test.input_file, test.output_file);
+    verdict.expect.captured_err = err_file;
+    const Expectations &expect = verdict.expect;
+    Tester tes = this->tes;
+    tes.set_benchmark_file(test.output_file).set_comparison_file(output_file);
+    Tester err_tes = tes;
+    err_tes.set_benchmark_file(expect.err_file)
+           .set_comparison_file(expect.captured_err);
+    vector<string> &failures = verdict.failures;
+    if (quiet) {
+        if (!tes.run()) failures.push_back("output");
+        if (expect.err_file != "" && !err_tes.run()) {
+            failures.push_back("error stream");
+        }
+    } else {
+        string &result = verdict.output_result;
+        result = tes.run_verbosely();
+        if (result != "" && result != "Passed") failures.push_back(result);
+        if (expect.err_file != "") {
+            string err_result = err_tes.run_verbosely();
+            if (err_result != "" && err_result != "Passed") {
+                failures.push_back("On error stream: " + err_result);
+            }
+        }
+    }
+    if (expect.exit_code >= 0 && exit_code != expect.exit_code) {
+        failures.push_back("Expected exit code "
+                           + boost::lexical_cast<string>(expect.exit_code)
+                           + ", got "
+                           + boost::lexical_cast<string>(exit_code));
+    }
+    verdict.passed = failures.empty();
+    return verdict;
+}
+
+
+static string strip_suffix(string path, string suffix)
+{
+    if (suffix == "") {
+        return boost::filesystem::path(path).replace_extension()
+                                            .generic_string();
+    }
+    unsigned path_len = path.length();
+    unsigned suffix_len = suffix.length();
+    if (path_len >= suffix_len
+        && path.compare(path_len - suffix_len, suffix_len, suffix) == 0) {
+        return path.substr(0, path_len - suffix_len);
+    }
+    return path;
+}
+
+
+/*  Finds what, besides its output, a test is expected to produce.  For a
+ *  test whose expected output is F + output_ext (or, with no expected
+ *  output, whose input is F + input_ext), the expected error stream is in
+ *  F + error_ext, and the expected exit code in F + code_ext.  Where no
+ *  extension was set, as for files named one by one, F is the file's path
+ *  without its extension.
+ *  Where there is no code file, the exit code given to expect_exit_code()
+ *  is expected, if any.
+ */
+Expectations Evaluator::expectations(string input, string output) const
+{
+    namespace fs = boost::filesystem;
+    Expectations expect;
+    expect.exit_code = expected_exit;
+    string stem;
+    if (output != "") {
+        stem = strip_suffix(output, output_ext);
+    } else if (input != "" && input != "--") {
+        stem = strip_suffix(input, input_ext);
+    } else {
+        return expect;
+    }
+    if (error_ext != "" && fs::exists(stem + error_ext)) {
+        expect.err_file = stem + error_ext;
+    }
+    ifstream code_file((stem + code_ext).c_str());
+    int code;
+    if (code_ext != "" && code_file >> code) {
+        expect.exit_code = code;
+    }
+    return expect;
+}
+
+
+/*  Copies _output_file_ into the copy directory, named after the test's
+ *  input (or, without one, its expected output) with the copy extension.
+ *  Returns the path copied to, or "" if no copy directory or extension was
+ *  set, or if the copy failed, in which case _error_ says why.
+ */
+string Evaluator::copy_output(const TestOutcome &test, string output_file,
+                              string *error)
 {
+    TraceSpan span("copy output", "harness");
+    namespace fs = boost::filesystem;
+    string in = test.input_file;
+    string name = (in != "" && in != "--") ? fs::path(in).filename().native()
+                : fs::path(test.output_file).filename().native();
+    if ((copy_directory == "" && copy_ext == "") || name == "") return "";
+    boost::system::error_code err;
+    fs::path destination = (copy_directory == "") ? fs::current_path(err)
+                                                  : copy_directory;
+    destination /= name + copy_ext;
+    if (!err) {
+        fs::copy_file(output_file, destination,
+                      fs::copy_option::overwrite_if_exists, err);
+    }
+    if (err) {
+        *error = "could not copy the output to \"" + destination.native()
+                 + "\": " + err.message();
+        return "";
+    }
+    return destination.native();
+}
 
+
+/*  The file a test's input is redirected from: an empty file if it has no
+ *  input, or "" for the harness's own standard input.
+ */
+string Evaluator::input_path(const TestOutcome &test) const
+{
+    if (test.input_file == "") return temp_input;
+    if (test.input_file == "--") return "";
+    return test.input_file;
+}
+
+
+vector<string> Evaluator::argv_words() const
+{
+    vector<string> words(1, program_name);
+    words.insert(words.end(), args.begin(), args.end());
+    return words;
+}
+
+
+void Evaluator::make_temp_files()
+{
+    if (temp_input != "") return;
+    temp_input = make_temp_file();
+    temp_output = make_temp_file();
+    temp_error = make_temp_file();
+}
+
+
+string display_name(string input)
+{
+    if (input == "") return "/no input/";
+    if (input == "--") return "/stdin/";
+    return boost::filesystem::path(input).filename().native();
+}
+
+
+string make_temp_file()
+{
+    TraceSpan span("make temp file", "harness");
+    namespace fs = boost::filesystem;
+    string r_val = fs::temp_directory_path().native()
+                 + fs::unique_path().native() + ".eval";
+    fclose(fopen(r_val.c_str(), "w"));
+    return r_val;
 }
 
 
@@ -98,13 +779,13 @@ Evaluator &Evaluator::set_copy_extension(string ext)
 
 Evaluator &Evaluator::save_all_outputs()
 {
-
+    copy_all = true;
     return *this;
 }
 
 Evaluator &Evaluator::save_failed_outputs()
 {
-
+    copy_failed = true;
     return *this;
 }
 
@@ -147,19 +828,83 @@ Evaluator &Evaluator::add_arg(string new_arg)
 
 Evaluator &Evaluator::be_verbose()
 {
-
+    reporter.be_verbose();
     return *this;
 }
 
+/*  Besides making the report quiet, this makes checks quicker, since the
+ *  reasons for failures are no longer found.
+ */
 Evaluator &Evaluator::be_quiet()
 {
-
+    quiet = true;
+    reporter.be_quiet();
     return *this;
 }
 
 Evaluator &Evaluator::print_exit_code()
 {
+    reporter.print_exit_code();
+    return *this;
+}
+
+Evaluator &Evaluator::print_results()
+{
+    return add_observer(&reporter);
+}
 
+Evaluator &Evaluator::add_observer(EvaluationObserver *observer)
+{
+    observers.push_back(observer);
+    return *this;
+}
+
+Evaluator &Evaluator::set_repetitions(unsigned n)
+{
+    repetitions = n;
+    return *this;
+}
+
+Evaluator &Evaluator::set_warmup_runs(unsigned n)
+{
+    warmup_runs = n;
+    return *this;
+}
+
+/*  By default, only the first run of each test is checked.
+ */
+Evaluator &Evaluator::check_all_runs()
+{
+    checking_all = true;
+    checking_none = false;
+    return *this;
+}
+
+Evaluator &Evaluator::check_no_runs()
+{
+    checking_none = true;
+    checking_all = false;
+    return *this;
+}
+
+Evaluator &Evaluator::stop_at_first_failure()
+{
+    stopping = true;
+    return *this;
+}
+
+/*  Keeps outcomes small when there are many runs, for observers that make
+ *  their own record of them.
+ */
+Evaluator &Evaluator::dont_keep_runs()
+{
+    keeping_runs = false;
+    return *this;
+}
+
+Evaluator &Evaluator::set_process_options(const ProcessOptions &options)
+{
+    process = options;
     return *this;
 }
 
@@ -226,6 +971,34 @@ Evaluator &Evaluator::print_on_test_success()
     return *this;
 }
 
+/*  Sets the extensions of the files of tests, which expectations() strips
+ *  to find a test's other expected files.
+ */
+Evaluator &Evaluator::set_file_extensions(string input_ext, string output_ext)
+{
+    this->input_ext = input_ext;
+    this->output_ext = output_ext;
+    return *this;
+}
+
+Evaluator &Evaluator::set_error_extension(string ext)
+{
+    error_ext = ext;
+    return *this;
+}
+
+Evaluator &Evaluator::set_code_extension(string ext)
+{
+    code_ext = ext;
+    return *this;
+}
+
+Evaluator &Evaluator::expect_exit_code(int code)
+{
+    expected_exit = code;
+    return *this;
+}
+
 
 Evaluator &Evaluator::report_only_avg_time()
 {
@@ -1,10 +1,123 @@
+/*---------------------------------------------------------------------------*\
+ *  evaluator.h                                                              *
+ *  This file contains the interface for the Evaluator class, which runs a   *
+ *    program on a list of tests, times it, and checks its output, so that   *
+ *    evaluation can be driven from other programs as well as from the       *
+ *    evaluate command.                                                      *
+ *  An Evaluator is set up with builder-style methods, then evaluate() runs  *
+ *    every test and returns a TestOutcome for each one that was run.  As it *
+ *    goes, it tells each EvaluationObserver added to it what is happening:  *
+ *    when a test starts, when each run finishes, or fails to, and the       *
+ *    verdict on each checked run.  Nothing is printed unless asked for with *
+ *    print_results(), which adds a TextReporter writing to standard output. *
+ *  A caller that must decide run by run what to do (eg. to skip tests) can  *
+ *    use begin_test(), warm_up(), run_test(), and end_test() itself, which  *
+ *    are what evaluate() is made of.  count_syscalls() makes one more,      *
+ *    untimed run of a test under ptrace() and counts its system calls.      *
+ *  evaluate_async() evaluates the tests in the background instead, several  *
+ *    at a time, on the process loop shared by the whole program (see        *
+ *    process-loop.h), and returns a future for each test's outcome.         *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
 #ifndef EVALUATOR_H
 #define EVALUATOR_H
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
 #include <vector>
 #include <string>
+#include "execute-process.h"
+#include "process-loop.h"
 #include "tester.h"
 #include "timer.h"
 
+/*  What a test is expected to produce besides its output.  The error stream
+ *  is compared only if err_file is set, and the exit code only if exit_code
+ *  is not negative.  captured_err is the file the error stream was written
+ *  to, if the test has been run.
+ */
+struct Expectations {
+    std::string err_file;
+    std::string captured_err;
+    int exit_code;
+};
+
+/*  The verdict on one checked run.  output_result is what the Tester said
+ *  of the output, which is empty on a pass unless it prints on success, and
+ *  always empty for a quiet Evaluator.
+ */
+struct Verdict {
+    bool passed;
+    int exit_code;
+    std::string output_result;
+    std::vector<std::string> failures;
+    Expectations expect;
+    std::string copied_to;      /* where the output was saved, if it was */
+};
+
+/*  What is known of one test.  The input is "" for no input, and "--" for
+ *  standard input.
+ */
+struct TestOutcome {
+    unsigned index;
+    std::string input_file;
+    std::string output_file;
+    std::vector<ProgramInfo> runs;      /* unless runs are not kept */
+    std::vector<std::string> errors;    /* of runs that could not be made */
+    int verdict;        /* 1 passed every check, 0 failed one, -1 unchecked */
+    std::vector<std::string> failures;  /* of the first failed check */
+};
+
+/*  Receives the progress of an Evaluator.  Every method does nothing unless
+ *  overridden.  on_run_complete() is called for every run that finishes,
+ *  before its verdict, if it is checked; on_run_error() for every run that
+ *  could not be made.
+ */
+class EvaluationObserver
+{
+public:
+    virtual ~EvaluationObserver();
+
+    virtual void on_test_start(const TestOutcome &test);
+    virtual void on_run_start(const TestOutcome &test, unsigned repetition);
+    virtual void on_run_complete(const TestOutcome &test, unsigned repetition,
+                                 const ProgramInfo &run);
+    virtual void on_run_error(const TestOutcome &test, unsigned repetition,
+                              const std::string &error);
+    virtual void on_verdict(const TestOutcome &test, unsigned repetition,
+                            const Verdict &verdict);
+    virtual void on_test_end(const TestOutcome &test);
+};
+
+/*  Reports progress as the evaluate command does: each run as it starts,
+ *  and each verdict, with failures explained unless quiet.
+ */
+class TextReporter : public EvaluationObserver
+{
+public:
+    TextReporter(std::ostream &out = std::cout);
+
+    TextReporter &be_quiet();
+    TextReporter &be_verbose();
+    TextReporter &print_exit_code();
+
+    void on_run_start(const TestOutcome &test, unsigned repetition);
+    void on_run_error(const TestOutcome &test, unsigned repetition,
+                      const std::string &error);
+    void on_verdict(const TestOutcome &test, unsigned repetition,
+                    const Verdict &verdict);
+
+private:
+    std::ostream *out;
+    bool quiet;
+    bool verbose;
+    bool print_ec;
+
+    void print_error_stream(std::string captured_err);
+};
+
 class Evaluator
 {
 public:
@@ -19,7 +132,20 @@ public:
 
     /*  Run evaluation based on the current settings
      */
-    void evaluate();
+    std::vector<TestOutcome> evaluate();
+    std::vector< std::future<TestOutcome> > evaluate_async();
+    void report_times(const std::vector<TestOutcome> &tests);
+
+    /*  The steps of evaluate(), for callers that take them one at a time
+     */
+    unsigned test_count() const;
+    TestOutcome begin_test(unsigned index);
+    void warm_up(const TestOutcome &test);
+    std::map<std::string, unsigned long> count_syscalls(
+        const TestOutcome &test);
+    bool run_test(TestOutcome &test, unsigned repetition, bool check);
+    void end_test(const TestOutcome &test);
+    Expectations expectations(std::string input, std::string output) const;
 
     /*  Methods that control evaluation settings
      */
@@ -38,6 +164,15 @@ public:
     Evaluator &be_verbose();
     Evaluator &be_quiet();
     Evaluator &print_exit_code();
+    Evaluator &print_results();
+    Evaluator &add_observer(EvaluationObserver *observer);
+    Evaluator &set_repetitions(unsigned n);
+    Evaluator &set_warmup_runs(unsigned n);
+    Evaluator &check_all_runs();
+    Evaluator &check_no_runs();
+    Evaluator &stop_at_first_failure();
+    Evaluator &dont_keep_runs();
+    Evaluator &set_process_options(const ProcessOptions &options);
 
     /*  Methods that control testing settings
      */
@@ -51,6 +186,11 @@ public:
     Evaluator &ignore_too_few_chars();
     Evaluator &expect_proper_output_length();
     Evaluator &print_on_test_success();
+    Evaluator &set_file_extensions(std::string input_ext,
+                                   std::string output_ext);
+    Evaluator &set_error_extension(std::string ext);
+    Evaluator &set_code_extension(std::string ext);
+    Evaluator &expect_exit_code(int code);
 
     /*  Methods that control timing settings
      */
@@ -73,7 +213,56 @@ private:
     std::vector<std::string> args;
     std::string copy_directory;
     std::string copy_ext;
+    bool copy_all;
+    bool copy_failed;
+    bool quiet;
+    TextReporter reporter;
+    std::vector<EvaluationObserver *> observers;
+    unsigned repetitions;
+    unsigned warmup_runs;
+    bool checking_all;
+    bool checking_none;
+    bool stopping;
+    bool keeping_runs;
+    ProcessOptions process;
+    std::string input_ext;
+    std::string output_ext;
+    std::string error_ext;
+    std::string code_ext;
+    int expected_exit;
+    std::string temp_input;
+    std::string temp_output;
+    std::string temp_error;
+    bool async_failed;
+
+    struct AsyncTest;
+
+    void init();
+    void make_temp_files();
+    std::string input_path(const TestOutcome &test) const;
+    std::vector<std::string> argv_words() const;
+    bool record_run(TestOutcome &test, unsigned repetition, bool check,
+                    const ProcessResult &result, std::string output_file,
+                    std::string err_file);
+    Verdict judge(const TestOutcome &test, int exit_code,
+                  std::string output_file, std::string err_file) const;
+    std::string copy_output(const TestOutcome &test, std::string output_file,
+                            std::string *error);
+    void continue_async(std::shared_ptr<AsyncTest> test);
+    void abandon_async(std::shared_ptr<AsyncTest> test);
+
+    Evaluator(const Evaluator &);
+    Evaluator &operator=(const Evaluator &);
 };
 
+/*  The name under which a test on _input_ is reported: the input's file
+ *  name, "/no input/", or "/stdin/".
+ */
+std::string display_name(std::string input);
+
+/*  Creates a new, empty temporary file, and returns its path.  It is the
+ *  caller's responsibility to remove it.
+ */
+std::string make_temp_file();
 
 #endif
@@ -1,31 +1,82 @@
 /*---------------------------------------------------------------------------*\
  *  execute-process.cpp                                                      *
  *  Written By: Colin Hamilton, Tufts University                             *
- *  This implementation for execute-process relies on fork(), execv(),       *
- *    wait3(), dup2(), gettimeofday(), and setrlimit().                      *
+ *  This implementation for execute-process relies on fork(), execve(),      *
+ *    wait4(), dup2(), gettimeofday(), and setrlimit().  Scheduling options  *
+ *    use sched_setaffinity(), sched_setscheduler(), nice(), and             *
+ *    posix_fadvise().                                                       *
+ *  Time limits are enforced by the parent, to the millisecond.  It sleeps   *
+ *    in ppoll() on a pidfd for the child, which becomes readable when the   *
+ *    child exits, waking at the real-time deadline or, under a CPU limit,   *
+ *    every few milliseconds to sample the child's CPU clock.  Kernels       *
+ *    without pidfd_open() fall back to sleeping in 1ms steps.  RLIMIT_CPU   *
+ *    is still set, rounded up, as a backstop.                               *
+ *  When asked to, the I/O of each process is read from /proc/<pid>/io       *
+ *    while it is a zombie: waitid() with WNOWAIT says that it has exited    *
+ *    without reaping it.  System calls are counted with ptrace(), the child *
+ *    asking to be traced just before exec(), and the parent resuming it     *
+ *    from each stop with PTRACE_SYSCALL while a watchdog thread enforces    *
+ *    the time limits.  Memory is sampled from /proc/<pid>/status by         *
+ *    check_limits(), so whatever waits for a process also wakes to sample   *
+ *    it.                                                                    *
+ *  Each child leads its own process group, and the harness makes itself a   *
+ *    "child subreaper", so that descendants orphaned by the child are       *
+ *    reparented to it instead of to init.  Once the child exits, or is      *
+ *    killed for a time limit, the rest of its group is killed and reaped,   *
+ *    and their times added to the child's.  Descendants that leave the      *
+ *    group (eg. with setsid()) are only caught when a cgroup is used; they  *
+ *    are reaped too, once orphaned to the harness.  The child itself is     *
+ *    reaped only after its tree is killed, so that its group id cannot be   *
+ *    used again by another process meanwhile.                               *
+ *  A child reading from the terminal the harness has in the foreground is   *
+ *    given the terminal for as long as it runs, since its own group would   *
+ *    otherwise be stopped by SIGTTIN when it read.                          *
  *    It also uses the boost::lexical_cast library to aid in producing       *
  *    exception messages.                                                    *
  *                                                                           *
  *  TO DO:                                                                   *
 \*---------------------------------------------------------------------------*/
+#include <algorithm>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <cmath>
+#include <ctime>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <poll.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
 #include <signal.h>
 #include <boost/lexical_cast.hpp>
 #include "execute-process.h"
+#include "cgroup.h"
+#include "profile.h"
+#include "syscall-names.h"
+#include "trace.h"
 using namespace std;
 
 
 static pid_t child_id = 0;
+static bool supervising = false;
 
 static struct sigaction sact;
 
 static void signal_handler(int signum)
 {
-    if (signum == SIGALRM) signum = SIGTERM;
-    if (child_id && !kill(child_id, signum)){
+    if (child_id && (!kill(-child_id, signum) || !kill(child_id, signum))) {
         sigaction(signum, &sact, NULL);
     } else {
         exit(signum);
@@ -38,9 +89,245 @@ static void set_signal_handler()
     sact.sa_flags = SA_RESTART;
     sigaction(SIGTERM, &sact, NULL);
     sigaction(SIGINT, &sact, NULL);
-    sigaction(SIGALRM, &sact, NULL);
 }
 
+void supervise_processes()
+{
+    supervising = true;
+}
+
+/*  The longest the parent sleeps between samples of a child's CPU clock.
+ */
+static const double CPU_SAMPLE_INTERVAL = 0.005;
+
+static double seconds_since(const timespec &start)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static timespec to_timespec(double seconds)
+{
+    timespec r_val;
+    r_val.tv_sec = (time_t) seconds;
+    r_val.tv_nsec = (long) ((seconds - r_val.tv_sec) * 1e9);
+    return r_val;
+}
+
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void) pid;
+    return -1;
+#endif
+}
+
+/*  Returns true if the child has exited (without reaping it), sleeping for
+ *  at most _timeout_ seconds first.
+ */
+static bool wait_for_exit(pid_t pid, int pidfd, double timeout)
+{
+    timespec wait = to_timespec(timeout);
+    if (pidfd >= 0) {
+        pollfd p;
+        p.fd = pidfd;
+        p.events = POLLIN;
+        return ppoll(&p, 1, &wait, NULL) > 0;
+    }
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0
+        && info.si_pid == pid) {
+        return true;
+    }
+    timespec step = to_timespec(0.001);
+    nanosleep((timeout < 0.001) ? &wait : &step, NULL);
+    return false;
+}
+
+/*  Kills every process in the child's tree: its process group, and its
+ *  cgroup if it has one.  The processes in the cgroup are noted first, so
+ *  that those that left the group can be reaped once they are orphaned.
+ */
+static void kill_tree(StartedProcess &process)
+{
+    if (process.cgroup != "") {
+        vector<pid_t> pids = cgroup_pids(process.cgroup);
+        process.cgroup_pids.insert(process.cgroup_pids.end(), pids.begin(),
+                                   pids.end());
+    }
+    kill(-process.pid, SIGKILL);
+    if (process.cgroup != "") kill_cgroup(process.cgroup);
+}
+
+/*  Reads the I/O counts of a process that has exited but not been reaped.
+ *  Leaves _io_ alone if they cannot be read.
+ */
+static void read_io(pid_t pid, IoUsage *io)
+{
+    ifstream file(("/proc/" + boost::lexical_cast<string>(pid)
+                   + "/io").c_str());
+    string name;
+    long long value;
+    IoUsage read = *io;
+    unsigned found = 0;
+    while (file >> name >> value) {
+        if (name == "rchar:") read.rchar = value;
+        else if (name == "wchar:") read.wchar = value;
+        else if (name == "syscr:") read.syscr = value;
+        else if (name == "syscw:") read.syscw = value;
+        else if (name == "read_bytes:") read.read_bytes = value;
+        else if (name == "write_bytes:") read.write_bytes = value;
+        else continue;
+        ++found;
+    }
+    if (found == 6) *io = read;
+}
+
+static void add_io(IoUsage *total, const IoUsage &more)
+{
+    if (more.rchar < 0) return;
+    if (total->rchar < 0) {
+        *total = more;
+        return;
+    }
+    total->rchar += more.rchar;
+    total->wchar += more.wchar;
+    total->read_bytes += more.read_bytes;
+    total->write_bytes += more.write_bytes;
+    total->syscr += more.syscr;
+    total->syscw += more.syscw;
+}
+
+/*  Waits for a process to exit without reaping it.  Returns the pid of the
+ *  process that did, or -1 if there is none.  _id_ is as in waitid().
+ */
+static pid_t wait_without_reaping(idtype_t type, pid_t id)
+{
+    siginfo_t info;
+    info.si_pid = 0;
+    while (waitid(type, id, &info, WEXITED | WNOWAIT) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return info.si_pid;
+}
+
+/*  Reaps _pid_, as wait4() takes it, and adds its times to _total_.  Its
+ *  peak memory is not added, since the processes of a tree may not have
+ *  run at the same time; the largest is kept instead.  Returns false if
+ *  there was nothing to reap.
+ */
+static bool reap_into(pid_t pid, rusage *total)
+{
+    int status;
+    rusage r;
+    pid_t reaped;
+    while ((reaped = wait4(pid, &status, 0, &r)) < 0 && errno == EINTR) {
+        // Intentionally empty
+    }
+    if (reaped < 0) return false;
+    timeradd(&total->ru_utime, &r.ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &r.ru_stime, &total->ru_stime);
+    if (r.ru_maxrss > total->ru_maxrss) total->ru_maxrss = r.ru_maxrss;
+    return true;
+}
+
+/*  Reaps what is left of a child's process group, after it has been killed,
+ *  adding their times to _total_, and their I/O to _io_ if it is not NULL.
+ */
+static void reap_group(pid_t pgid, rusage *total, IoUsage *io)
+{
+    while (true) {
+        pid_t next = -pgid;
+        if (io != NULL) {
+            next = wait_without_reaping(P_PGID, pgid);
+            if (next < 0) break;
+            IoUsage more = ProgramInfo().io;
+            read_io(next, &more);
+            add_io(io, more);
+        }
+        if (!reap_into(next, total)) break;
+    }
+}
+
+/*  Reaps the processes found in a child's cgroup that left its group, as
+ *  reap_group() does, once they have been killed and, as orphans, passed
+ *  to the harness.  One already reaped, by its parent or with the group,
+ *  is skipped.  One still not the harness's to reap after a second (eg.
+ *  its pid was used again) is given up on.
+ */
+static void reap_orphans(const vector<pid_t> &pids, rusage *total,
+                         IoUsage *io)
+{
+    timespec step = { 0, 1000000 };
+    set<pid_t> done;
+    for (unsigned i = 0; i < pids.size(); ++i) {
+        pid_t pid = pids[i];
+        if (!done.insert(pid).second) continue;
+        for (int tries = 0; tries < 1000; ++tries) {
+            siginfo_t info;
+            info.si_pid = 0;
+            if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0) {
+                if (info.si_pid == pid) {
+                    IoUsage more = ProgramInfo().io;
+                    if (io != NULL) read_io(pid, &more);
+                    if (reap_into(pid, total) && io != NULL) {
+                        add_io(io, more);
+                    }
+                    break;
+                }
+            } else if (errno == ECHILD && kill(pid, 0) < 0
+                       && errno == ESRCH) {
+                break;
+            }
+            nanosleep(&step, NULL);
+        }
+    }
+}
+
+/*  Cgroups are not used again once a child fails to join one.  The child
+ *  says so by writing CGROUP_NOT_JOINED first to its error pipe.
+ */
+static bool cgroups_usable = true;
+static const char CGROUP_NOT_JOINED = '\001';
+
+/*  Uses the cgroup's figures for the whole tree in place of those gathered
+ *  from wait4().  If they cannot be read, or show no CPU time at all (as
+ *  for a run shorter than the cgroup's accounting can see), those from
+ *  wait4() are kept for this run.
+ */
+static void use_cgroup_usage(const string &cgroup, ProgramInfo *info)
+{
+    CgroupUsage usage;
+    if (!read_cgroup_usage(cgroup, &usage)
+        || usage.user_time + usage.sys_time <= 0) {
+        return;
+    }
+    info->user_sec = (unsigned) usage.user_time;
+    info->user_usec = (unsigned) ((usage.user_time - info->user_sec) * 1e6);
+    info->sys_sec = (unsigned) usage.sys_time;
+    info->sys_usec = (unsigned) ((usage.sys_time - info->sys_sec) * 1e6);
+    if (usage.max_rss_kb >= 0) info->max_rss_kb = usage.max_rss_kb;
+}
+
+static string next_cgroup_name()
+{
+    static unsigned count = 0;
+    return "evaluate-" + boost::lexical_cast<string>(getpid())
+        + "-" + boost::lexical_cast<string>(count++);
+}
+
+static string seconds_string(double t)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.4fs", t);
+    return buffer;
+}
+
+
 static ProgramInfo set_ptime(rusage r, timeval before, timeval after)
 {
     ProgramInfo r_val;
@@ -48,6 +335,7 @@ static ProgramInfo set_ptime(rusage r, timeval before, timeval after)
     r_val.user_usec = r.ru_utime.tv_usec;
     r_val.sys_sec   = r.ru_stime.tv_sec;
     r_val.sys_usec  = r.ru_stime.tv_usec;
+    r_val.max_rss_kb = r.ru_maxrss;
     r_val.wall_sec  = after.tv_sec - before.tv_sec;
     r_val.wall_usec = after.tv_usec - before.tv_usec;
     /*  When subtracting, if the usecond's place of the minuand is less than
@@ -63,30 +351,231 @@ static ProgramInfo set_ptime(rusage r, timeval before, timeval after)
 
 
 
-ProgramInfo execute_process(string name, char *argv[],
-                  FILE *input, FILE *output, FILE *errput,
-                  unsigned max_cpu_time, unsigned max_real_time)
+ProgramInfo::ProgramInfo()
+{
+    user_sec = user_usec = 0;
+    sys_sec = sys_usec = 0;
+    wall_sec = wall_usec = 0;
+    max_rss_kb = 0;
+    exit_code = 0;
+    io.rchar = io.wchar = io.read_bytes = io.write_bytes = -1;
+    io.syscr = io.syscw = -1;
+    memory_timeline.interval = 0;
+}
+
+
+ProcessOptions::ProcessOptions()
+{
+    max_cpu_time = 0;
+    max_real_time = 0;
+    nice = 0;
+    fifo_priority = 0;
+    drop_input_cache = false;
+    use_cgroup = false;
+    profiler = NULL;
+    measure_io = false;
+    count_syscalls = false;
+    memory_interval = 0;
+}
+
+
+/*  Applies the scheduling settings of _options_ to the calling process.
+ *  Meant to be called in the child, between fork() and exec().
+ */
+static void set_up_child(const ProcessOptions &options)
 {
-    int exit_status;
-    timeval before, after;
     rlimit time_limit;
-    rusage time_taken;
-    ProgramInfo r_val;
+    time_limit.rlim_cur = time_limit.rlim_max
+                        = (rlim_t) ceil(options.max_cpu_time) + 1;
+    if (options.max_cpu_time > 0 && setrlimit(RLIMIT_CPU, &time_limit)) {
+        throw string("failed to set time limit");
+    }
+    if (!options.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (unsigned i = 0; i < options.cpus.size(); ++i) {
+            CPU_SET(options.cpus[i], &set);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set)) {
+            throw string("failed to set CPU affinity: ") + strerror(errno);
+        }
+    }
+    if (options.fifo_priority) {
+        sched_param param;
+        param.sched_priority = options.fifo_priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param)) {
+            throw string("failed to set SCHED_FIFO priority: ")
+                + strerror(errno);
+        }
+    }
+    if (options.nice) {
+        errno = 0;
+        if (nice(options.nice) == -1 && errno) {
+            throw string("failed to set niceness: ") + strerror(errno);
+        }
+    }
+}
+
+
+/*  Returns the harness's environment with _settings_ ("NAME=value") put in
+ *  place of any variables of the same names, as strings for execve().
+ */
+static vector<string> child_environment(const vector<string> &settings)
+{
+    vector<string> r_val;
+    for (char **variable = environ; *variable != NULL; ++variable) {
+        string entry = *variable;
+        string name = entry.substr(0, entry.find('=') + 1);
+        bool replaced = false;
+        for (unsigned i = 0; i < settings.size() && !replaced; ++i) {
+            replaced = settings[i].compare(0, name.size(), name) == 0;
+        }
+        if (!replaced) r_val.push_back(entry);
+    }
+    r_val.insert(r_val.end(), settings.begin(), settings.end());
+    return r_val;
+}
+
+
+/*  Makes _pgid_ the foreground process group of the terminal on _fd_.
+ *  SIGTTOU, which a caller in the background would get for this, is
+ *  blocked meanwhile.
+ */
+static void give_terminal(int fd, pid_t pgid)
+{
+    sigset_t ttou, old;
+    sigemptyset(&ttou);
+    sigaddset(&ttou, SIGTTOU);
+    pthread_sigmask(SIG_BLOCK, &ttou, &old);
+    tcsetpgrp(fd, pgid);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
 
-    set_signal_handler();
-    gettimeofday(&before, NULL);
-    if ((child_id = fork())) {
-        if (child_id < 0) throw string("could not open process");
-        alarm(max_real_time);
-        wait3(&exit_status, 0, &time_taken);
-        gettimeofday(&after, NULL);
-        if (WIFSIGNALED(exit_status)) {
-            throw string("process terminated by signal number ")
-                + boost::lexical_cast<string>(WTERMSIG(exit_status));
-        }
-        r_val = set_ptime(time_taken, before, after);
-        r_val.exit_code = exit_status;
+/*  Returns a copy of the child's standard input if it is the terminal, with
+ *  the harness in its foreground, or -1 if it is not.
+ */
+static int terminal_input(FILE *input)
+{
+    int fd = (input != NULL) ? fileno(input) : STDIN_FILENO;
+    if (!isatty(fd) || tcgetpgrp(fd) != getpgrp()) return -1;
+    return fcntl(fd, F_DUPFD_CLOEXEC, 0);
+}
+
+
+/*  Errors in the child, before or during exec(), are written to a pipe that
+ *  is closed by a successful exec().  The parent reads it to its end before
+ *  returning, so such errors are thrown from finish_process(), as any other
+ *  error is.  A child that cannot join its cgroup says so first, and runs
+ *  without it.
+ *  When profiling, the child first waits for the parent to close another
+ *  pipe, once the profiler has attached.  If _traced_ is set, it then asks
+ *  to be traced, so that it stops for the parent once exec() succeeds.
+ */
+static StartedProcess start_child(string name, char *argv[],
+                                  FILE *input, FILE *output, FILE *errput,
+                                  const ProcessOptions &options, bool traced)
+{
+    TraceSpan span("spawn", "harness");
+    int error_pipe[2];
+    StartedProcess r_val;
+    r_val.options = options;
+    r_val.pidfd = -1;
+    r_val.sample_cpu = false;
+    r_val.limit = NO_LIMIT_HIT;
+    r_val.trace_track = trace_slot_track(0);
+    r_val.memory.interval = (options.memory_interval > 0)
+                          ? options.memory_interval : 0;
+    r_val.next_sample = r_val.memory.interval;
+    r_val.pending = 0;
+    r_val.terminal = -1;
+
+    if (options.drop_input_cache && input != NULL && input != stdin) {
+        posix_fadvise(fileno(input), 0, 0, POSIX_FADV_DONTNEED);
+    }
+    static bool subreaper = false;
+    if (supervising && !subreaper) {
+        prctl(PR_SET_CHILD_SUBREAPER, 1);
+        subreaper = true;
+    }
+    if (options.use_cgroup && cgroups_usable) {
+        r_val.cgroup = create_cgroup(next_cgroup_name());
+    }
+    if (pipe2(error_pipe, O_CLOEXEC)) {
+        if (r_val.cgroup != "") remove_cgroup(r_val.cgroup);
+        throw string("could not open process");
+    }
+    int hold_pipe[2];
+    if (options.profiler != NULL && pipe2(hold_pipe, O_CLOEXEC)) {
+        close(error_pipe[0]);
+        close(error_pipe[1]);
+        if (r_val.cgroup != "") remove_cgroup(r_val.cgroup);
+        throw string("could not open process");
+    }
+    /*  Any environment of its own is built before fork(), so that the child
+     *  need not allocate.
+     */
+    vector<string> environment;
+    vector<char *> envp;
+    char **child_env = environ;
+    if (!options.environment.empty()) {
+        environment = child_environment(options.environment);
+        for (unsigned i = 0; i < environment.size(); ++i) {
+            envp.push_back(const_cast<char *>(environment[i].c_str()));
+        }
+        envp.push_back(NULL);
+        child_env = &envp[0];
+    }
+    if (supervising) set_signal_handler();
+    r_val.terminal = terminal_input(input);
+    gettimeofday(&r_val.before, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &r_val.start);
+    if ((r_val.pid = fork())) {
+        close(error_pipe[1]);
+        if (options.profiler != NULL) close(hold_pipe[0]);
+        if (r_val.pid < 0) {
+            close(error_pipe[0]);
+            if (options.profiler != NULL) close(hold_pipe[1]);
+            if (r_val.cgroup != "") remove_cgroup(r_val.cgroup);
+            if (r_val.terminal >= 0) close(r_val.terminal);
+            throw string("could not open process");
+        }
+        setpgid(r_val.pid, r_val.pid);
+        if (r_val.terminal >= 0) give_terminal(r_val.terminal, r_val.pid);
+        if (options.profiler != NULL) {
+            options.profiler->attach(r_val.pid);
+            close(hold_pipe[1]);
+        }
+        string message;
+        char buffer[256];
+        ssize_t len;
+        while ((len = read(error_pipe[0], buffer, sizeof(buffer))) != 0) {
+            if (len < 0 && errno != EINTR) break;
+            if (len > 0) message.append(buffer, len);
+        }
+        close(error_pipe[0]);
+        if (message != "" && message[0] == CGROUP_NOT_JOINED) {
+            message.erase(0, 1);
+            cgroups_usable = false;
+            remove_cgroup(r_val.cgroup);
+            r_val.cgroup = "";
+        }
+        if (message != "") {
+            r_val.error = message;
+            return r_val;
+        }
+        r_val.pidfd = open_pidfd(r_val.pid);
+        r_val.sample_cpu = options.max_cpu_time > 0
+                        && clock_getcpuclockid(r_val.pid,
+                                               &r_val.cpu_clock) == 0;
     } else {
+        close(error_pipe[0]);
+        if (options.profiler != NULL) close(hold_pipe[1]);
+        setpgid(0, 0);
+        if (r_val.terminal >= 0) give_terminal(r_val.terminal, getpid());
+        if (r_val.cgroup != "" && !join_cgroup(r_val.cgroup)
+            && write(error_pipe[1], &CGROUP_NOT_JOINED, 1) < 0) {
+            _exit(127);
+        }
         if (input != NULL) {
             dup2(fileno(input), STDIN_FILENO);
         }
@@ -96,19 +585,369 @@ ProgramInfo execute_process(string name, char *argv[],
         if (errput != NULL) {
             dup2(fileno(errput), STDERR_FILENO);
         }
-        time_limit.rlim_cur = time_limit.rlim_max = max_cpu_time;
-        if (max_cpu_time && setrlimit(RLIMIT_CPU, &time_limit)) {
-            throw string("failed to set time limit");
+        string err;
+        try {
+            set_up_child(options);
+            if (options.profiler != NULL) {
+                char go;
+                while (read(hold_pipe[0], &go, 1) < 0 && errno == EINTR) {
+                    // Intentionally empty: wait for the profiler
+                }
+            }
+            if (traced && ptrace(PTRACE_TRACEME, 0, NULL, NULL)) {
+                throw string("failed to trace process: ") + strerror(errno);
+            }
+            execve(name.c_str(), argv, child_env);
+            err = string("failed to execute process: ") + strerror(errno);
+        } catch (string e) {
+            err = e;
+        }
+        if (write(error_pipe[1], err.c_str(), err.size()) < 0) _exit(127);
+        _exit(127);
+    }
+    return r_val;
+}
+
+
+StartedProcess start_process(string name, char *argv[],
+                             FILE *input, FILE *output, FILE *errput,
+                             const ProcessOptions &options)
+{
+    return start_child(name, argv, input, output, errput, options, false);
+}
+
+
+/*  Reads the resident memory of a running process, in kilobytes, or
+ *  returns -1 if it has none (eg. it has exited).
+ */
+static long read_rss_kb(pid_t pid)
+{
+    ifstream file(("/proc/" + boost::lexical_cast<string>(pid)
+                   + "/status").c_str());
+    string line;
+    while (getline(file, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) return atol(line.c_str() + 6);
+    }
+    return -1;
+}
+
+/*  Adds a sample to the last point of the timeline, or starts a new one,
+ *  first merging the points in pairs if there are too many.
+ */
+static void add_memory_sample(StartedProcess &process, long kb)
+{
+    MemoryTimeline &memory = process.memory;
+    vector<long> &points = memory.points;
+    unsigned per_point = (unsigned) (memory.interval
+                                     / process.options.memory_interval
+                                     + 0.5);
+    if (!points.empty() && process.pending < per_point) {
+        if (kb > points.back()) points.back() = kb;
+        ++process.pending;
+        return;
+    }
+    if (points.size() >= MEMORY_TIMELINE_POINTS) {
+        for (unsigned i = 0; i < points.size() / 2; ++i) {
+            points[i] = max(points[2 * i], points[2 * i + 1]);
+        }
+        points.resize(points.size() / 2);
+        memory.interval *= 2;
+    }
+    points.push_back(kb);
+    process.pending = 1;
+}
+
+/*  Samples the memory of a process if a sample is due, and brings
+ *  _next_check_ forward to when the next one is.  A sample taken late
+ *  stands for the ones missed as well, so that the points stay evenly
+ *  spaced.
+ */
+static void sample_memory(StartedProcess &process, double *next_check)
+{
+    double interval = process.options.memory_interval;
+    double elapsed = seconds_since(process.start);
+    if (elapsed >= process.next_sample) {
+        long kb = read_rss_kb(process.pid);
+        while (process.next_sample <= elapsed) {
+            if (kb >= 0) add_memory_sample(process, kb);
+            process.next_sample += interval;
+        }
+    }
+    double wait = process.next_sample - elapsed;
+    if (wait < *next_check) *next_check = wait;
+}
+
+/*  Kills the process if it has gone over one of its time limits, and
+ *  returns true if it has (now or before).  Otherwise, samples its memory
+ *  if that is due, and sets _next_check_ to the longest that may pass
+ *  before this should be called again: the time left before the real-time
+ *  limit or the next memory sample, or, under a CPU limit, a short interval
+ *  between samples of the process's CPU clock.  With none of these, that
+ *  is an hour.
+ */
+bool check_limits(StartedProcess &process, double *next_check)
+{
+    const ProcessOptions &options = process.options;
+    *next_check = 3600;
+    if (process.limit != NO_LIMIT_HIT) return true;
+    if (options.max_real_time > 0) {
+        *next_check = options.max_real_time - seconds_since(process.start);
+        if (*next_check <= 0) process.limit = REAL_LIMIT_HIT;
+    }
+    if (process.limit == NO_LIMIT_HIT && process.sample_cpu) {
+        timespec used;
+        if (clock_gettime(process.cpu_clock, &used) == 0) {
+            double left = options.max_cpu_time
+                        - (used.tv_sec + used.tv_nsec / 1e9);
+            if (left <= 0) process.limit = CPU_LIMIT_HIT;
+            if (left > CPU_SAMPLE_INTERVAL) left = CPU_SAMPLE_INTERVAL;
+            if (left < *next_check) *next_check = left;
+        }
+    }
+    if (process.limit == NO_LIMIT_HIT) {
+        if (options.memory_interval > 0) sample_memory(process, next_check);
+        return false;
+    }
+    kill_tree(process);
+    return true;
+}
+
+
+/*  Returns true if the process has exited, without reaping it.
+ */
+bool has_exited(const StartedProcess &process)
+{
+    siginfo_t info;
+    info.si_pid = 0;
+    return waitid(P_PID, process.pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0
+        && info.si_pid == process.pid;
+}
+
+
+/*  Waits until the child exits or goes over one of its time limits, in
+ *  which case it is killed, sampling its memory as it goes if asked to.
+ *  Either way, the child is left to be reaped.
+ */
+static void wait_with_limits(StartedProcess &process)
+{
+    const ProcessOptions &options = process.options;
+    if (options.max_real_time <= 0 && options.max_cpu_time <= 0
+        && options.memory_interval <= 0) {
+        return;
+    }
+    double timeout;
+    while (!check_limits(process, &timeout)) {
+        if (wait_for_exit(process.pid, process.pidfd, timeout)) break;
+    }
+}
+
+
+/*  Runs a traced child to its end, resuming it and every process it starts
+ *  in its group from each stop, and counting the system calls they enter.
+ *  Other signals are passed on.  A process other than the child that calls
+ *  setsid() or setpgid() is let go, since it may leave the group, where its
+ *  stops would not be seen.  The child itself is left to be reaped.
+ */
+static void trace_syscalls(StartedProcess &process)
+{
+    const ProcessOptions &options = process.options;
+    mutex lock;
+    condition_variable finished;
+    bool done = false;
+    thread watchdog;
+    if (options.max_real_time > 0 || options.max_cpu_time > 0) {
+        watchdog = thread([&]() {
+            unique_lock<mutex> guard(lock);
+            double timeout;
+            while (!done && !check_limits(process, &timeout)) {
+                finished.wait_for(guard, chrono::duration<double>(timeout));
+            }
+        });
+    }
+
+    const long trace_options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK
+                             | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE
+                             | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL;
+    map<string, unsigned long> counts;
+    set<pid_t> followed;
+    while (true) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_PGID, process.pid, &info,
+                   WEXITED | WSTOPPED | WNOWAIT | __WALL) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        pid_t pid = info.si_pid;
+        if (pid == process.pid && info.si_code != CLD_TRAPPED
+            && info.si_code != CLD_STOPPED) {
+            break;
+        }
+        int status;
+        if (waitpid(pid, &status, __WALL) < 0) continue;
+        if (!WIFSTOPPED(status)) {
+            followed.erase(pid);
+            continue;
         }
-        execv(name.c_str(), argv);
-        throw string("failed to execute process");
+        int signal = WSTOPSIG(status), deliver = 0;
+        if (!followed.count(pid)) {
+            /*  The first stop is the child's exec(), or a SIGSTOP for a
+             *  process it started.
+             */
+            followed.insert(pid);
+            ptrace(PTRACE_SETOPTIONS, pid, NULL, trace_options);
+            if (signal != SIGTRAP && signal != SIGSTOP) deliver = signal;
+        } else if (signal == (SIGTRAP | 0x80)) {
+            __ptrace_syscall_info call;
+            if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(call), &call) > 0
+                && call.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                ++counts[syscall_name(call.entry.nr)];
+                if (pid != process.pid && (call.entry.nr == SYS_setsid
+                                           || call.entry.nr == SYS_setpgid)) {
+                    ptrace(PTRACE_DETACH, pid, NULL, 0);
+                    followed.erase(pid);
+                    continue;
+                }
+            }
+        } else if (signal != SIGTRAP || (status >> 16) == 0) {
+            deliver = signal;
+        }
+        ptrace(PTRACE_SYSCALL, pid, NULL, deliver);
+    }
+
+    {
+        lock_guard<mutex> guard(lock);
+        done = true;
     }
+    finished.notify_one();
+    if (watchdog.joinable()) watchdog.join();
+    process.syscalls = counts;
+}
+
+
+/*  Reaps a process that has exited, or been killed, along with the rest of
+ *  its tree, and returns what it took.  Throws a string if it could not be
+ *  executed, went over a time limit, or was killed by a signal.
+ */
+ProgramInfo finish_process(StartedProcess &process)
+{
+    int exit_status;
+    timeval after;
+    rusage time_taken;
+    ProgramInfo r_val;
+    const ProcessOptions &options = process.options;
+
+    /*  The child is left a zombie until its tree has been killed, so that
+     *  its pid, and so its group's, cannot be used again meanwhile.
+     */
+    bool exited = wait_without_reaping(P_PID, process.pid) == process.pid;
+    gettimeofday(&after, NULL);
+    if (options.measure_io && process.error == "" && exited) {
+        read_io(process.pid, &r_val.io);
+    }
+    if (process.terminal >= 0) {
+        give_terminal(process.terminal, getpgrp());
+        close(process.terminal);
+        process.terminal = -1;
+    }
+    if (tracing()) {
+        timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        trace_event("run", "child", process.trace_track,
+                    trace_time(process.start), trace_time(end),
+                    "pid " + boost::lexical_cast<string>(process.pid));
+    }
+    TraceSpan span("reap", "harness");
+    kill_tree(process);
+    while (wait4(process.pid, &exit_status, 0, &time_taken) < 0
+           && errno == EINTR) {
+        // Intentionally empty
+    }
+    IoUsage *io = (r_val.io.rchar >= 0) ? &r_val.io : NULL;
+    reap_group(process.pid, &time_taken, io);
+    reap_orphans(process.cgroup_pids, &time_taken, io);
+    if (options.profiler != NULL) options.profiler->detach(process.pid);
+    if (process.pidfd >= 0) close(process.pidfd);
+    process.pidfd = -1;
+    IoUsage io_used = r_val.io;
+    r_val = set_ptime(time_taken, process.before, after);
+    r_val.io = io_used;
+    r_val.syscalls = process.syscalls;
+    r_val.memory_timeline = process.memory;
+    if (process.cgroup != "") {
+        use_cgroup_usage(process.cgroup, &r_val);
+        remove_cgroup(process.cgroup);
+    }
+    if (process.error != "") {
+        throw process.error;
+    }
+    if (process.limit == REAL_LIMIT_HIT) {
+        double used = r_val.wall_sec + r_val.wall_usec / 1e6;
+        throw string("exceeded real-time limit of ")
+            + seconds_string(options.max_real_time) + " by "
+            + seconds_string(used - options.max_real_time);
+    }
+    if (process.limit == CPU_LIMIT_HIT) {
+        double used = r_val.user_sec + r_val.user_usec / 1e6
+                    + r_val.sys_sec + r_val.sys_usec / 1e6;
+        throw string("exceeded CPU-time limit of ")
+            + seconds_string(options.max_cpu_time) + " by "
+            + seconds_string(used - options.max_cpu_time);
+    }
+    if (WIFSIGNALED(exit_status)) {
+        throw string("process terminated by signal number ")
+            + boost::lexical_cast<string>(WTERMSIG(exit_status));
+    }
+    r_val.exit_code = WEXITSTATUS(exit_status);
     return r_val;
 }
 
+
+ProgramInfo execute_process(string name, char *argv[],
+                  FILE *input, FILE *output, FILE *errput,
+                  const ProcessOptions &options)
+{
+    StartedProcess process = start_child(name, argv, input, output, errput,
+                                         options, options.count_syscalls);
+    child_id = process.pid;
+    if (process.error == "" && options.count_syscalls) {
+        trace_syscalls(process);
+    } else if (process.error == "") {
+        wait_with_limits(process);
+    }
+    try {
+        ProgramInfo r_val = finish_process(process);
+        child_id = 0;
+        return r_val;
+    } catch (string err) {
+        child_id = 0;
+        throw;
+    }
+}
+
+ProgramInfo execute_process(string name, char *argv[],
+                  FILE *input, FILE *output, FILE *errput,
+                  unsigned max_cpu_time, unsigned max_real_time)
+{
+    ProcessOptions options;
+    options.max_cpu_time = max_cpu_time;
+    options.max_real_time = max_real_time;
+    return execute_process(name, argv, input, output, errput, options);
+}
+
 ProgramInfo execute_process(string name, char *argv[],
                   string input, string output, string errput,
                   unsigned max_cpu_time, unsigned max_real_time)
+{
+    ProcessOptions options;
+    options.max_cpu_time = max_cpu_time;
+    options.max_real_time = max_real_time;
+    return execute_process(name, argv, input, output, errput, options);
+}
+
+ProgramInfo execute_process(string name, char *argv[],
+                  string input, string output, string errput,
+                  const ProcessOptions &options)
 {
     FILE *in, *out, *err;
     if (input == "") in = stdin;
@@ -119,10 +958,28 @@ ProgramInfo execute_process(string name, char *argv[],
     else err = fopen(errput.c_str(), "w");
 
     ProgramInfo r_val = execute_process(name, argv,
-                                        in, out, err,
-                                        max_cpu_time, max_real_time);
+                                        in, out, err, options);
     if (in != NULL)  fclose(in);
     if (out != NULL) fclose(out);
     if (err != NULL) fclose(err);
     return r_val;
 }
+
+
+static string noop_program()
+{
+    if (access("/bin/true", X_OK) == 0) return "/bin/true";
+    return "/usr/bin/true";
+}
+
+vector<ProgramInfo> measure_overhead(unsigned runs, string input,
+                                     string output, string errput)
+{
+    string name = noop_program();
+    char *argv[] = { const_cast<char *>(name.c_str()), NULL };
+    vector<ProgramInfo> r_val;
+    for (unsigned i = 0; i < runs; ++i) {
+        r_val.push_back(execute_process(name, argv, input, output, errput));
+    }
+    return r_val;
+}
@@ -6,7 +6,14 @@
  *  several functions that allow one to run an external program.             *
  *  Each such function returns a ProgramInfo struct on success, containing   *
  *  the amount of time the process took (wall, system, and user, each        *
- *  specifying seconds and microseconds), and the exit code of the process.  *
+ *  specifying seconds and microseconds), its peak memory in kilobytes, and  *
+ *  the exit code of the process.  The system and user times cover every     *
+ *  process the program started, not just the program itself; so does the   *
+ *  memory when the process is run in a cgroup.  Otherwise, it is the most   *
+ *  used by any one process.                                                 *
+ *  The I/O a run did (see IoUsage), the system calls it made, and its       *
+ *    memory over time (see MemoryTimeline) are only measured when asked     *
+ *    for in its ProcessOptions.                                             *
  *  See below for more specific descriptions of each.                        *
  *                                                                           *
  *  TO DO:                                                                   *
@@ -14,7 +21,44 @@
 #ifndef EXECUTE_PROCESS_H_INCLUDED
 #define EXECUTE_PROCESS_H_INCLUDED
 
+#include <ctime>
+#include <map>
 #include <string>
+#include <vector>
+#include <sys/time.h>
+#include <sys/types.h>
+
+class Profiler;
+
+/*  The I/O of a run, as counted in /proc/<pid>/io: the bytes passed to and
+ *    from read- and write-like system calls (whether or not they reached a
+ *    disk), the bytes actually fetched from or sent towards storage, and
+ *    the number of such calls.  Each is -1 if it was not measured.
+ *  Children the process reaped itself are included; the rest of its tree,
+ *    reaped by the harness, is added in as it is reaped.
+ */
+struct IoUsage {
+    long long rchar;
+    long long wchar;
+    long long read_bytes;
+    long long write_bytes;
+    long long syscr;
+    long long syscw;
+};
+
+/*  The resident memory of a run over time, sampled from /proc/<pid>/status
+ *    while it ran.  Each point is the largest sample taken in its interval,
+ *    in kilobytes, each sample being taken at the end of one.  Once a run has
+ *    MEMORY_TIMELINE_POINTS, neighbouring points are merged in pairs and
+ *    the interval doubled, so that a long run stays as small.
+ *  Only the process itself is sampled, not its children.
+ */
+static const unsigned MEMORY_TIMELINE_POINTS = 512;
+
+struct MemoryTimeline {
+    double interval;                /* in seconds; 0 if not sampled */
+    std::vector<long> points;
+};
 
 struct ProgramInfo {
     unsigned user_sec;
@@ -23,7 +67,61 @@ struct ProgramInfo {
     unsigned sys_usec;
     unsigned wall_sec;
     unsigned wall_usec;
+    long max_rss_kb;
     int exit_code;
+    IoUsage io;
+    std::map<std::string, unsigned long> syscalls;  /* calls, by name */
+    MemoryTimeline memory_timeline;
+
+    ProgramInfo();
+};
+
+/*  Settings for running a process.  The default settings place no limits on
+ *    the process and leave its scheduling alone.
+ *  The time limits are in seconds, and may be fractional (eg. 0.15).  A
+ *    process that goes over either is killed, and an exception thrown that
+ *    says by how much it went over.
+ *  _cpus_ lists the CPUs the process may run on (empty for any), _nice_ is
+ *    added to its niceness, and a nonzero _fifo_priority_ runs it under the
+ *    SCHED_FIFO real-time policy at that priority.  If _drop_input_cache_ is
+ *    set, the input file is evicted from the page cache before the process
+ *    starts, so that it is read cold.
+ *  If _use_cgroup_ is set, the process and its descendants are run in a new
+ *    cgroup v2 leaf where one can be made (see cgroup.h), which catches
+ *    descendants that leave the process group, and gives the peak memory
+ *    of the whole tree.
+ *  If _profiler_ is set, the process is held just before exec() while the
+ *    profiler attaches to it (see profile.h), and is detached from it once
+ *    it has been reaped.
+ *  If _measure_io_ is set, the process's /proc/<pid>/io is read just before
+ *    it is reaped (it is waited for with WNOWAIT, so that the entry is still
+ *    there), giving ProgramInfo::io.
+ *  If _count_syscalls_ is set, execute_process() runs the process under
+ *    ptrace(), stopping it at every system call, and counts them by name in
+ *    ProgramInfo::syscalls.  That slows it down a great deal, so such a run
+ *    should not be timed.  Its threads and the children that stay in its
+ *    process group are followed.  start_process() ignores this setting.
+ *  If _memory_interval_ is positive, the process's resident memory is
+ *    sampled every so many seconds while it runs, giving
+ *    ProgramInfo::memory_timeline.
+ *  _environment_ holds "NAME=value" settings, which the process gets in
+ *    place of (or as well as) the harness's own variables of those names.
+ */
+struct ProcessOptions {
+    double max_cpu_time;
+    double max_real_time;
+    std::vector<int> cpus;
+    int nice;
+    int fifo_priority;
+    bool drop_input_cache;
+    bool use_cgroup;
+    Profiler *profiler;
+    bool measure_io;
+    bool count_syscalls;
+    double memory_interval;
+    std::vector<std::string> environment;
+
+    ProcessOptions();
 };
 
 /*  executes the process whose path is stored in _name_, passing it the array
@@ -45,8 +143,17 @@ struct ProgramInfo {
  *  _max_cpu_time_ and _max_real_time_ may be zero, in which case no time
  *    limit will be placed on the child.
  *  This function may throw an exception as a string describing the error.
- *    This would happen only if the child process fails to open.
+ *    This would happen only if the child process fails to open, or if its
+ *    limits or scheduling settings cannot be applied.
  */
+ProgramInfo execute_process(std::string name, char *argv[],
+                            FILE *input, FILE *output, FILE *errput,
+                            const ProcessOptions &options);
+
+ProgramInfo execute_process(std::string name, char *argv[], std::string input,
+                            std::string output, std::string errput,
+                            const ProcessOptions &options);
+
 ProgramInfo execute_process(std::string name, char *argv[],
                             FILE *input = stdin,
                             FILE *output = stdout, FILE *errput = stderr,
@@ -68,4 +175,68 @@ static inline ProgramInfo execute_process(std::string name, char *argv[] = NULL,
                            max_cpu_time, max_real_time);
 }
 
+/*  A process started with start_process(), for callers that wait for many
+ *    processes at once rather than one at a time.  Such a caller waits for
+ *    _pidfd_ to become readable (or, where it is -1, polls every few
+ *    milliseconds with has_exited()), calling check_limits() before each
+ *    wait to enforce the time limits, to sample the memory of a process
+ *    with a _memory_interval_, and to learn how long it may sleep.
+ *    Once the process has exited, finish_process() reaps it and returns
+ *    its ProgramInfo, or throws as execute_process() would.
+ *  If the process could not be executed, _error_ says why, and it should be
+ *    finished at once.
+ */
+enum LimitHit {
+    NO_LIMIT_HIT,
+    REAL_LIMIT_HIT,
+    CPU_LIMIT_HIT
+};
+
+struct StartedProcess {
+    pid_t pid;
+    int pidfd;
+    std::string cgroup;
+    std::vector<pid_t> cgroup_pids;     /* found there when it was killed */
+    std::string error;
+    ProcessOptions options;
+    timeval before;
+    timespec start;
+    bool sample_cpu;
+    clockid_t cpu_clock;
+    LimitHit limit;
+    unsigned trace_track;       /* the slot its lifetime is traced in */
+    std::map<std::string, unsigned long> syscalls;  /* if traced */
+    MemoryTimeline memory;
+    double next_sample;         /* seconds after the start */
+    unsigned pending;           /* samples in the last point */
+    int terminal;               /* given to its group while it runs, or -1 */
+};
+
+StartedProcess start_process(std::string name, char *argv[],
+                             FILE *input, FILE *output, FILE *errput,
+                             const ProcessOptions &options);
+bool check_limits(StartedProcess &process, double *next_check);
+bool has_exited(const StartedProcess &process);
+ProgramInfo finish_process(StartedProcess &process);
+
+/*  Makes the calling program answer for the processes it runs, which
+ *    changes the whole process, so is left to the program that owns it:
+ *    a SIGINT or SIGTERM is passed on to the process running before the
+ *    harness exits, and processes a program leaves behind (eg. by
+ *    daemonizing) are adopted by the harness rather than by init, so that
+ *    they can be reaped and their times counted.  Without it, those that
+ *    left the program's process group are only killed and counted when it
+ *    runs in a cgroup.
+ */
+void supervise_processes();
+
+/*  Measures the fixed cost of running a process: runs a trivial program
+ *    (/bin/true) _runs_ times, redirecting its streams to _input_, _output_,
+ *    and _errput_ as above, and returns the ProgramInfo of each run.
+ *    Like execute_process(), this may throw an exception as a string.
+ */
+std::vector<ProgramInfo> measure_overhead(unsigned runs, std::string input,
+                                          std::string output,
+                                          std::string errput);
+
 #endif
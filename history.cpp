@@ -0,0 +1,67 @@
+/*---------------------------------------------------------------------------*\
+ *  history.cpp                                                              *
+ *  The history file is plain text, one test per line:                       *
+ *      test <verdict> <median_real> <name>                                  *
+ *    It is replaced atomically, like the result cache.                      *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "history.h"
+using namespace std;
+
+
+TestHistory::TestHistory(string filename)
+{
+    this->filename = filename;
+}
+
+
+void TestHistory::load()
+{
+    ifstream in(filename.c_str());
+    string line;
+    while (getline(in, line)) {
+        stringstream ss(line);
+        string kind, name;
+        TestRecord entry;
+        ss >> kind >> entry.verdict >> entry.median_real;
+        ss.get();
+        getline(ss, name);
+        if (kind == "test" && ss && name != "") records[name] = entry;
+    }
+}
+
+
+void TestHistory::save()
+{
+    string temp = filename + ".tmp";
+    ofstream out(temp.c_str());
+    out.precision(9);
+    map<string, TestRecord>::const_iterator r;
+    for (r = records.begin(); r != records.end(); ++r) {
+        out << "test " << r->second.verdict << " " << r->second.median_real
+            << " " << r->first << "\n";
+    }
+    out.close();
+    if (out.fail() || rename(temp.c_str(), filename.c_str())) {
+        remove(temp.c_str());
+    }
+}
+
+
+bool TestHistory::lookup(string test, TestRecord *record) const
+{
+    map<string, TestRecord>::const_iterator found = records.find(test);
+    if (found == records.end()) return false;
+    *record = found->second;
+    return true;
+}
+
+
+void TestHistory::record(string test, const TestRecord &record)
+{
+    records[test] = record;
+}
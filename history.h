@@ -0,0 +1,40 @@
+/*---------------------------------------------------------------------------*\
+ *  history.h                                                                *
+ *  This file contains the interface for the TestHistory class, a small      *
+ *    on-disk record of how each test went the last time it was run: its    *
+ *    verdict and its median real time.  It is used to weigh tests when      *
+ *    dividing a suite into shards that should take about as long as each    *
+ *    other.                                                                 *
+ *  Tests are identified by name, normally the path of their input file.     *
+ *    Nothing is written to disk until TestHistory::save().                  *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef HISTORY_H_INCLUDED
+#define HISTORY_H_INCLUDED
+
+#include <map>
+#include <string>
+
+struct TestRecord {
+    int verdict;            /* 1 passed, 0 failed, -1 never checked */
+    double median_real;     /* seconds */
+};
+
+class TestHistory
+{
+public:
+    TestHistory(std::string filename);
+
+    void load();
+    void save();
+
+    bool lookup(std::string test, TestRecord *record) const;
+    void record(std::string test, const TestRecord &record);
+
+private:
+    std::string filename;
+    std::map<std::string, TestRecord> records;
+};
+
+#endif
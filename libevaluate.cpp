@@ -0,0 +1,369 @@
+/*---------------------------------------------------------------------------*\
+ *  libevaluate.cpp                                                          *
+ *  This implementation wraps an Evaluator in each evaluate_evaluator, and   *
+ *    keeps the TestOutcomes of a run in each evaluate_results, along with   *
+ *    the C structs and arrays of pointers into them that are handed out.    *
+ *  Every function catches whatever its C++ calls throw, and keeps it for    *
+ *    evaluate_last_error() in a string local to the calling thread.         *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include "evaluator.h"
+#include "libevaluate.h"
+using namespace std;
+
+struct evaluate_evaluator {
+    Evaluator ev;
+};
+
+struct evaluate_results {
+    vector<TestOutcome> outcomes;
+    vector<evaluate_test_result> tests;
+    vector< vector<evaluate_program_info> > runs;
+    vector< vector<const char *> > errors;
+    vector< vector<const char *> > failures;
+};
+
+static thread_local string last_error;
+
+
+static void default_options(evaluate_process_options *options)
+{
+    ProcessOptions defaults;
+    memset(options, 0, sizeof *options);
+    options->size = sizeof *options;
+    options->max_cpu_time = defaults.max_cpu_time;
+    options->max_real_time = defaults.max_real_time;
+    options->nice = defaults.nice;
+    options->fifo_priority = defaults.fifo_priority;
+    options->drop_input_cache = defaults.drop_input_cache;
+    options->use_cgroup = defaults.use_cgroup;
+}
+
+/*  Converts _given_ to ProcessOptions, or returns the defaults if it is
+ *  NULL.  Only the fields within its size are read; the rest, which the
+ *  caller did not know of, keep their defaults.
+ */
+static ProcessOptions process_options(const evaluate_process_options *given)
+{
+    ProcessOptions r_val;
+    if (given == NULL) return r_val;
+    evaluate_process_options known;
+    default_options(&known);
+    memcpy(&known, given, min(given->size, sizeof known));
+    const evaluate_process_options *opts = &known;
+    r_val.max_cpu_time = opts->max_cpu_time;
+    r_val.max_real_time = opts->max_real_time;
+    if (opts->cpus != NULL) {
+        r_val.cpus.assign(opts->cpus, opts->cpus + opts->num_cpus);
+    }
+    r_val.nice = opts->nice;
+    r_val.fifo_priority = opts->fifo_priority;
+    r_val.drop_input_cache = opts->drop_input_cache != 0;
+    r_val.use_cgroup = opts->use_cgroup != 0;
+    return r_val;
+}
+
+static evaluate_program_info program_info(const ProgramInfo &info)
+{
+    evaluate_program_info r_val;
+    r_val.user_sec = info.user_sec;
+    r_val.user_usec = info.user_usec;
+    r_val.sys_sec = info.sys_sec;
+    r_val.sys_usec = info.sys_usec;
+    r_val.wall_sec = info.wall_sec;
+    r_val.wall_usec = info.wall_usec;
+    r_val.max_rss_kb = info.max_rss_kb;
+    r_val.exit_code = info.exit_code;
+    return r_val;
+}
+
+static vector<const char *> c_strings(const vector<string> &strings)
+{
+    vector<const char *> r_val;
+    for (unsigned i = 0; i < strings.size(); ++i) {
+        r_val.push_back(strings[i].c_str());
+    }
+    return r_val;
+}
+
+
+int evaluate_abi_version(void)
+{
+    return EVALUATE_ABI_VERSION;
+}
+
+
+const char *evaluate_last_error(void)
+{
+    return last_error.c_str();
+}
+
+
+void evaluate_process_options_init_size(evaluate_process_options *options,
+                                        size_t size)
+{
+    evaluate_process_options defaults;
+    default_options(&defaults);
+    defaults.size = size;
+    memcpy(options, &defaults, min(size, sizeof defaults));
+}
+
+
+/*  Opens _name_ with _mode_, or returns _std_ if there is no name.  Throws
+ *  a string if the file cannot be opened.
+ */
+static FILE *open_stream(const char *name, const char *mode, FILE *std)
+{
+    if (name == NULL) return std;
+    FILE *r_val = fopen(name, mode);
+    if (r_val == NULL) {
+        throw string("cannot open \"") + name + "\": " + strerror(errno);
+    }
+    return r_val;
+}
+
+static void close_stream(FILE *file, FILE *std)
+{
+    if (file != NULL && file != std) fclose(file);
+}
+
+
+int evaluate_execute_process(const char *name, const char *const *argv,
+                             const char *input, const char *output,
+                             const char *errput,
+                             const evaluate_process_options *options,
+                             evaluate_program_info *info)
+{
+    FILE *in = NULL, *out = NULL, *err = NULL;
+    int r_val = -1;
+    try {
+        ProcessOptions opts = process_options(options);
+        vector<char *> args;
+        if (argv == NULL) args.push_back(const_cast<char *>(name));
+        else while (*argv != NULL) args.push_back(const_cast<char *>(*argv++));
+        args.push_back(NULL);
+
+        in = open_stream(input, "r", stdin);
+        out = open_stream(output, "w", stdout);
+        err = open_stream(errput, "w", stderr);
+        *info = program_info(execute_process(name, &args[0], in, out, err,
+                                             opts));
+        r_val = 0;
+    } catch (string e) {
+        last_error = e;
+    } catch (exception &e) {
+        last_error = e.what();
+    }
+    close_stream(in, stdin);
+    close_stream(out, stdout);
+    close_stream(err, stderr);
+    return r_val;
+}
+
+
+evaluate_evaluator *evaluate_evaluator_new(void)
+{
+    try {
+        return new evaluate_evaluator;
+    } catch (exception &e) {
+        last_error = e.what();
+        return NULL;
+    }
+}
+
+
+void evaluate_evaluator_free(evaluate_evaluator *ev)
+{
+    delete ev;
+}
+
+
+/*  Returns true, after saying why, if _text_ is NULL.
+ */
+static bool missing(const char *text, const char *what)
+{
+    if (text != NULL) return false;
+    last_error = string("no ") + what + " given";
+    return true;
+}
+
+
+int evaluate_set_program(evaluate_evaluator *ev, const char *name)
+{
+    if (missing(name, "program name")) return -1;
+    ev->ev.set_program(name);
+    return 0;
+}
+
+int evaluate_add_arg(evaluate_evaluator *ev, const char *arg)
+{
+    if (missing(arg, "argument")) return -1;
+    ev->ev.add_arg(arg);
+    return 0;
+}
+
+int evaluate_add_test(evaluate_evaluator *ev, const char *input,
+                      const char *output)
+{
+    if (missing(input, "input file") || missing(output, "output file")) {
+        return -1;
+    }
+    ev->ev.add_input_and_output(input, output);
+    return 0;
+}
+
+void evaluate_set_repetitions(evaluate_evaluator *ev, unsigned n)
+{
+    ev->ev.set_repetitions(n);
+}
+
+void evaluate_set_warmup_runs(evaluate_evaluator *ev, unsigned n)
+{
+    ev->ev.set_warmup_runs(n);
+}
+
+void evaluate_check_all_runs(evaluate_evaluator *ev)
+{
+    ev->ev.check_all_runs();
+}
+
+void evaluate_check_no_runs(evaluate_evaluator *ev)
+{
+    ev->ev.check_no_runs();
+}
+
+void evaluate_stop_at_first_failure(evaluate_evaluator *ev)
+{
+    ev->ev.stop_at_first_failure();
+}
+
+void evaluate_set_process_options(evaluate_evaluator *ev,
+                                  const evaluate_process_options *options)
+{
+    ev->ev.set_process_options(process_options(options));
+}
+
+int evaluate_set_file_extensions(evaluate_evaluator *ev,
+                                 const char *input_ext,
+                                 const char *output_ext)
+{
+    if (missing(input_ext, "input extension")
+        || missing(output_ext, "output extension")) {
+        return -1;
+    }
+    ev->ev.set_file_extensions(input_ext, output_ext);
+    return 0;
+}
+
+int evaluate_set_error_extension(evaluate_evaluator *ev, const char *ext)
+{
+    if (missing(ext, "error extension")) return -1;
+    ev->ev.set_error_extension(ext);
+    return 0;
+}
+
+int evaluate_set_code_extension(evaluate_evaluator *ev, const char *ext)
+{
+    if (missing(ext, "exit code extension")) return -1;
+    ev->ev.set_code_extension(ext);
+    return 0;
+}
+
+void evaluate_expect_exit_code(evaluate_evaluator *ev, int code)
+{
+    ev->ev.expect_exit_code(code);
+}
+
+void evaluate_ignore_whitespace(evaluate_evaluator *ev)
+{
+    ev->ev.ignore_whitespace();
+}
+
+int evaluate_ignore_chars(evaluate_evaluator *ev, const char *chars)
+{
+    if (missing(chars, "characters")) return -1;
+    ev->ev.ignore_chars(chars);
+    return 0;
+}
+
+void evaluate_ignore_extra_chars(evaluate_evaluator *ev)
+{
+    ev->ev.ignore_extra_chars();
+}
+
+void evaluate_ignore_too_few_chars(evaluate_evaluator *ev)
+{
+    ev->ev.ignore_too_few_chars();
+}
+
+
+/*  evaluate_run()
+ *  The outcomes are all kept before any C struct is made, so that the
+ *  pointers into them are not moved by later tests.
+ */
+evaluate_results *evaluate_run(evaluate_evaluator *ev)
+{
+    evaluate_results *r_val = NULL;
+    try {
+        r_val = new evaluate_results;
+        r_val->outcomes = ev->ev.evaluate();
+        unsigned count = r_val->outcomes.size();
+        r_val->runs.resize(count);
+        r_val->errors.resize(count);
+        r_val->failures.resize(count);
+        for (unsigned i = 0; i < count; ++i) {
+            const TestOutcome &outcome = r_val->outcomes[i];
+            for (unsigned j = 0; j < outcome.runs.size(); ++j) {
+                r_val->runs[i].push_back(program_info(outcome.runs[j]));
+            }
+            r_val->errors[i] = c_strings(outcome.errors);
+            r_val->failures[i] = c_strings(outcome.failures);
+
+            evaluate_test_result test;
+            test.index = outcome.index;
+            test.input_file = outcome.input_file.c_str();
+            test.output_file = outcome.output_file.c_str();
+            test.verdict = outcome.verdict;
+            test.num_runs = r_val->runs[i].size();
+            test.runs = test.num_runs ? &r_val->runs[i][0] : NULL;
+            test.num_errors = r_val->errors[i].size();
+            test.errors = test.num_errors ? &r_val->errors[i][0] : NULL;
+            test.num_failures = r_val->failures[i].size();
+            test.failures = test.num_failures ? &r_val->failures[i][0] : NULL;
+            r_val->tests.push_back(test);
+        }
+        return r_val;
+    } catch (string e) {
+        last_error = e;
+    } catch (exception &e) {
+        last_error = e.what();
+    }
+    delete r_val;
+    return NULL;
+}
+
+
+unsigned evaluate_results_count(const evaluate_results *results)
+{
+    return results->tests.size();
+}
+
+
+const evaluate_test_result *evaluate_results_get(
+    const evaluate_results *results, unsigned i)
+{
+    if (i >= results->tests.size()) return NULL;
+    return &results->tests[i];
+}
+
+
+void evaluate_results_free(evaluate_results *results)
+{
+    delete results;
+}
@@ -0,0 +1,171 @@
+/*---------------------------------------------------------------------------*\
+ *  libevaluate.h                                                            *
+ *  This file contains the C interface to the evaluate library, for callers  *
+ *    that cannot use the C++ classes directly (eg. through Python's ctypes  *
+ *    or Go's cgo), so that they can run and check tests in-process rather   *
+ *    than by running the evaluate command once per suite.                   *
+ *  Evaluators and results are opaque handles, made and freed only by the    *
+ *    functions below.  The structs are plain data, holding the times,       *
+ *    limits and verdicts of ProgramInfo, ProcessOptions, and TestOutcome,   *
+ *    but not yet their I/O, system call counts, memory timelines, or        *
+ *    environment.  Fields are only ever added to their ends, and            *
+ *    EVALUATE_ABI_VERSION is raised if anything else changes.  A struct     *
+ *    the caller fills in begins with its size, so that a newer library      *
+ *    reads only the fields the caller was built with, and takes the rest    *
+ *    as their defaults.                                                     *
+ *  No function throws.  Those that can fail return -1 or NULL, after which  *
+ *    evaluate_last_error() says why.                                        *
+ *  The library leaves the calling process as it found it: it installs no    *
+ *    signal handlers, and does not make itself a child subreaper (as the    *
+ *    evaluate command does).  So a SIGINT or SIGTERM is not passed on to a  *
+ *    process being run, and processes that leave their program's process    *
+ *    group are only killed and counted when run in a cgroup.  A caller      *
+ *    that wants them reaped can call prctl(PR_SET_CHILD_SUBREAPER, 1)       *
+ *    itself.                                                                *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef LIBEVALUATE_H_INCLUDED
+#define LIBEVALUATE_H_INCLUDED
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EVALUATE_ABI_VERSION 2
+
+/*  The times and peak memory of one run, as in ProgramInfo.
+ */
+typedef struct evaluate_program_info {
+    unsigned user_sec;
+    unsigned user_usec;
+    unsigned sys_sec;
+    unsigned sys_usec;
+    unsigned wall_sec;
+    unsigned wall_usec;
+    long max_rss_kb;
+    int exit_code;
+} evaluate_program_info;
+
+/*  Settings for running a process, as in ProcessOptions, less those for
+ *  profiling, measuring, and the environment.  _cpus_ points to _num_cpus_
+ *  CPU numbers, and may be NULL for any CPU.  _size_ is the size of the
+ *  struct as the caller knows it.  Use evaluate_process_options_init() to
+ *  set it and get the defaults.
+ */
+typedef struct evaluate_process_options {
+    size_t size;
+    double max_cpu_time;
+    double max_real_time;
+    const int *cpus;
+    unsigned num_cpus;
+    int nice;
+    int fifo_priority;
+    int drop_input_cache;
+    int use_cgroup;
+} evaluate_process_options;
+
+/*  What is known of one test, as in TestOutcome.  _verdict_ is 1 if every
+ *  checked run passed, 0 if one failed, and -1 if none were checked.  All
+ *  of the pointers belong to the results the test came from.
+ */
+typedef struct evaluate_test_result {
+    unsigned index;
+    const char *input_file;
+    const char *output_file;
+    int verdict;
+    unsigned num_runs;
+    const evaluate_program_info *runs;
+    unsigned num_errors;
+    const char *const *errors;
+    unsigned num_failures;
+    const char *const *failures;
+} evaluate_test_result;
+
+typedef struct evaluate_evaluator evaluate_evaluator;
+typedef struct evaluate_results evaluate_results;
+
+/*  The EVALUATE_ABI_VERSION the library was built with.
+ */
+int evaluate_abi_version(void);
+
+/*  Why the last call on this thread that failed did so.
+ */
+const char *evaluate_last_error(void);
+
+/*  Fills in the defaults of the first _size_ bytes of _options_, and sets
+ *  its size to _size_.  Callers that cannot use the inline function
+ *  following (eg. through ctypes) give the size of their struct.
+ */
+void evaluate_process_options_init_size(evaluate_process_options *options,
+                                        size_t size);
+
+static inline void evaluate_process_options_init(
+    evaluate_process_options *options)
+{
+    evaluate_process_options_init_size(options, sizeof *options);
+}
+
+/*  Runs _name_ once, with the NULL-terminated _argv_ (which starts with the
+ *  program's own name), redirecting its streams to the files named, any of
+ *  which may be NULL to leave the stream alone.  _options_ may be NULL for
+ *  the defaults.  Fills in _info_ and returns 0, or returns -1.
+ */
+int evaluate_execute_process(const char *name, const char *const *argv,
+                             const char *input, const char *output,
+                             const char *errput,
+                             const evaluate_process_options *options,
+                             evaluate_program_info *info);
+
+/*  Makes an Evaluator, which is set up with the functions following, as
+ *  its C++ methods of the same names would, and run with evaluate_run().
+ *  Nothing is printed.  Returns NULL if it cannot be made.
+ */
+evaluate_evaluator *evaluate_evaluator_new(void);
+void evaluate_evaluator_free(evaluate_evaluator *ev);
+
+/*  The functions that take strings return 0, or -1 if one of them is NULL,
+ *  in which case _ev_ is left as it was.  A test's _input_ is a file name,
+ *  "" for no input, or "--" for the caller's standard input; its _output_
+ *  is the file of expected output, or "" for none.  An extension may be
+ *  "" for none.  Process options may be NULL, as for
+ *  evaluate_execute_process(), for the defaults.
+ */
+int evaluate_set_program(evaluate_evaluator *ev, const char *name);
+int evaluate_add_arg(evaluate_evaluator *ev, const char *arg);
+int evaluate_add_test(evaluate_evaluator *ev, const char *input,
+                      const char *output);
+void evaluate_set_repetitions(evaluate_evaluator *ev, unsigned n);
+void evaluate_set_warmup_runs(evaluate_evaluator *ev, unsigned n);
+void evaluate_check_all_runs(evaluate_evaluator *ev);
+void evaluate_check_no_runs(evaluate_evaluator *ev);
+void evaluate_stop_at_first_failure(evaluate_evaluator *ev);
+void evaluate_set_process_options(evaluate_evaluator *ev,
+                                  const evaluate_process_options *options);
+int evaluate_set_file_extensions(evaluate_evaluator *ev,
+                                 const char *input_ext,
+                                 const char *output_ext);
+int evaluate_set_error_extension(evaluate_evaluator *ev, const char *ext);
+int evaluate_set_code_extension(evaluate_evaluator *ev, const char *ext);
+void evaluate_expect_exit_code(evaluate_evaluator *ev, int code);
+void evaluate_ignore_whitespace(evaluate_evaluator *ev);
+int evaluate_ignore_chars(evaluate_evaluator *ev, const char *chars);
+void evaluate_ignore_extra_chars(evaluate_evaluator *ev);
+void evaluate_ignore_too_few_chars(evaluate_evaluator *ev);
+
+/*  Runs every test added to _ev_, and returns what came of them, or NULL.
+ *  The results must be freed with evaluate_results_free().
+ */
+evaluate_results *evaluate_run(evaluate_evaluator *ev);
+unsigned evaluate_results_count(const evaluate_results *results);
+const evaluate_test_result *evaluate_results_get(
+    const evaluate_results *results, unsigned i);
+void evaluate_results_free(evaluate_results *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,383 @@
+/*---------------------------------------------------------------------------*\
+ *  process-loop.cpp                                                         *
+ *  The loop's thread sleeps in epoll_wait() on a pidfd for each running     *
+ *    process, and on an eventfd that other threads write to when they add   *
+ *    work.  It wakes early only to enforce time limits (see check_limits()  *
+ *    in execute-process.h), or, for processes without a pidfd, to poll      *
+ *    them every millisecond.  So the cost of waiting does not grow with     *
+ *    the number of processes, and no thread is kept for each one.           *
+ *  Starting a process still blocks the loop until the child has called      *
+ *    exec(), which is normally well under a millisecond.                    *
+ *  Each running process holds the lowest slot free when it started, so      *
+ *    that its lifetime is traced on that slot's track (see trace.h).        *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "process-loop.h"
+#include "trace.h"
+using namespace std;
+
+
+struct ProcessLoop::Request {
+    string name;
+    vector<string> argv;
+    string input;
+    string output;
+    string errput;
+    ProcessOptions options;
+    ProcessCallback done;
+    function<void()> started;
+};
+
+struct ProcessLoop::Running {
+    StartedProcess process;
+    ProcessCallback done;
+    unsigned slot;
+};
+
+
+/*  Calls the callback of a run that will not be started with _error_, and
+ *  frees the request.
+ */
+void ProcessLoop::fail(Request *request, string error)
+{
+    ProcessResult result;
+    result.ran = false;
+    result.error = error;
+    try {
+        request->done(result);
+    } catch (...) {
+        // Intentionally empty: a failed callback must not end the loop
+    }
+    delete request;
+}
+
+
+ProcessLoop::ProcessLoop()
+{
+    max_running = thread::hardware_concurrency();
+    if (max_running == 0) max_running = 1;
+    stopping = false;
+    epoll_fd = -1;
+    wake_fd = -1;
+}
+
+
+/*  Stops the loop: processes still running are killed, and their callbacks
+ *  called with the error that comes of it, and runs still waiting are
+ *  failed without being started.
+ */
+ProcessLoop::~ProcessLoop()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    if (loop_thread.joinable()) {
+        wake();
+        loop_thread.join();
+    }
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (wake_fd >= 0) close(wake_fd);
+}
+
+
+ProcessLoop &ProcessLoop::shared()
+{
+    static ProcessLoop loop;
+    return loop;
+}
+
+
+ProcessLoop &ProcessLoop::set_max_running(unsigned n)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        max_running = (n == 0) ? 1 : n;
+    }
+    if (loop_thread.joinable()) wake();
+    return *this;
+}
+
+
+/*  Adds a run to the end of the queue.  _argv_ holds the process's whole
+ *  argv, starting with its name.  If given, _started_ is called on the
+ *  loop's thread just before the process is started.  Once the loop is
+ *  stopping, the run is failed at once instead, on the calling thread.
+ *  Throws a string if the loop cannot be started.
+ */
+void ProcessLoop::submit(string name, const vector<string> &argv,
+                         string input, string output, string errput,
+                         const ProcessOptions &options, ProcessCallback done,
+                         function<void()> started)
+{
+    Request *request = new Request;
+    request->name = name;
+    request->argv = argv;
+    request->input = input;
+    request->output = output;
+    request->errput = errput;
+    request->options = options;
+    request->done = done;
+    request->started = started;
+    bool stopped;
+    {
+        lock_guard<mutex> guard(lock);
+        stopped = stopping;
+        if (!stopped) pending.push_back(request);
+    }
+    if (stopped) {
+        fail(request, "stopped before the process was started");
+        return;
+    }
+    post(function<void()>());
+}
+
+
+/*  Adds a run as above, and returns a future for its ProgramInfo, which
+ *  holds the error, as a string, if there is none.
+ */
+future<ProgramInfo> ProcessLoop::submit(string name,
+                                        const vector<string> &argv,
+                                        string input, string output,
+                                        string errput,
+                                        const ProcessOptions &options)
+{
+    shared_ptr< promise<ProgramInfo> > result(new promise<ProgramInfo>);
+    future<ProgramInfo> r_val = result->get_future();
+    submit(name, argv, input, output, errput, options,
+           [result](const ProcessResult &run) {
+               if (run.ran) result->set_value(run.info);
+               else result->set_exception(make_exception_ptr(run.error));
+           });
+    return r_val;
+}
+
+
+/*  Has _task_ called on the loop's thread, before it next starts or waits
+ *  for processes, starting the thread if need be.  An empty task only
+ *  wakes the loop.
+ */
+void ProcessLoop::post(function<void()> task)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        if (task) tasks.push_back(task);
+        if (!loop_thread.joinable()) {
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            epoll_event event;
+            event.events = EPOLLIN;
+            event.data.fd = wake_fd;
+            if (epoll_fd < 0 || wake_fd < 0
+                || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event)) {
+                throw string("could not start the process loop: ")
+                      + strerror(errno);
+            }
+            loop_thread = thread(&ProcessLoop::run, this);
+        }
+    }
+    wake();
+}
+
+
+void ProcessLoop::wake()
+{
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        // Intentionally empty: the loop is already due to wake
+    }
+}
+
+
+void ProcessLoop::run()
+{
+    set_trace_track(TRACE_LOOP_TRACK);
+    vector<epoll_event> events(64);
+    while (true) {
+        deque< function<void()> > ready;
+        vector<Request *> starting;
+        {
+            lock_guard<mutex> guard(lock);
+            if (stopping) break;
+            ready.swap(tasks);
+            while (!pending.empty()
+                   && running.size() + starting.size() < max_running) {
+                starting.push_back(pending.front());
+                pending.pop_front();
+            }
+        }
+        for (unsigned i = 0; i < ready.size(); ++i) {
+            try {
+                ready[i]();
+            } catch (...) {
+                // Intentionally empty: a failed task must not end the loop
+            }
+        }
+        for (unsigned i = 0; i < starting.size(); ++i) start(starting[i]);
+
+        double timeout = 3600;
+        vector<int> polled;
+        map<int, Running *>::iterator it;
+        for (it = running.begin(); it != running.end(); ++it) {
+            double next;
+            if (!check_limits(it->second->process, &next) && next < timeout) {
+                timeout = next;
+            }
+            if (it->first < 0) polled.push_back(it->first);
+        }
+        if (!polled.empty() && timeout > 0.001) timeout = 0.001;
+        int got = epoll_wait(epoll_fd, &events[0], events.size(),
+                             (int) ceil(timeout * 1000));
+        for (int i = 0; i < got; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd) {
+                uint64_t count;
+                while (read(wake_fd, &count, sizeof(count)) > 0) {
+                    // Intentionally empty
+                }
+            } else if ((it = running.find(fd)) != running.end()) {
+                finish(it);
+            }
+        }
+        for (unsigned i = 0; i < polled.size(); ++i) {
+            it = running.find(polled[i]);
+            if (it != running.end() && has_exited(it->second->process)) {
+                finish(it);
+            }
+        }
+    }
+
+    /*  The callbacks are called without the lock, since they may submit
+     *  more runs, which fail at once now that the loop is stopping, or
+     *  post more tasks, which are run here until none are left.
+     */
+    for (map<int, Running *>::iterator it = running.begin();
+         it != running.end(); ) {
+        kill(-it->second->process.pid, SIGKILL);
+        finish(it++);
+    }
+    while (true) {
+        deque< function<void()> > ready;
+        deque<Request *> stopped;
+        {
+            lock_guard<mutex> guard(lock);
+            ready.swap(tasks);
+            stopped.swap(pending);
+        }
+        if (ready.empty() && stopped.empty()) break;
+        for (unsigned i = 0; i < ready.size(); ++i) {
+            try {
+                ready[i]();
+            } catch (...) {
+                // Intentionally empty: a failed task must not end the loop
+            }
+        }
+        for (unsigned i = 0; i < stopped.size(); ++i) {
+            fail(stopped[i], "stopped before the process was started");
+        }
+    }
+}
+
+
+/*  Starts a run, redirecting its streams as execute_process() does when
+ *  given file names.  The files can be closed at once, since the child has
+ *  its own copies.
+ */
+void ProcessLoop::start(Request *request)
+{
+    FILE *in = (request->input == "") ? stdin
+             : fopen(request->input.c_str(), "r");
+    FILE *out = (request->output == "") ? stdout
+              : fopen(request->output.c_str(), "w");
+    FILE *err = (request->errput == "") ? stderr
+              : fopen(request->errput.c_str(), "w");
+    vector<char *> argv;
+    for (unsigned i = 0; i < request->argv.size(); ++i) {
+        argv.push_back(&request->argv[i][0]);
+    }
+    argv.push_back(NULL);
+
+    Running *running_process = new Running;
+    running_process->done = request->done;
+    string error;
+    try {
+        if (request->started) request->started();
+        running_process->process = start_process(request->name, &argv[0],
+                                                 in, out, err,
+                                                 request->options);
+    } catch (string e) {
+        error = e;
+    }
+    if (in != NULL && in != stdin) fclose(in);
+    if (out != NULL && out != stdout) fclose(out);
+    if (err != NULL && err != stderr) fclose(err);
+    delete request;
+    if (error != "") {
+        ProcessResult result;
+        result.ran = false;
+        result.error = error;
+        try {
+            running_process->done(result);
+        } catch (...) {
+            // Intentionally empty
+        }
+        delete running_process;
+        return;
+    }
+
+    StartedProcess &process = running_process->process;
+    running_process->slot = 0;
+    while (running_process->slot < slots.size()
+           && slots[running_process->slot]) {
+        ++running_process->slot;
+    }
+    if (running_process->slot == slots.size()) slots.push_back(false);
+    slots[running_process->slot] = true;
+    process.trace_track = trace_slot_track(running_process->slot);
+    int key = (process.pidfd >= 0) ? process.pidfd : -process.pid;
+    map<int, Running *>::iterator it
+        = running.insert(make_pair(key, running_process)).first;
+    if (process.error != "") {
+        finish(it);
+    } else if (process.pidfd >= 0) {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = process.pidfd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, process.pidfd, &event);
+    }
+}
+
+
+/*  Reaps a run that has ended, and calls its callback.  Closing the pidfd,
+ *  which finish_process() does, also takes it out of the epoll set.
+ */
+void ProcessLoop::finish(map<int, Running *>::iterator it)
+{
+    Running *running_process = it->second;
+    running.erase(it);
+    slots[running_process->slot] = false;
+    ProcessResult result;
+    try {
+        result.info = finish_process(running_process->process);
+        result.ran = true;
+    } catch (string err) {
+        result.ran = false;
+        result.error = err;
+    }
+    try {
+        running_process->done(result);
+    } catch (...) {
+        // Intentionally empty: a failed callback must not end the loop
+    }
+    delete running_process;
+}
@@ -0,0 +1,85 @@
+/*---------------------------------------------------------------------------*\
+ *  process-loop.h                                                           *
+ *  This file contains the interface for the ProcessLoop class, which runs   *
+ *    processes in the background, many at a time, and waits for all of      *
+ *    them on one thread.  Runs are submitted with their files and options,  *
+ *    as execute_process() takes them, and are started in the order given,   *
+ *    no more than max_running at once.                                      *
+ *  When a run ends, its callback is called with the ProgramInfo, or with    *
+ *    the error execute_process() would have thrown.  Callbacks are called   *
+ *    on the loop's own thread, one at a time, so they should be quick, and  *
+ *    may submit further runs.  The loop's thread is started with the first  *
+ *    run, and ended when the loop is destroyed, which kills any runs still  *
+ *    going and fails any still waiting, or submitted while it stops.        *
+ *  shared() is a loop for the whole program, so that every caller's runs    *
+ *    count against one limit.                                               *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef PROCESS_LOOP_H_INCLUDED
+#define PROCESS_LOOP_H_INCLUDED
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "execute-process.h"
+
+struct ProcessResult {
+    bool ran;               /* false if error says why there is no info */
+    std::string error;
+    ProgramInfo info;
+};
+
+typedef std::function<void(const ProcessResult &)> ProcessCallback;
+
+class ProcessLoop
+{
+public:
+    ProcessLoop();
+    ~ProcessLoop();
+
+    static ProcessLoop &shared();
+
+    ProcessLoop &set_max_running(unsigned n);
+    void submit(std::string name, const std::vector<std::string> &argv,
+                std::string input, std::string output, std::string errput,
+                const ProcessOptions &options, ProcessCallback done,
+                std::function<void()> started = std::function<void()>());
+    std::future<ProgramInfo> submit(std::string name,
+                                    const std::vector<std::string> &argv,
+                                    std::string input, std::string output,
+                                    std::string errput,
+                                    const ProcessOptions &options);
+    void post(std::function<void()> task);
+
+private:
+    struct Request;
+    struct Running;
+
+    std::mutex lock;
+    std::deque<Request *> pending;
+    std::deque< std::function<void()> > tasks;
+    std::map<int, Running *> running;   /* by pidfd, or by -pid if none */
+    std::vector<bool> slots;            /* which are taken by running */
+    unsigned max_running;
+    bool stopping;
+    int epoll_fd;
+    int wake_fd;
+    std::thread loop_thread;
+
+    void run();
+    void wake();
+    void start(Request *request);
+    void finish(std::map<int, Running *>::iterator it);
+    static void fail(Request *request, std::string error);
+
+    ProcessLoop(const ProcessLoop &);
+    ProcessLoop &operator=(const ProcessLoop &);
+};
+
+#endif
@@ -0,0 +1,463 @@
+/*---------------------------------------------------------------------------*\
+ *  profile.cpp                                                              *
+ *  Each attached process has one perf event for each CPU, opened disabled   *
+ *    and enabled by its exec(), and inherited by its threads and children.  *
+ *    (The kernel will not give an inherited event that counts on every CPU  *
+ *    a ring buffer, so there is one buffer for each CPU, as "perf record"   *
+ *    does.)  A thread for each process sleeps in poll() until a buffer is   *
+ *    partly full, and then reads them all out, so that a long run loses no  *
+ *    samples; detach() reads what is left.                                  *
+ *  Besides the samples, the buffers hold a record of each executable        *
+ *    mapping the processes make, and of each fork, from which the file and  *
+ *    offset of each address are found.  Samples are named as they are read, *
+ *    since addresses are only meaningful while the mappings are known, so   *
+ *    the records read from all the buffers are put in time order first.     *
+ *    The symbols of each file are read once, when first needed.             *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "profile.h"
+using namespace std;
+
+static const unsigned MAX_DATA_PAGES = 16;
+static const unsigned MIN_DATA_PAGES = 2;
+
+struct Profiler::Buffer {
+    int fd;
+    char *base;             /* the metadata page, then the data */
+    size_t data_size;
+};
+
+struct Profiler::Attachment {
+    pid_t pid;
+    vector<Buffer> buffers; /* one for each CPU */
+    int stop_fd;
+    size_t page_size;
+    thread watcher;
+};
+
+
+Profiler::Profiler(unsigned frequency)
+    : frequency(frequency)
+{
+    sample_count = 0;
+    lost_count = 0;
+}
+
+
+Profiler::~Profiler()
+{
+    vector<pid_t> pids;
+    {
+        lock_guard<mutex> guard(lock);
+        map<pid_t, Attachment *>::iterator it;
+        for (it = attached.begin(); it != attached.end(); ++it) {
+            pids.push_back(it->first);
+        }
+    }
+    for (unsigned i = 0; i < pids.size(); ++i) detach(pids[i]);
+    map<string, ElfSymbols *>::iterator it;
+    for (it = files.begin(); it != files.end(); ++it) delete it->second;
+}
+
+
+/*  attach()
+ *  Returns false, keeping the reason for error() if it is the first, if the
+ *  process cannot be sampled on any CPU.  CPUs that are offline are skipped,
+ *  and the buffers made smaller if the locked memory allowed runs short.
+ */
+bool Profiler::attach(pid_t pid)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_CPU_CLOCK;
+    attr.freq = 1;
+    attr.sample_freq = frequency;
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME
+                     | PERF_SAMPLE_CALLCHAIN;
+    attr.sample_id_all = 1;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_callchain_kernel = 1;
+    attr.mmap = 1;
+    attr.task = 1;
+    attr.watermark = 1;
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    attr.wakeup_watermark = page_size;
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    unsigned pages = MAX_DATA_PAGES;
+    vector<Buffer> buffers;
+    string error;
+    for (long cpu = 0; cpu < cpus; ++cpu) {
+        int fd = syscall(SYS_perf_event_open, &attr, pid, (int) cpu, -1,
+                         PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0) {
+            if (error == "") {
+                error = string("cannot open a perf event: ") + strerror(errno);
+            }
+            continue;
+        }
+        void *base = MAP_FAILED;
+        while (pages >= MIN_DATA_PAGES) {
+            base = mmap(NULL, (pages + 1) * page_size,
+                        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (base != MAP_FAILED) break;
+            pages /= 2;
+        }
+        if (base == MAP_FAILED) {
+            if (error == "") {
+                error = string("cannot map a perf buffer: ") + strerror(errno);
+            }
+            close(fd);
+            pages = MIN_DATA_PAGES;
+            continue;
+        }
+        Buffer buffer;
+        buffer.fd = fd;
+        buffer.base = (char *) base;
+        buffer.data_size = pages * page_size;
+        buffers.push_back(buffer);
+    }
+    int stop_fd = buffers.empty() ? -1 : eventfd(0, EFD_CLOEXEC);
+    if (!buffers.empty() && stop_fd < 0) {
+        error = string("cannot profile: ") + strerror(errno);
+    }
+    if (stop_fd < 0) {
+        for (unsigned i = 0; i < buffers.size(); ++i) {
+            munmap(buffers[i].base, page_size + buffers[i].data_size);
+            close(buffers[i].fd);
+        }
+        lock_guard<mutex> guard(lock);
+        if (first_error == "") first_error = error;
+        return false;
+    }
+
+    Attachment *attachment = new Attachment;
+    attachment->pid = pid;
+    attachment->buffers = buffers;
+    attachment->stop_fd = stop_fd;
+    attachment->page_size = page_size;
+    {
+        lock_guard<mutex> guard(lock);
+        attached[pid] = attachment;
+        mappings.erase(pid);
+    }
+    attachment->watcher = thread(&Profiler::watch, this, attachment);
+    return true;
+}
+
+
+/*  detach()
+ *  Does nothing for a process that is not attached, eg. because attach()
+ *  failed.
+ */
+void Profiler::detach(pid_t pid)
+{
+    Attachment *attachment;
+    {
+        lock_guard<mutex> guard(lock);
+        map<pid_t, Attachment *>::iterator found = attached.find(pid);
+        if (found == attached.end()) return;
+        attachment = found->second;
+        attached.erase(found);
+    }
+    uint64_t one = 1;
+    if (write(attachment->stop_fd, &one, sizeof(one)) < 0) {
+        // Intentionally empty: an eventfd write cannot fail here
+    }
+    attachment->watcher.join();
+    {
+        lock_guard<mutex> guard(lock);
+        drain(attachment);
+    }
+    for (unsigned i = 0; i < attachment->buffers.size(); ++i) {
+        Buffer &buffer = attachment->buffers[i];
+        munmap(buffer.base, attachment->page_size + buffer.data_size);
+        close(buffer.fd);
+    }
+    close(attachment->stop_fd);
+    delete attachment;
+}
+
+
+void Profiler::clear()
+{
+    lock_guard<mutex> guard(lock);
+    stacks.clear();
+    leaves.clear();
+    sample_count = 0;
+    lost_count = 0;
+}
+
+
+unsigned long Profiler::samples() const
+{
+    lock_guard<mutex> guard(lock);
+    return sample_count;
+}
+
+
+unsigned long Profiler::lost() const
+{
+    lock_guard<mutex> guard(lock);
+    return lost_count;
+}
+
+
+string Profiler::error() const
+{
+    lock_guard<mutex> guard(lock);
+    return first_error;
+}
+
+
+/*  Throws a string if the file cannot be written.
+ */
+void Profiler::write_folded(string filename) const
+{
+    FILE *file = fopen(filename.c_str(), "w");
+    if (file == NULL) {
+        throw string("cannot open profile file \"") + filename + "\": "
+              + strerror(errno);
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        map<string, unsigned long>::const_iterator it;
+        for (it = stacks.begin(); it != stacks.end(); ++it) {
+            fprintf(file, "%s %lu\n", it->first.c_str(), it->second);
+        }
+    }
+    if (fclose(file)) {
+        throw string("cannot write profile file \"") + filename + "\": "
+              + strerror(errno);
+    }
+}
+
+
+/*  Returns the _n_ functions found running in the most samples, most first,
+ *  each with the fraction of the samples it was found in.
+ */
+vector< pair<string, double> > Profiler::hot_functions(unsigned n) const
+{
+    lock_guard<mutex> guard(lock);
+    vector< pair<unsigned long, string> > counts;
+    map<string, unsigned long>::const_iterator it;
+    for (it = leaves.begin(); it != leaves.end(); ++it) {
+        counts.push_back(make_pair(it->second, it->first));
+    }
+    sort(counts.begin(), counts.end(),
+         [](const pair<unsigned long, string> &a,
+            const pair<unsigned long, string> &b) {
+             return a.first > b.first
+                    || (a.first == b.first && a.second < b.second);
+         });
+    vector< pair<string, double> > r_val;
+    for (unsigned i = 0; i < counts.size() && i < n; ++i) {
+        r_val.push_back(make_pair(counts[i].second,
+                                  (double) counts[i].first / sample_count));
+    }
+    return r_val;
+}
+
+
+/*  watch()
+ *  Reads the buffers whenever the kernel says one is partly full, until
+ *  detach() writes to stop_fd.  Once the process itself has exited, an
+ *  event only reports that, so it is no longer waited on.
+ */
+void Profiler::watch(Attachment *attachment)
+{
+    vector<pollfd> fds(attachment->buffers.size() + 1);
+    for (unsigned i = 0; i < attachment->buffers.size(); ++i) {
+        fds[i].fd = attachment->buffers[i].fd;
+        fds[i].events = POLLIN;
+    }
+    pollfd &stop = fds.back();
+    stop.fd = attachment->stop_fd;
+    stop.events = POLLIN;
+    while (true) {
+        if (poll(&fds[0], fds.size(), -1) < 0 && errno != EINTR) return;
+        if (stop.revents) return;
+        for (unsigned i = 0; i + 1 < fds.size(); ++i) {
+            if (fds[i].revents & (POLLHUP | POLLERR)) fds[i].fd = -1;
+        }
+        lock_guard<mutex> guard(lock);
+        drain(attachment);
+    }
+}
+
+
+/*  Returns when a record was made.  Samples have the time after the address
+ *  and thread, other records at their end (with sample_id_all).
+ */
+static uint64_t record_time(const string &event)
+{
+    uint64_t time = 0;
+    const perf_event_header *header = (const perf_event_header *) &event[0];
+    size_t at = (header->type == PERF_RECORD_SAMPLE) ? sizeof(*header) + 16
+                                                     : event.size() - 8;
+    if (at + 8 <= event.size()) memcpy(&time, &event[at], 8);
+    return time;
+}
+
+/*  Reads every record in the buffers, in the order they were made.  Must be
+ *  called with the lock.
+ */
+void Profiler::drain(Attachment *attachment)
+{
+    vector< pair<uint64_t, string> > events;
+    for (unsigned i = 0; i < attachment->buffers.size(); ++i) {
+        Buffer &buffer = attachment->buffers[i];
+        perf_event_mmap_page *meta = (perf_event_mmap_page *) buffer.base;
+        const char *data = buffer.base + attachment->page_size;
+        size_t size = buffer.data_size;
+        uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+        uint64_t tail = meta->data_tail;
+        while (tail < head) {
+            size_t start = tail % size;
+            const perf_event_header *header
+                = (const perf_event_header *) (data + start);
+            if (header->size < sizeof(*header)) break;
+            string event;
+            if (start + header->size <= size) {
+                event.assign(data + start, header->size);
+            } else {
+                size_t first = size - start;
+                event.assign(data + start, first);
+                event.append(data, header->size - first);
+            }
+            tail += header->size;
+            events.push_back(make_pair(record_time(event), event));
+        }
+        __atomic_store_n(&meta->data_tail, head, __ATOMIC_RELEASE);
+    }
+    stable_sort(events.begin(), events.end(),
+                [](const pair<uint64_t, string> &a,
+                   const pair<uint64_t, string> &b) {
+                    return a.first < b.first;
+                });
+    for (unsigned i = 0; i < events.size(); ++i) {
+        record(events[i].second.data());
+    }
+}
+
+
+/*  Takes in one record from a buffer.  Must be called with the lock.
+ */
+void Profiler::record(const char *event)
+{
+    perf_event_header header;
+    memcpy(&header, event, sizeof(header));
+    const char *body = event + sizeof(header);
+    size_t body_size = header.size - sizeof(header);
+    uint32_t pid, ppid;
+
+    if (header.type == PERF_RECORD_SAMPLE && body_size >= 32) {
+        uint64_t ip, depth;
+        memcpy(&ip, body, 8);
+        memcpy(&pid, body + 8, 4);
+        memcpy(&depth, body + 24, 8);
+        depth = min<uint64_t>(depth, (body_size - 32) / 8);
+        vector<string> frames;
+        for (uint64_t i = 0; i < depth; ++i) {
+            uint64_t address;
+            memcpy(&address, body + 32 + 8 * i, 8);
+            if (address >= (uint64_t) PERF_CONTEXT_MAX) continue;
+            /*  Return addresses are just after their calls, which may be
+             *  the last instruction of a function.
+             */
+            frames.push_back(function_at(pid, frames.empty() ? address
+                                                             : address - 1));
+        }
+        if (frames.empty()) frames.push_back(function_at(pid, ip));
+        string folded = frames.back();
+        for (unsigned i = frames.size() - 1; i-- > 0; ) {
+            folded += ";" + frames[i];
+        }
+        ++stacks[folded];
+        ++leaves[frames[0]];
+        ++sample_count;
+    } else if (header.type == PERF_RECORD_MMAP && body_size > 32) {
+        Mapping mapping;
+        uint64_t length;
+        memcpy(&pid, body, 4);
+        memcpy(&mapping.start, body + 8, 8);
+        memcpy(&length, body + 16, 8);
+        memcpy(&mapping.offset, body + 24, 8);
+        mapping.end = mapping.start + length;
+        mapping.file = string(body + 32, strnlen(body + 32, body_size - 32));
+        add_mapping(pid, mapping);
+    } else if (header.type == PERF_RECORD_FORK && body_size >= 8) {
+        memcpy(&pid, body, 4);
+        memcpy(&ppid, body + 4, 4);
+        if (pid != ppid) mappings[pid] = mappings[ppid];
+    } else if (header.type == PERF_RECORD_LOST && body_size >= 16) {
+        uint64_t lost;
+        memcpy(&lost, body + 8, 8);
+        lost_count += lost;
+    }
+}
+
+
+/*  Adds a mapping of process _pid_, replacing any it overlaps (eg. those of
+ *  the program it was before an exec()).
+ */
+void Profiler::add_mapping(pid_t pid, const Mapping &mapping)
+{
+    vector<Mapping> &known = mappings[pid];
+    for (unsigned i = 0; i < known.size(); ) {
+        if (known[i].start < mapping.end && mapping.start < known[i].end) {
+            known.erase(known.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+    known.push_back(mapping);
+}
+
+
+/*  Names the function at _address_ in process _pid_.  An address in a file
+ *  without a symbol for it is named by the file, as "[libc.so.6]"; one in
+ *  no file by its mapping, as "[vdso]", or "[unknown]".
+ */
+string Profiler::function_at(pid_t pid, uint64_t address)
+{
+    map<pid_t, vector<Mapping> >::const_iterator found = mappings.find(pid);
+    if (found == mappings.end()) return "[unknown]";
+    const vector<Mapping> &known = found->second;
+    for (unsigned i = 0; i < known.size(); ++i) {
+        const Mapping &mapping = known[i];
+        if (address < mapping.start || address >= mapping.end) continue;
+        if (mapping.file == "" || mapping.file[0] != '/') {
+            return (mapping.file != "" && mapping.file[0] == '[')
+                   ? mapping.file : "[unknown]";
+        }
+        ElfSymbols *&symbols = files[mapping.file];
+        if (symbols == NULL) {
+            symbols = new ElfSymbols;
+            symbols->load(mapping.file);
+        }
+        string name = symbols->name_at(address - mapping.start
+                                       + mapping.offset);
+        if (name != "") return name;
+        return "[" + mapping.file.substr(mapping.file.rfind('/') + 1) + "]";
+    }
+    return "[unknown]";
+}
@@ -0,0 +1,88 @@
+/*---------------------------------------------------------------------------*\
+ *  profile.h                                                                *
+ *  This file contains the interface for the Profiler class, which samples   *
+ *    where a process spends its CPU time, with the kernel's cpu-clock       *
+ *    software event (see perf_event_open(2)), which needs no access to the  *
+ *    hardware counters.  Each sample is the process's user-space call       *
+ *    stack, with each address named by the ELF symbols of the file it is   *
+ *    in (see elf-symbols.h).  Stacks are walked by frame pointer, so        *
+ *    programs built without them show only their innermost function.       *
+ *                                                                           *
+ *  Profiler::attach() starts sampling a process that has not yet called     *
+ *    exec(): sampling begins with the exec, and follows the process's       *
+ *    threads and children.  execute_process() does this for a Profiler     *
+ *    given in its ProcessOptions.  Profiler::detach() reads the last        *
+ *    samples once the process has ended.  Any number of processes may be   *
+ *    attached at once; their samples are counted together, until clear().  *
+ *  If a process cannot be sampled (eg. perf_event_paranoid forbids it), it  *
+ *    is run unsampled, and Profiler::error() says why.                      *
+ *                                                                           *
+ *  Profiler::write_folded() writes the samples as "folded" stacks, one     *
+ *    line per distinct stack, outermost function first:                    *
+ *      main;sort;compare 42                                                 *
+ *    which flame graph tools (eg. flamegraph.pl, speedscope) read.          *
+ *  Profiler::hot_functions() gives the functions most often found running, *
+ *    with the share of the samples each was found in.                       *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef PROFILE_H_INCLUDED
+#define PROFILE_H_INCLUDED
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+#include "elf-symbols.h"
+
+class Profiler
+{
+public:
+    Profiler(unsigned frequency = 999);
+    ~Profiler();
+
+    bool attach(pid_t pid);
+    void detach(pid_t pid);
+    void clear();
+
+    unsigned long samples() const;
+    unsigned long lost() const;
+    std::string error() const;
+    void write_folded(std::string filename) const;
+    std::vector< std::pair<std::string, double> >
+    hot_functions(unsigned n) const;
+
+private:
+    struct Mapping {
+        uint64_t start;
+        uint64_t end;
+        uint64_t offset;
+        std::string file;
+    };
+    struct Buffer;
+    struct Attachment;
+
+    unsigned frequency;
+    mutable std::mutex lock;
+    std::map<pid_t, Attachment *> attached;
+    std::map<pid_t, std::vector<Mapping> > mappings;    /* by process */
+    std::map<std::string, ElfSymbols *> files;
+    std::map<std::string, unsigned long> stacks;
+    std::map<std::string, unsigned long> leaves;
+    unsigned long sample_count;
+    unsigned long lost_count;
+    std::string first_error;
+
+    void watch(Attachment *attachment);
+    void drain(Attachment *attachment);
+    void record(const char *event);
+    void add_mapping(pid_t pid, const Mapping &mapping);
+    std::string function_at(pid_t pid, uint64_t address);
+
+    Profiler(const Profiler &);
+    Profiler &operator=(const Profiler &);
+};
+
+#endif
@@ -0,0 +1,306 @@
+/*---------------------------------------------------------------------------*\
+ *  results.cpp                                                              *
+ *  This implementation writes each line with a single fprintf() to a file   *
+ *    opened for appending, and flushes it at once, so that the record is    *
+ *    complete up to the last finished run even if the harness is killed.    *
+ *  When syncing, each line is still flushed at once; fdatasync() is only    *
+ *    called once enough lines or time have built up, since it is slow.      *
+ *  Lines that cannot be parsed (eg. a last line cut short) are skipped.     *
+ *    A log opened for appending first loses any such last line, so that    *
+ *    the next line written is not joined onto it.                           *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "results.h"
+using namespace std;
+
+
+static double now_seconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+ResultLog::ResultLog()
+{
+    file = NULL;
+    sync_lines = 0;
+    sync_seconds = 0;
+    unsynced = 0;
+    last_sync = 0;
+}
+
+
+ResultLog::~ResultLog()
+{
+    close();
+}
+
+
+/*  Cuts _filename_ back to the end of its last complete line, if it does
+ *  not end with one.  A file that does not exist is left alone.
+ */
+static void trim_partial_line(const string &filename)
+{
+    int fd = ::open(filename.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat info;
+    off_t end = (fstat(fd, &info) == 0) ? info.st_size : 0;
+    char block[4096];
+    bool trimmed = false;
+    while (end > 0 && !trimmed) {
+        off_t start = (end > (off_t)sizeof(block)) ? end - sizeof(block) : 0;
+        ssize_t got = pread(fd, block, end - start, start);
+        if (got != end - start) break;
+        if (end == info.st_size && block[got - 1] == '\n') break;
+        for (ssize_t i = got - 1; i >= 0 && !trimmed; --i) {
+            if (block[i] == '\n') {
+                trimmed = ftruncate(fd, start + i + 1) == 0;
+            }
+        }
+        end = start;
+        if (end == 0 && !trimmed) trimmed = ftruncate(fd, 0) == 0;
+    }
+    ::close(fd);
+}
+
+
+/*  Opens _filename_ for the log, either replacing it or adding to its end.
+ *  Throws a string if it cannot be opened.
+ */
+void ResultLog::open(string filename, bool append)
+{
+    close();
+    if (append) trim_partial_line(filename);
+    file = fopen(filename.c_str(), append ? "a" : "w");
+    if (file == NULL) {
+        throw string("cannot open results file \"") + filename + "\": "
+              + strerror(errno);
+    }
+}
+
+
+bool ResultLog::is_open() const
+{
+    return file != NULL;
+}
+
+
+void ResultLog::close()
+{
+    if (file == NULL) return;
+    if (sync_lines && unsynced) sync();
+    fclose(file);
+    file = NULL;
+}
+
+
+/*  Makes the log sync to disk after _lines_ lines, or after the first line
+ *  written once _seconds_ have passed since the last sync, whichever comes
+ *  first.  Zero lines turns syncing off.
+ */
+ResultLog &ResultLog::sync_every(unsigned lines, double seconds)
+{
+    sync_lines = lines;
+    sync_seconds = seconds;
+    last_sync = now_seconds();
+    return *this;
+}
+
+
+void ResultLog::sync()
+{
+    fflush(file);
+    fdatasync(fileno(file));
+    unsynced = 0;
+    last_sync = now_seconds();
+}
+
+
+void ResultLog::written()
+{
+    fflush(file);
+    if (sync_lines == 0) return;
+    ++unsynced;
+    if (unsynced >= sync_lines || now_seconds() - last_sync >= sync_seconds) {
+        sync();
+    }
+}
+
+
+void ResultLog::log_run(string input, string output, unsigned repetition,
+                        const ProgramInfo &run)
+{
+    if (file == NULL) return;
+    fprintf(file, "run\t%s\t%s\t%u\t%u.%06u\t%u.%06u\t%u.%06u\t%ld\t%d\n",
+            input.c_str(), output.c_str(), repetition,
+            run.wall_sec, run.wall_usec, run.user_sec, run.user_usec,
+            run.sys_sec, run.sys_usec, run.max_rss_kb, run.exit_code);
+    const vector<long> &points = run.memory_timeline.points;
+    if (!points.empty()) {
+        string kb;
+        for (unsigned i = 0; i < points.size(); ++i) {
+            if (i) kb += ",";
+            kb += to_string(points[i]);
+        }
+        fprintf(file, "memory\t%s\t%s\t%u\t%.6f\t%s\n", input.c_str(),
+                output.c_str(), repetition, run.memory_timeline.interval,
+                kb.c_str());
+    }
+    written();
+}
+
+
+void ResultLog::log_verdict(string input, string output, bool passed)
+{
+    if (file == NULL) return;
+    fprintf(file, "verdict\t%s\t%s\t%d\n", input.c_str(), output.c_str(),
+            passed ? 1 : 0);
+    written();
+}
+
+
+/*  Records what produced the runs that follow, so that a log can be
+ *  checked against the settings of the process that adds to it.
+ */
+void ResultLog::log_fingerprint(string fingerprint)
+{
+    if (file == NULL) return;
+    fprintf(file, "fingerprint\t%s\n", fingerprint.c_str());
+    written();
+}
+
+
+/*  Splits "S.U" into whole seconds and microseconds.  Returns false if the
+ *  text is not of that form.
+ */
+static bool parse_seconds(const string &text, unsigned *sec, unsigned *usec)
+{
+    char *end;
+    *sec = strtoul(text.c_str(), &end, 10);
+    if (*end != '.' || strlen(end + 1) != 6) return false;
+    *usec = strtoul(end + 1, &end, 10);
+    return *end == '\0';
+}
+
+static vector<string> split_tabs(const string &line)
+{
+    vector<string> fields;
+    string::size_type start = 0, tab;
+    while ((tab = line.find('\t', start)) != string::npos) {
+        fields.push_back(line.substr(start, tab - start));
+        start = tab + 1;
+    }
+    fields.push_back(line.substr(start));
+    return fields;
+}
+
+
+typedef map< pair<string, string>, unsigned > TestIndex;
+
+/*  Adds the timeline on a memory line to the run it follows, if that run
+ *  has been read.
+ */
+static void read_memory_line(const vector<string> &fields,
+                             const TestIndex &index,
+                             vector<LoggedTest> &tests)
+{
+    TestIndex::const_iterator found
+        = index.find(make_pair(fields[1], fields[2]));
+    if (found == index.end()) return;
+    map<unsigned, ProgramInfo> &runs = tests[found->second].runs;
+    map<unsigned, ProgramInfo>::iterator run
+        = runs.find(strtoul(fields[3].c_str(), NULL, 10));
+    if (run == runs.end()) return;
+    MemoryTimeline timeline;
+    timeline.interval = atof(fields[4].c_str());
+    stringstream points(fields[5]);
+    string point;
+    while (getline(points, point, ',')) {
+        timeline.points.push_back(atol(point.c_str()));
+    }
+    run->second.memory_timeline = timeline;
+}
+
+void read_result_log(string filename, vector<LoggedTest> &tests)
+{
+    ifstream in(filename.c_str());
+    if (!in.is_open()) {
+        throw string("cannot read results file \"") + filename + "\"";
+    }
+    map< pair<string, string>, unsigned > index;
+    for (unsigned i = 0; i < tests.size(); ++i) {
+        index[make_pair(tests[i].input_file, tests[i].output_file)] = i;
+    }
+    string line;
+    while (getline(in, line)) {
+        vector<string> fields = split_tabs(line);
+        bool is_run = fields[0] == "run" && fields.size() == 9;
+        bool is_verdict = fields[0] == "verdict" && fields.size() == 4;
+        if (fields[0] == "memory" && fields.size() == 6) {
+            read_memory_line(fields, index, tests);
+            continue;
+        }
+        if (!is_run && !is_verdict) continue;
+
+        ProgramInfo run;
+        unsigned repetition = 0;
+        if (is_run) {
+            stringstream numbers(fields[3] + " " + fields[7] + " "
+                                 + fields[8]);
+            if (!(numbers >> repetition >> run.max_rss_kb >> run.exit_code)
+                || !parse_seconds(fields[4], &run.wall_sec, &run.wall_usec)
+                || !parse_seconds(fields[5], &run.user_sec, &run.user_usec)
+                || !parse_seconds(fields[6], &run.sys_sec, &run.sys_usec)) {
+                continue;
+            }
+        } else if (fields[3] != "0" && fields[3] != "1") {
+            continue;
+        }
+
+        pair<string, string> key(fields[1], fields[2]);
+        map< pair<string, string>, unsigned >::iterator found
+            = index.find(key);
+        if (found == index.end()) {
+            LoggedTest test;
+            test.input_file = fields[1];
+            test.output_file = fields[2];
+            test.verdict = -1;
+            found = index.insert(make_pair(key, tests.size())).first;
+            tests.push_back(test);
+        }
+        LoggedTest &test = tests[found->second];
+        if (is_run) {
+            test.runs[repetition] = run;
+        } else if (fields[3] == "0") {
+            test.verdict = 0;
+        } else if (test.verdict == -1) {
+            test.verdict = 1;
+        }
+    }
+}
+
+
+string read_log_fingerprint(string filename)
+{
+    ifstream in(filename.c_str());
+    if (!in.is_open()) {
+        throw string("cannot read results file \"") + filename + "\"";
+    }
+    string line;
+    if (!getline(in, line)) return "";
+    vector<string> fields = split_tabs(line);
+    if (fields[0] != "fingerprint" || fields.size() != 2) return "";
+    return fields[1];
+}
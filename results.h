@@ -0,0 +1,84 @@
+/*---------------------------------------------------------------------------*\
+ *  results.h                                                                *
+ *  This file contains the interface for the ResultLog class, which writes   *
+ *    a machine-readable record of each run and each verdict as it happens,  *
+ *    and for read_result_log(), which reads such a record back.             *
+ *                                                                           *
+ *  The record is plain text, one tab-separated line per event:              *
+ *      run <input> <output> <repetition> <real> <user> <sys> <rss> <exit>   *
+ *      memory <input> <output> <repetition> <interval> <kb>,<kb>,...        *
+ *      verdict <input> <output> <passed>                                    *
+ *      fingerprint <hash>                                                   *
+ *    Times are in seconds, peak memory in kilobytes, and <passed> is 1 or   *
+ *    0.  A memory line follows the run line of a run whose memory was       *
+ *    sampled over time (see MemoryTimeline), giving each point in turn.     *
+ *    A fingerprint line, if any, comes first, and says what produced the    *
+ *    runs (see ResultLog::log_fingerprint()).                               *
+ *    Since every line stands alone, records from several processes (eg.     *
+ *    several shards of one suite) can be read together.                     *
+ *  ResultLog::sync_every() makes the log durable as well: every so many     *
+ *    lines, or every so many seconds, it is flushed to disk with            *
+ *    fdatasync(), so that it survives a crash of the machine, and not just  *
+ *    of the harness.                                                        *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef RESULTS_H_INCLUDED
+#define RESULTS_H_INCLUDED
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "execute-process.h"
+
+struct LoggedTest {
+    std::string input_file;
+    std::string output_file;
+    std::map<unsigned, ProgramInfo> runs;   /* by repetition */
+    int verdict;        /* 1 passed, 0 failed, -1 never checked */
+};
+
+class ResultLog
+{
+public:
+    ResultLog();
+    ~ResultLog();
+
+    void open(std::string filename, bool append);
+    bool is_open() const;
+    void close();
+    ResultLog &sync_every(unsigned lines, double seconds);
+
+    void log_run(std::string input, std::string output, unsigned repetition,
+                 const ProgramInfo &run);
+    void log_verdict(std::string input, std::string output, bool passed);
+    void log_fingerprint(std::string fingerprint);
+
+private:
+    FILE *file;
+    unsigned sync_lines;
+    double sync_seconds;
+    unsigned unsynced;
+    double last_sync;
+
+    void written();
+    void sync();
+
+    ResultLog(const ResultLog &);
+    ResultLog &operator=(const ResultLog &);
+};
+
+/*  Reads the tests recorded in _filename_, in the order they first appear,
+ *    and adds them to _tests_.  A test recorded more than once is merged:
+ *    its runs are combined, and it passes only if every verdict was a pass.
+ *    Throws a string if the file cannot be read.
+ */
+void read_result_log(std::string filename, std::vector<LoggedTest> &tests);
+
+/*  Returns the fingerprint on the first line of _filename_, or the empty
+ *    string if it has none.  Throws a string if the file cannot be read.
+ */
+std::string read_log_fingerprint(std::string filename);
+
+#endif
@@ -0,0 +1,162 @@
+/*---------------------------------------------------------------------------*\
+ *  scaling.cpp                                                              *
+ *  This implementation depends on the string, vector, cmath, fstream, and   *
+ *    algorithm libraries, and on boost::filesystem for file sizes.          *
+ *  Sizes read from file names are the first run of digits in the name,      *
+ *    optionally followed by a k, m, or g multiplier (so "10k" is 10000).    *
+ *  Logarithms are taken base 2; since each fit has its own constant, the    *
+ *    base only changes the constant, not the ranking.                       *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+#include <fstream>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include "scaling.h"
+using namespace std;
+
+
+static double size_from_name(string input)
+{
+    namespace fs = boost::filesystem;
+    string name = fs::path(input).filename().native();
+    string::size_type start = name.find_first_of("0123456789");
+    if (start == string::npos) return -1;
+    string::size_type end = name.find_first_not_of("0123456789", start);
+    double n = atof(name.substr(start, end - start).c_str());
+    if (end != string::npos) {
+        switch (tolower(name[end])) {
+        case 'k':  n *= 1e3; break;
+        case 'm':  n *= 1e6; break;
+        case 'g':  n *= 1e9; break;
+        }
+    }
+    return n;
+}
+
+static double size_from_sidecar(string input, string sidecar_ext)
+{
+    ifstream sidecar((input + sidecar_ext).c_str());
+    double n;
+    if (sidecar >> n) return n;
+    return -1;
+}
+
+static double size_from_bytes(string input)
+{
+    namespace fs = boost::filesystem;
+    boost::system::error_code err;
+    boost::uintmax_t bytes = fs::file_size(input, err);
+    if (err) return -1;
+    return (double) bytes;
+}
+
+
+double input_size(string input, SizeSource source, string sidecar_ext)
+{
+    if (input == "" || input == "--") return -1;
+    double n;
+    switch (source) {
+    case SIZE_FROM_NAME:     return size_from_name(input);
+    case SIZE_FROM_SIDECAR:  return size_from_sidecar(input, sidecar_ext);
+    case SIZE_FROM_BYTES:    return size_from_bytes(input);
+    case SIZE_AUTO:
+        if ((n = size_from_sidecar(input, sidecar_ext)) >= 0) return n;
+        if ((n = size_from_name(input)) >= 0) return n;
+        return size_from_bytes(input);
+    }
+    return -1;
+}
+
+
+SizeSource parse_size_source(string name)
+{
+    if (name == "auto")    return SIZE_AUTO;
+    if (name == "name")    return SIZE_FROM_NAME;
+    if (name == "sidecar") return SIZE_FROM_SIDECAR;
+    if (name == "bytes")   return SIZE_FROM_BYTES;
+    throw string("unknown size source \"") + name
+        + "\" (expected auto, name, sidecar, or bytes)";
+}
+
+
+double complexity_term(ComplexityClass complexity, double n)
+{
+    double lg = (n > 1) ? log2(n) : 0.0;
+    switch (complexity) {
+    case COMPLEXITY_1:          return 1.0;
+    case COMPLEXITY_LOG_N:      return lg;
+    case COMPLEXITY_N:          return n;
+    case COMPLEXITY_N_LOG_N:    return n * lg;
+    case COMPLEXITY_N_SQUARED:  return n * n;
+    case COMPLEXITY_N_CUBED:    return n * n * n;
+    }
+    return 0.0;
+}
+
+string complexity_name(ComplexityClass complexity)
+{
+    switch (complexity) {
+    case COMPLEXITY_1:          return "O(1)";
+    case COMPLEXITY_LOG_N:      return "O(log n)";
+    case COMPLEXITY_N:          return "O(n)";
+    case COMPLEXITY_N_LOG_N:    return "O(n log n)";
+    case COMPLEXITY_N_SQUARED:  return "O(n^2)";
+    case COMPLEXITY_N_CUBED:    return "O(n^3)";
+    }
+    return "O(?)";
+}
+
+
+static bool better_fit(const ComplexityFit &a, const ComplexityFit &b)
+{
+    return a.rms < b.rms;
+}
+
+/*  For a model t = c * f(n), the least-squares constant is
+ *      c = sum(t * f(n)) / sum(f(n)^2)
+ *  The error of each fit is normalized by the mean time, so that fits of
+ *  fast and slow programs can be compared on the same scale.
+ */
+vector<ComplexityFit> fit_complexities(const vector<double> &sizes,
+                                       const vector<double> &times)
+{
+    vector<ComplexityFit> fits;
+    unsigned len = sizes.size();
+    if (len != times.size()) return fits;
+    vector<double> distinct(sizes);
+    sort(distinct.begin(), distinct.end());
+    if (unique(distinct.begin(), distinct.end()) - distinct.begin() < 2) {
+        return fits;
+    }
+    double mean = 0.0;
+    for (unsigned i = 0; i < len; ++i) mean += times[i];
+    mean /= len;
+
+    for (int c = COMPLEXITY_1; c <= COMPLEXITY_N_CUBED; ++c) {
+        ComplexityFit fit;
+        fit.complexity = (ComplexityClass) c;
+        double tf = 0.0, ff = 0.0;
+        for (unsigned i = 0; i < len; ++i) {
+            double f = complexity_term(fit.complexity, sizes[i]);
+            tf += times[i] * f;
+            ff += f * f;
+        }
+        if (ff == 0.0) continue;
+        fit.constant = tf / ff;
+        double err = 0.0;
+        for (unsigned i = 0; i < len; ++i) {
+            double diff = times[i] - fit.constant
+                        * complexity_term(fit.complexity, sizes[i]);
+            err += diff * diff;
+        }
+        fit.rms = sqrt(err / len);
+        if (mean > 0) fit.rms /= mean;
+        fits.push_back(fit);
+    }
+    stable_sort(fits.begin(), fits.end(), better_fit);
+    return fits;
+}
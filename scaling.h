@@ -0,0 +1,71 @@
+/*---------------------------------------------------------------------------*\
+ *  scaling.h                                                                *
+ *  This file contains the interface for the scaling module, which relates   *
+ *    the times measured for a family of inputs to the sizes of those        *
+ *    inputs.  It has two halves:                                            *
+ *                                                                           *
+ *  input_size() tags an input file with a size "n".  The size may be read   *
+ *    from the file's name (eg. "sort-10k.in" or "n=1000.txt"), from a       *
+ *    sidecar file holding just the number (eg. "sort.in.size"), or taken    *
+ *    to be the number of bytes in the file.                                 *
+ *  fit_complexities() fits measured times against the common complexity     *
+ *    classes, O(1) through O(n^3), by least squares.  Each fit is of the    *
+ *    form  t = c * f(n),  and the fits are returned best first, ranked by   *
+ *    their root-mean-square error relative to the mean time.               *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef SCALING_H_INCLUDED
+#define SCALING_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+enum ComplexityClass {
+    COMPLEXITY_1,
+    COMPLEXITY_LOG_N,
+    COMPLEXITY_N,
+    COMPLEXITY_N_LOG_N,
+    COMPLEXITY_N_SQUARED,
+    COMPLEXITY_N_CUBED
+};
+
+enum SizeSource {
+    SIZE_AUTO,          /* sidecar, then file name, then bytes */
+    SIZE_FROM_NAME,
+    SIZE_FROM_SIDECAR,
+    SIZE_FROM_BYTES
+};
+
+struct ComplexityFit {
+    ComplexityClass complexity;
+    double constant;
+    double rms;         /* root-mean-square error, relative to mean time */
+};
+
+/*  Returns the size of the input file _input_, found as specified by
+ *    _source_.  Sidecar files are named _input_ + _sidecar_ext_.
+ *    Returns a negative number if no size could be found.
+ */
+double input_size(std::string input, SizeSource source,
+                  std::string sidecar_ext = ".size");
+
+/*  Parses the name of a SizeSource ("auto", "name", "sidecar", "bytes").
+ *    Throws a string describing the error if the name is not recognized.
+ */
+SizeSource parse_size_source(std::string name);
+
+/*  Returns the value of f(n) for the given complexity class, and a
+ *    printable name for the class, eg. "O(n log n)".
+ */
+double complexity_term(ComplexityClass complexity, double n);
+std::string complexity_name(ComplexityClass complexity);
+
+/*  Fits _times_ against _sizes_ for every complexity class.  The vectors
+ *    must be of the same length.  The result is sorted best fit first, and
+ *    is empty if fewer than two distinct sizes were given.
+ */
+std::vector<ComplexityFit> fit_complexities(const std::vector<double> &sizes,
+                                            const std::vector<double> &times);
+
+#endif
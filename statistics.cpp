@@ -0,0 +1,170 @@
+/*---------------------------------------------------------------------------*\
+ *  statistics.cpp                                                           *
+ *  This implementation depends only on the cmath and algorithm libraries.   *
+ *  The P-squared estimator follows Jain and Chlamtac, "The P-Square         *
+ *    Algorithm for Dynamic Calculation of Quantiles and Histograms Without  *
+ *    Storing Observations" (CACM, 1985).  Marker positions are kept         *
+ *    1-based, as in the paper.                                              *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <cmath>
+#include <algorithm>
+#include "statistics.h"
+using namespace std;
+
+
+RunningStats::RunningStats()
+{
+    n = 0;
+    avg = 0.0;
+    m2 = 0.0;
+    low = 0.0;
+    high = 0.0;
+}
+
+
+void RunningStats::add(double x)
+{
+    ++n;
+    double delta = x - avg;
+    avg += delta / n;
+    m2 += delta * (x - avg);
+    if (n == 1 || x < low) low = x;
+    if (n == 1 || x > high) high = x;
+}
+
+unsigned long RunningStats::count() const
+{
+    return n;
+}
+
+double RunningStats::mean() const
+{
+    return avg;
+}
+
+/*  The sample variance; zero until there are two numbers.
+ */
+double RunningStats::variance() const
+{
+    return (n > 1) ? m2 / (n - 1) : 0.0;
+}
+
+double RunningStats::stddev() const
+{
+    return sqrt(variance());
+}
+
+double RunningStats::min() const
+{
+    return low;
+}
+
+double RunningStats::max() const
+{
+    return high;
+}
+
+
+
+P2Quantile::P2Quantile(double p)
+{
+    this->p = p;
+    n = 0;
+    for (int i = 0; i < 5; ++i) {
+        pos[i] = i + 1;
+        height[i] = 0.0;
+    }
+    desired[0] = 1;
+    desired[1] = 1 + 2 * p;
+    desired[2] = 1 + 4 * p;
+    desired[3] = 3 + 2 * p;
+    desired[4] = 5;
+    step[0] = 0;
+    step[1] = p / 2;
+    step[2] = p;
+    step[3] = (1 + p) / 2;
+    step[4] = 1;
+}
+
+
+void P2Quantile::add(double x)
+{
+    if (n < 5) {
+        height[n++] = x;
+        if (n == 5) sort(height, height + 5);
+        return;
+    }
+    ++n;
+
+    /*  Find the cell holding x, stretching the outer markers if needed.
+     */
+    int k;
+    if (x < height[0]) {
+        height[0] = x;
+        k = 0;
+    } else if (x >= height[4]) {
+        height[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= height[k + 1]) ++k;
+    }
+    for (int i = k + 1; i < 5; ++i) ++pos[i];
+    for (int i = 0; i < 5; ++i) desired[i] += step[i];
+
+    /*  Move the middle markers toward their desired positions, adjusting
+     *  their heights with the piecewise-parabolic formula where it keeps
+     *  them in order, and linearly otherwise.
+     */
+    for (int i = 1; i < 4; ++i) {
+        double d = desired[i] - pos[i];
+        if ((d >= 1 && pos[i + 1] - pos[i] > 1)
+            || (d <= -1 && pos[i - 1] - pos[i] < -1)) {
+            int dir = (d > 0) ? 1 : -1;
+            double h = parabolic(i, dir);
+            if (height[i - 1] < h && h < height[i + 1]) {
+                height[i] = h;
+            } else {
+                height[i] = linear(i, dir);
+            }
+            pos[i] += dir;
+        }
+    }
+}
+
+double P2Quantile::parabolic(int i, int d) const
+{
+    return height[i] + (double) d / (pos[i + 1] - pos[i - 1])
+        * ((pos[i] - pos[i - 1] + d) * (height[i + 1] - height[i])
+               / (pos[i + 1] - pos[i])
+           + (pos[i + 1] - pos[i] - d) * (height[i] - height[i - 1])
+               / (pos[i] - pos[i - 1]));
+}
+
+double P2Quantile::linear(int i, int d) const
+{
+    return height[i] + d * (height[i + d] - height[i]) / (pos[i + d] - pos[i]);
+}
+
+
+unsigned long P2Quantile::count() const
+{
+    return n;
+}
+
+/*  With fewer than five numbers the markers are just the numbers seen, so
+ *  the quantile is found exactly, by nearest rank.
+ */
+double P2Quantile::value() const
+{
+    if (n == 0) return 0.0;
+    if (n >= 5) return height[2];
+    double sorted[5];
+    copy(height, height + n, sorted);
+    sort(sorted, sorted + n);
+    unsigned rank = (unsigned) ceil(p * n);
+    if (rank > 0) --rank;
+    return sorted[rank];
+}
@@ -0,0 +1,63 @@
+/*---------------------------------------------------------------------------*\
+ *  statistics.h                                                             *
+ *  This file contains the interface for the statistics module, a pair of    *
+ *    classes that summarize a stream of numbers in constant memory, so that *
+ *    timings can be aggregated as they arrive rather than stored.           *
+ *                                                                           *
+ *  RunningStats keeps the count, minimum, maximum, mean, and variance of    *
+ *    every number it is given, using Welford's method for the mean and      *
+ *    variance (which avoids the cancellation of the naive sum of squares).  *
+ *  P2Quantile estimates a single quantile (eg. 0.5 for the median) with     *
+ *    the P-squared algorithm of Jain and Chlamtac, which keeps only five    *
+ *    markers.  Until five numbers have been seen, the quantile is exact.    *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef STATISTICS_H_INCLUDED
+#define STATISTICS_H_INCLUDED
+
+class RunningStats
+{
+public:
+    RunningStats();
+
+    void add(double x);
+
+    unsigned long count() const;
+    double mean() const;
+    double variance() const;
+    double stddev() const;
+    double min() const;
+    double max() const;
+
+private:
+    unsigned long n;
+    double avg;
+    double m2;
+    double low;
+    double high;
+};
+
+class P2Quantile
+{
+public:
+    P2Quantile(double p = 0.5);
+
+    void add(double x);
+
+    unsigned long count() const;
+    double value() const;
+
+private:
+    double p;
+    unsigned long n;
+    int pos[5];
+    double desired[5];
+    double step[5];
+    double height[5];
+
+    double parabolic(int i, int d) const;
+    double linear(int i, int d) const;
+};
+
+#endif
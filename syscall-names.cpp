@@ -0,0 +1,41 @@
+/*---------------------------------------------------------------------------*\
+ *  syscall-names.cpp                                                        *
+ *  This implementation builds a map from the generated table the first      *
+ *    time a name is asked for.                                              *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <map>
+#include <sys/syscall.h>
+#include <boost/lexical_cast.hpp>
+#include "syscall-names.h"
+using namespace std;
+
+struct SyscallEntry {
+    long number;
+    const char *name;
+};
+
+static const SyscallEntry syscall_table[] = {
+#include "syscall-table.h"
+};
+
+
+static map<long, string> make_names()
+{
+    map<long, string> r_val;
+    unsigned count = sizeof(syscall_table) / sizeof(syscall_table[0]);
+    for (unsigned i = 0; i < count; ++i) {
+        r_val.insert(make_pair(syscall_table[i].number,
+                               string(syscall_table[i].name)));
+    }
+    return r_val;
+}
+
+string syscall_name(long number)
+{
+    static const map<long, string> names = make_names();
+    map<long, string>::const_iterator found = names.find(number);
+    if (found != names.end()) return found->second;
+    return "syscall_" + boost::lexical_cast<string>(number);
+}
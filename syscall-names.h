@@ -0,0 +1,22 @@
+/*---------------------------------------------------------------------------*\
+ *  syscall-names.h                                                          *
+ *  This file contains the interface for the syscall-names module, which     *
+ *    names system calls by their numbers on the machine it was built for.   *
+ *                                                                           *
+ *  The names come from the __NR_ constants of <sys/syscall.h>, which the    *
+ *    Makefile lists in syscall-table.h, so that every call the C library's  *
+ *    headers know of is named without a table kept by hand.                 *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef SYSCALL_NAMES_H_INCLUDED
+#define SYSCALL_NAMES_H_INCLUDED
+
+#include <string>
+
+/*  Returns the name of system call _number_ (eg. "read"), or, for a number
+ *    the headers do not know, "syscall_<number>".
+ */
+std::string syscall_name(long number);
+
+#endif
@@ -140,6 +140,15 @@ string Tester::run_verbosely()
     return succ;
 }
 
+string Tester::settings() const
+{
+    return string("spaces=") + (ignore_spaces ? "1" : "0")
+        + " extras=" + (ignore_extras ? "1" : "0")
+        + " truncation=" + (ignore_truncation ? "1" : "0")
+        + " ignore=" + chars_to_ignore;
+}
+
+
 /* Function under consideration.
  *   If implemented, it would work very much like a diff of the files.
  * Of course, it's not a huge priority, as users can always call diff
@@ -21,6 +21,8 @@
  *     and what was recieved.  If the files matched, the empty string is     *
  *     returned, unless print_on_success was set, in which case a string     *
  *     with a success message is returned.                                   *
+ *  Tester::settings() describes the options set, in a form that changes     *
+ *     whenever they would change the result of a comparison.                *
  *                                                                           *
  *  TO DO:                                                                   *
 \*---------------------------------------------------------------------------*/
@@ -38,6 +40,7 @@ public:
 
     bool run();
     std::string run_verbosely();
+    std::string settings() const;
 
     Tester &set_benchmark_file(std::string filename);
     Tester &set_comparison_file(std::string filename);
@@ -0,0 +1,162 @@
+/*---------------------------------------------------------------------------*\
+ *  async-driver.cpp                                                         *
+ *  This file drives Evaluator::evaluate_async() and ProcessLoop for         *
+ *    tests/async.sh, which has no other way in to them.  Each mode exits    *
+ *    with status 0 if it behaved, and otherwise prints why and exits 1.     *
+ *      evaluate <dir>  evaluates passing and failing tests in the           *
+ *                      background, copying failed outputs to a directory    *
+ *                      that does not exist, with an observer that throws    *
+ *                      at the end of one test, and checks that every        *
+ *                      future is ready.                                     *
+ *      stop            destroys a loop while runs are going, waiting, and   *
+ *                      being submitted by the callbacks of others.          *
+ *      exit <dir>      returns from main() with background tests still      *
+ *                      running on the shared loop.                          *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include "../evaluator.h"
+#include "../process-loop.h"
+using namespace std;
+
+
+/*  How long a future may take before the test is taken to have hung.
+ */
+static const chrono::seconds PATIENCE(10);
+
+/*  Throws at the end of the test on input _input_.
+ */
+class ThrowingObserver : public EvaluationObserver
+{
+public:
+    ThrowingObserver(string input) : input(input) {}
+
+    void on_test_end(const TestOutcome &test)
+    {
+        if (test.input_file == input) throw string("observer failed");
+    }
+
+private:
+    string input;
+};
+
+
+static void write_file(string name, string text)
+{
+    ofstream(name.c_str()) << text;
+}
+
+static int fail(string why)
+{
+    cout << why << endl;
+    return 1;
+}
+
+
+static int evaluate_in(string dir)
+{
+    Evaluator ev;
+    ev.set_program("/bin/cat").set_repetitions(3).check_all_runs();
+    ev.set_copy_directory(dir + "/missing").save_failed_outputs();
+    for (unsigned i = 0; i < 4; ++i) {
+        string in = dir + "/" + to_string(i) + ".in";
+        string out = dir + "/" + to_string(i) + ".out";
+        write_file(in, to_string(i) + "\n");
+        write_file(out, (i == 1) ? string("wrong\n") : to_string(i) + "\n");
+        ev.add_input_and_output(in, out);
+    }
+    ThrowingObserver thrower(dir + "/2.in");
+    ev.add_observer(&thrower);
+    vector< future<TestOutcome> > outcomes = ev.evaluate_async();
+    for (unsigned i = 0; i < outcomes.size(); ++i) {
+        if (outcomes[i].wait_for(PATIENCE) != future_status::ready) {
+            return fail("test " + to_string(i) + " never ended");
+        }
+        TestOutcome outcome;
+        try {
+            outcome = outcomes[i].get();
+        } catch (string err) {
+            if (i == 2 && err == "observer failed") continue;
+            return fail("test " + to_string(i) + " threw " + err);
+        }
+        if (i == 2) return fail("the observer's exception was lost");
+        if (outcome.verdict != (i == 1 ? 0 : 1)) {
+            return fail("test " + to_string(i) + " got the wrong verdict");
+        }
+        if ((i == 1) != !outcome.errors.empty()) {
+            return fail("test " + to_string(i) + " has the wrong errors");
+        }
+    }
+    return 0;
+}
+
+
+static int stop()
+{
+    atomic<unsigned> called(0);
+    chrono::steady_clock::time_point begun = chrono::steady_clock::now();
+    {
+        ProcessLoop loop;
+        loop.set_max_running(1);
+        vector<string> argv;
+        argv.push_back("sleep");
+        argv.push_back("30");
+        ProcessOptions options;
+        for (unsigned i = 0; i < 3; ++i) {
+            loop.submit("/bin/sleep", argv, "", "", "", options,
+                        [&loop, &called, argv, options]
+                        (const ProcessResult &) {
+                            ++called;
+                            loop.submit("/bin/sleep", argv, "", "", "",
+                                        options,
+                                        [&called](const ProcessResult &run) {
+                                            if (!run.ran) ++called;
+                                        });
+                        });
+        }
+        this_thread::sleep_for(chrono::milliseconds(200));
+    }
+    if (chrono::steady_clock::now() - begun > PATIENCE) {
+        return fail("stopping the loop waited for its runs");
+    }
+    if (called != 6) {
+        return fail(to_string(called) + " of 6 callbacks were called");
+    }
+    return 0;
+}
+
+
+static int exit_in(string dir)
+{
+    static Evaluator ev;
+    ev.set_program("/bin/sleep").set_repetitions(3).check_no_runs();
+    vector<string> args(1, "30");
+    ev.set_args(args);
+    for (unsigned i = 0; i < 4; ++i) {
+        string in = dir + "/" + to_string(i) + ".in";
+        write_file(in, "");
+        ev.add_input_and_output(in, "");
+    }
+    static vector< future<TestOutcome> > outcomes;
+    outcomes = ev.evaluate_async();
+    this_thread::sleep_for(chrono::milliseconds(200));
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    string mode = (argc > 1) ? argv[1] : "";
+    if (mode == "evaluate" && argc == 3) return evaluate_in(argv[2]);
+    if (mode == "stop") return stop();
+    if (mode == "exit" && argc == 3) return exit_in(argv[2]);
+    cerr << "usage: " << argv[0] << " evaluate DIR | stop | exit DIR"
+         << endl;
+    return 2;
+}
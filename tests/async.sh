@@ -0,0 +1,15 @@
+#!/bin/sh
+# Background evaluation ends every test, even one whose observer throws or
+# whose output cannot be copied, and a process loop stops without waiting
+# for its runs, whether destroyed directly or at exit.
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+for mode in "evaluate $dir" stop "exit $dir"; do
+    if ! timeout 20 "$ASYNC_DRIVER" $mode > "$dir/log" 2>&1; then
+        echo "${mode%% *} failed:"
+        cat "$dir/log"
+        exit 1
+    fi
+done
@@ -0,0 +1,21 @@
+#!/bin/sh
+# An output that cannot be copied is reported as an error of its test, and
+# the remaining tests are still run.
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+mkdir -p "$dir/in" "$dir/out"
+for i in 1 2; do
+    printf '%s\n' $i > "$dir/in/$i.in"
+    printf 'x\n' > "$dir/out/$i.out"
+done
+
+cd "$dir" || exit 1
+"$EVALUATE" -d in -D out -e .in -E .out -s --copy-dir missing/dir /bin/cat \
+    > log 2>&1
+if [ "$(grep -c 'could not copy the output' log)" -ne 2 ] \
+    || ! grep -q "Passed (0/2)" log; then
+    echo "copy failure not reported:"
+    cat log
+    exit 1
+fi
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Tests found in directories are named by their paths joined to those
+# directories, and a file named just the suffix is not taken for a test.
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+mkdir -p "$dir/in/sub" "$dir/out/sub"
+printf '1\n' > "$dir/in/a.in"
+printf '1\n' > "$dir/out/a.out"
+printf '2\n' > "$dir/in/sub/b.in"
+printf '2\n' > "$dir/out/sub/b.out"
+printf 'x\n' > "$dir/in/.in"
+printf 'y\n' > "$dir/out/.out"
+
+cd "$dir" || exit 1
+"$EVALUATE" -d in/ -D out/ -e .in -E .out --recursive -s /bin/cat \
+    > log 2>&1
+status=$?
+if [ $status -ne 0 ] || ! grep -q "Passed (2/2)" log; then
+    echo "exit status $status:"
+    cat log
+    exit 1
+fi
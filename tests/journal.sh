@@ -0,0 +1,35 @@
+#!/bin/sh
+# A journal cut short in the middle of a line can still be resumed, the
+# runs taken from it are written to --results as well, and a journal made
+# with other arguments is not resumed at all.
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+mkdir -p "$dir/in" "$dir/out"
+for i in 1 2 3; do
+    printf '%s\n' $i > "$dir/in/$i.in"
+    printf '%s\n' $i > "$dir/out/$i.out"
+done
+
+fail() {
+    echo "$1:"
+    cat log
+    exit 1
+}
+
+cd "$dir" || exit 1
+"$EVALUATE" -d in -D out -e .in -E .out -s --journal journal /bin/cat \
+    > log 2>&1 || fail "first run failed"
+printf 'run\tin/4.in\tout/4.o' >> journal
+
+"$EVALUATE" -d in -D out -e .in -E .out -s --journal journal --resume \
+    --results results /bin/cat > log 2>&1 || fail "resuming failed"
+grep -q "Passed (3/3)" log || fail "resuming did not pass every test"
+[ "$(grep -c '^run' results)" -eq 3 ] || fail "replayed runs not in results"
+[ "$(grep -c '^verdict' results)" -eq 3 ] || fail "verdicts not in results"
+grep -q 'out/4.o' journal && fail "partial line left in the journal"
+
+"$EVALUATE" -d in -D out -e .in -E .out -s --journal journal --resume \
+    /bin/cat -- -u > log 2>&1 && fail "resumed with different arguments"
+grep -q "cannot resume" log || fail "no reason given for not resuming"
+exit 0
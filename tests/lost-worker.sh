@@ -0,0 +1,42 @@
+#!/bin/sh
+# A job lost with its worker is run again: by the same worker once the
+# connection is made again, or by another if that worker is gone for good.
+
+dir=$(mktemp -d) || exit 1
+pids=
+trap 'kill $pids 2> /dev/null; rm -rf "$dir"' EXIT
+mkdir "$dir/in" "$dir/out"
+for n in 1 2 3 4 5 6; do
+    printf '%s\n' $n > "$dir/in/$n.in"
+    printf '%s\n' $n > "$dir/out/$n.out"
+done
+printf '#!/bin/sh\nsleep 0.3\nexec cat\n' > "$dir/slow.sh"
+chmod +x "$dir/slow.sh"
+cd "$dir" || exit 1
+
+"$EVALUATE" --worker --listen "$dir/a.sock" 2> /dev/null &
+a=$!
+"$EVALUATE" --worker --listen "$dir/b.sock" 2> /dev/null &
+b=$!
+pids="$a $b"
+sleep 0.5
+
+# The connection to worker a is lost mid-job, but a can be reached again.
+(sleep 0.4; pkill -KILL -P $a) &
+"$EVALUATE" -d in -D out -e .in -E .out -s --connect "$dir/a.sock" \
+    ./slow.sh > one.log 2>&1
+if ! grep -q "Passed (6/6)" one.log; then
+    echo "one worker, connection lost:"
+    cat one.log
+    exit 1
+fi
+
+# Worker a is killed outright mid-run, so b must run a's jobs.
+(sleep 0.4; pkill -KILL -P $a; kill -KILL $a) &
+"$EVALUATE" -d in -D out -e .in -E .out -s --connect "$dir/a.sock" \
+    --connect "$dir/b.sock" ./slow.sh > two.log 2>&1
+if ! grep -q "Passed (6/6)" two.log; then
+    echo "two workers, one killed:"
+    cat two.log
+    exit 1
+fi
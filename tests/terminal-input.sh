@@ -0,0 +1,20 @@
+#!/bin/sh
+# A test reading the harness's standard input from a terminal must be given
+# the terminal, rather than being stopped by SIGTTIN in its own process group.
+# Runs the harness under a pseudo-terminal made by script(1).
+
+command -v script > /dev/null || { echo "skipped: no script(1)"; exit 0; }
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+printf 'hello\n' > "$dir/expected"
+
+(sleep 1; printf 'hello\n'; sleep 0.5; printf '\004') \
+    | timeout 10 script -qec \
+        "'$EVALUATE' /bin/cat -f -- -F '$dir/expected' -s" /dev/null \
+    > "$dir/log" 2>&1
+status=$?
+if [ $status -ne 0 ] || ! grep -q "Passed (1/1)" "$dir/log"; then
+    echo "exit status $status:"
+    cat "$dir/log"
+    exit 1
+fi
@@ -7,13 +7,22 @@
 \*---------------------------------------------------------------------------*/
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include "timer.h"
+#include "scaling.h"
 using namespace std;
 
 
 Timer::Timer()
 {
     report_all();
+    report_stats = false;
+    report_mem = false;
+    histogram = HISTOGRAM_NONE;
+    subtract = false;
     before_decimal = 3;
     after_decimal = 4;
     spaces = 4;
@@ -51,7 +60,7 @@ static unsigned num_digits(unsigned x)
 }
 
 
-void Timer::report_run(ProgramInfo result)
+void Timer::report_run(const ProgramInfo &result)
 {
         (*output) << "Real:   ";
         (*output) << get_real(result);
@@ -63,7 +72,7 @@ void Timer::report_run(ProgramInfo result)
 }
 
 
-double Timer::print_line(const TimeSet times, int start, int end,
+double Timer::print_line(const TimeSet &times, int start, int end,
                          string seperator, string final,
                          double (*get_num)(ProgramInfo))
 {
@@ -71,7 +80,7 @@ double Timer::print_line(const TimeSet times, int start, int end,
     string btwn = "";
     double sum = 0.0;
     for (int i = start; i < end && i < size; ++i) {
-        double t = get_num(times.runs[i]);
+        double t = correct(get_num(times.runs[i]), get_num);
         if (report_all_times) {
             (*output) << btwn << setw(before_decimal + 1 + after_decimal)
                       << std::right << t;
@@ -95,18 +104,20 @@ string Timer::repeat_char(char c, int times)
     return r_val;
 }
 
-void Timer::report_time(const TimeSet results)
+void Timer::report_time(const TimeSet &results)
 {
+    (*output).setf(ios::fixed);
+    (*output).precision(after_decimal);
     verify_dimensions(results.runs.size());
     if (report_all_times) {
         report_runs(results);
-    } else if (report_avg) {
+    } else if (report_avg || report_stats) {
         report_avg_alone(results);
     }
 }
 
 
-void Timer::report_runs(const TimeSet results)
+void Timer::report_runs(const TimeSet &results)
 {
     unsigned size = results.runs.size();
     if (size == 0) return;
@@ -161,47 +172,363 @@ void Timer::report_runs(const TimeSet results)
         (*output) << endl;
         current_column += columns;
     }
+    if (report_stats) {
+        (*output) << endl;
+        report_summary(results);
+    }
+    if (report_mem) report_memory_line(results);
+    report_io_line(results);
+    report_memory_timeline(results);
+    if (histogram != HISTOGRAM_NONE) report_histogram(results);
+    report_hot_functions(results);
+    report_syscalls(results);
     (*output) << after << endl;
 }
 
 
-static double average(const TimeSet times, double (*get_num)(ProgramInfo))
+/*  Returns the summary of one time in a TimeSet.  Sets filled through
+ *  add_run() already hold it; for sets whose runs were pushed directly, it
+ *  is built from the runs.
+ */
+static MetricSummary summarize(const TimeSet &times,
+                               const MetricSummary &stored,
+                               double (*get_num)(ProgramInfo))
 {
-    int size = times.runs.size();
-    double sum = 0.0;
-    for (int i = 0; i < size; ++i) {
-        sum += get_num(times.runs[i]);
+    if (stored.stats.count() >= times.runs.size()) return stored;
+    MetricSummary r_val;
+    unsigned size = times.runs.size();
+    for (unsigned i = 0; i < size; ++i) {
+        r_val.add(get_num(times.runs[i]));
     }
-    return sum / size;
+    return r_val;
 }
 
-void Timer::report_avg_alone(const TimeSet results)
+static unsigned long run_count(const TimeSet &times)
 {
-    unsigned size = results.runs.size();
-    if (size == 0) return;
+    unsigned long stored = times.real.stats.count();
+    return (stored > times.runs.size()) ? stored : times.runs.size();
+}
+
+static long timeline_peak(const MemoryTimeline &timeline)
+{
+    if (timeline.points.empty()) return -1;
+    return *max_element(timeline.points.begin(), timeline.points.end());
+}
+
+
+/*  An input size is unknown (negative) until one is measured, as scaling
+ *  would take zero for a real size.
+ */
+TimeSet::TimeSet()
+{
+    memory_timeline.interval = 0;
+    memory_timeline_run = 0;
+    input_size = -1;
+}
+
+
+void add_run(TimeSet &set, const ProgramInfo &run, bool keep_raw)
+{
+    set.real.add(get_real(run));
+    set.user.add(get_user(run));
+    set.sys.add(get_sys(run));
+    set.memory.add(run.max_rss_kb);
+    set.io.add(run.io);
+    if (timeline_peak(run.memory_timeline)
+        > timeline_peak(set.memory_timeline)) {
+        set.memory_timeline = run.memory_timeline;
+        set.memory_timeline_run = set.real.stats.count() - 1;
+    }
+    if (keep_raw) set.runs.push_back(run);
+}
+
+void IoSummary::add(const IoUsage &io)
+{
+    if (io.rchar < 0) return;
+    rchar.add(io.rchar);
+    wchar.add(io.wchar);
+    read_bytes.add(io.read_bytes);
+    write_bytes.add(io.write_bytes);
+    syscr.add(io.syscr);
+    syscw.add(io.syscw);
+}
+
+
+void Timer::report_avg_alone(const TimeSet &results)
+{
+    if (run_count(results) == 0) return;
 
     (*output) << before;
     (*output) << make_header(results) << endl;
+    report_summary(results);
+    if (report_mem) report_memory_line(results);
+    report_io_line(results);
+    report_memory_timeline(results);
+    if (histogram != HISTOGRAM_NONE) report_histogram(results);
+    report_hot_functions(results);
+    report_syscalls(results);
+    (*output) << after << endl;
+}
+
+/*  Prints the average of each time, followed by its standard deviation,
+ *  median, and 90th percentile when statistics are requested.
+ */
+void Timer::report_summary(const TimeSet &results)
+{
+    unsigned num_width = before_decimal + 1 + after_decimal;
+    string between = repeat_char(' ', spaces);
+    MetricSummary sums[3] = { summarize(results, results.real, get_real),
+                              summarize(results, results.user, get_user),
+                              summarize(results, results.sys, get_sys) };
+    const char *labels[3] = { "Real:   ", "User:   ", "System: " };
+    double (*getters[3])(ProgramInfo) = { get_real, get_user, get_sys };
+
     (*output) << repeat_char(' ', 8);
-    (*output) << "  AVG" << endl;
-    (*output) << "Real:   ";
-    (*output) << setw(before_decimal + 1 + after_decimal)
-              << std::right << average(results, get_real) << "s";
-    (*output) << endl << "User:   ";
-    (*output) << setw(before_decimal + 1 + after_decimal)
-              << std::right << average(results, get_user) << "s";
-    (*output) << endl << "System: ";
-    (*output) << setw(before_decimal + 1 + after_decimal)
-              << std::right << average(results, get_sys) << "s";
-    (*output) << endl << after << endl;
+    if (report_stats) {
+        (*output) << setw(num_width) << std::right << "AVG" << " "
+                  << between << setw(num_width) << "STDEV" << " "
+                  << between << setw(num_width) << "MEDIAN" << " "
+                  << between << setw(num_width) << "P90";
+    } else {
+        (*output) << "  AVG";
+    }
+    (*output) << endl;
+    for (unsigned i = 0; i < 3; ++i) {
+        (*output) << labels[i];
+        (*output) << setw(num_width) << std::right
+                  << correct(sums[i].stats.mean(), getters[i]) << "s";
+        if (report_stats) {
+            (*output) << between << setw(num_width) << std::right
+                      << sums[i].stats.stddev() << "s"
+                      << between << setw(num_width) << std::right
+                      << correct(sums[i].median.value(), getters[i]) << "s"
+                      << between << setw(num_width) << std::right
+                      << correct(sums[i].p90.value(), getters[i]) << "s";
+        }
+        (*output) << endl;
+    }
+}
+
+static double get_memory(ProgramInfo p)
+{
+    return (double) p.max_rss_kb;
+}
+
+void Timer::report_memory_line(const TimeSet &results)
+{
+    MetricSummary memory = summarize(results, results.memory, get_memory);
+    if (memory.stats.count() == 0) return;
+    (*output) << "Memory: peak " << (long) memory.stats.max()
+              << " KB, average " << (long) memory.stats.mean() << " KB"
+              << endl;
+}
+
+
+static string byte_string(double bytes)
+{
+    static const char *units[] = { "B", "KB", "MB", "GB", "TB" };
+    unsigned unit = 0;
+    while (bytes >= 1024 && unit < 4) {
+        bytes /= 1024;
+        ++unit;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), unit ? "%.1f %s" : "%.0f %s", bytes,
+             units[unit]);
+    return buffer;
+}
+
+/*  Gives the average I/O of a run, if it was measured, as the bytes and
+ *  calls of reading and writing, with the part of each that reached
+ *  storage.
+ */
+void Timer::report_io_line(const TimeSet &results)
+{
+    IoSummary io = results.io;
+    if (io.rchar.count() < results.runs.size()) {
+        io = IoSummary();
+        for (unsigned i = 0; i < results.runs.size(); ++i) {
+            io.add(results.runs[i].io);
+        }
+    }
+    if (io.rchar.count() == 0) return;
+    (*output) << "I/O: read " << byte_string(io.rchar.mean()) << " in "
+              << (long) (io.syscr.mean() + 0.5) << " calls ("
+              << byte_string(io.read_bytes.mean()) << " from storage), wrote "
+              << byte_string(io.wchar.mean()) << " in "
+              << (long) (io.syscw.mean() + 0.5) << " calls ("
+              << byte_string(io.write_bytes.mean()) << " to storage)"
+              << endl;
+}
+
+
+/*  Lists the functions a profiled test was most often found running in,
+ *  each with the share of the samples it was found in.
+ */
+void Timer::report_hot_functions(const TimeSet &results)
+{
+    if (results.hot_functions.empty()) return;
+    (*output) << "Hot functions:" << endl;
+    for (unsigned i = 0; i < results.hot_functions.size(); ++i) {
+        char share[16];
+        snprintf(share, sizeof(share), "%6.1f%%",
+                 results.hot_functions[i].second * 100);
+        (*output) << share << "  " << results.hot_functions[i].first << endl;
+    }
+}
+
+
+/*  Lists the system calls a traced run of the test made most often, with
+ *  how many times it made each.
+ */
+void Timer::report_syscalls(const TimeSet &results)
+{
+    static const unsigned shown = 10;
+    if (results.syscalls.empty()) return;
+    vector< pair<unsigned long, string> > counts;
+    unsigned long total = 0;
+    map<string, unsigned long>::const_iterator it;
+    for (it = results.syscalls.begin(); it != results.syscalls.end(); ++it) {
+        counts.push_back(make_pair(it->second, it->first));
+        total += it->second;
+    }
+    sort(counts.begin(), counts.end(),
+         [](const pair<unsigned long, string> &a,
+            const pair<unsigned long, string> &b) {
+             return a.first > b.first
+                    || (a.first == b.first && a.second < b.second);
+         });
+    (*output) << "System calls (" << total << " in one traced run):" << endl;
+    for (unsigned i = 0; i < counts.size() && i < shown; ++i) {
+        (*output) << setw(10) << std::right << counts[i].first << "  "
+                  << counts[i].second << endl;
+    }
 }
 
-void Timer::report_times(const vector<TimeSet> all_results)
+
+/*  Shades, from fewest to most runs, used to draw one bucket of a histogram.
+ *  Any bucket holding a run is drawn with at least the second shade.
+ */
+static const string SHADES = " .:-=+*#%@";
+
+/*  Returns a string of _buckets_ characters, each shaded by how many of
+ *  _values_ fall into the corresponding part of the range [low, high].
+ *  When log_scale is set, the range is divided evenly by ratio rather than
+ *  by difference, which spreads out heavy-tailed times.
+ */
+string Timer::sparkline(const vector<double> &values, unsigned buckets,
+                        double low, double high, bool log_scale)
+{
+    vector<unsigned> counts(buckets, 0);
+    unsigned most = 0;
+    double from = log_scale ? log(low) : low;
+    double to = log_scale ? log(high) : high;
+    unsigned size = values.size();
+    for (unsigned i = 0; i < size; ++i) {
+        double x = log_scale ? log(values[i]) : values[i];
+        unsigned b = (to > from)
+                   ? (unsigned) ((x - from) / (to - from) * buckets) : 0;
+        if (b >= buckets) b = buckets - 1;
+        if (++counts[b] > most) most = counts[b];
+    }
+    string r_val;
+    unsigned levels = SHADES.length() - 1;
+    for (unsigned b = 0; b < buckets; ++b) {
+        unsigned shade = 0;
+        if (counts[b] > 0) {
+            shade = (counts[b] * levels + most - 1) / most;
+        }
+        r_val += SHADES[shade];
+    }
+    return r_val;
+}
+
+/*  Draws each time as a line of the form
+ *      Real:   |  .:@#:.     .:=.  |  0.0031s..0.0390s
+ *  The number of buckets is limited by the line width, and by the number of
+ *  runs, since a histogram much wider than its runs is mostly blank.
+ */
+void Timer::report_histogram(const TimeSet &results)
+{
+    unsigned size = results.runs.size();
+    if (size == 0) return;
+    unsigned num_width = before_decimal + 1 + after_decimal;
+    unsigned range_width = 2 * num_width + 10;
+    if (width < 8 + 2 + range_width + 1) return;
+    unsigned buckets = width - (8 + 2 + range_width);
+    if (buckets > 4 * size && 4 * size >= 10) buckets = 4 * size;
+    const char *labels[3] = { "Real:   ", "User:   ", "System: " };
+    double (*getters[3])(ProgramInfo) = { get_real, get_user, get_sys };
+
+    (*output) << endl;
+    for (unsigned m = 0; m < 3; ++m) {
+        vector<double> values;
+        for (unsigned i = 0; i < size; ++i) {
+            values.push_back(correct(getters[m](results.runs[i]),
+                                     getters[m]));
+        }
+        double low = *min_element(values.begin(), values.end());
+        double high = *max_element(values.begin(), values.end());
+        bool log_scale = histogram == HISTOGRAM_LOG
+                      || (histogram == HISTOGRAM_AUTO && high >= 10 * low);
+        if (low <= 0) log_scale = false;
+        (*output) << labels[m] << "|"
+                  << sparkline(values, buckets, low, high, log_scale)
+                  << "|  " << low << "s.." << high << "s"
+                  << (log_scale ? " log" : "") << endl;
+    }
+}
+
+/*  Draws the memory of the run that peaked highest as a line of the form
+ *      RSS:    |..::--==++**##%%@@@@@@@@@|  1.2 MB..45.0 MB in 2.300s, run 3
+ *  where each column is the highest point in its part of the run, shaded
+ *  from the lowest point to the highest.
+ */
+void Timer::report_memory_timeline(const TimeSet &results)
+{
+    MemoryTimeline timeline = results.memory_timeline;
+    unsigned run = results.memory_timeline_run;
+    if (timeline.points.empty()) {
+        for (unsigned i = 0; i < results.runs.size(); ++i) {
+            const MemoryTimeline &next = results.runs[i].memory_timeline;
+            if (timeline_peak(next) > timeline_peak(timeline)) {
+                timeline = next;
+                run = i;
+            }
+        }
+    }
+    const vector<long> &points = timeline.points;
+    if (points.empty()) return;
+    unsigned range_width = 40;
+    if (width < 8 + 2 + range_width + 1) return;
+    unsigned columns = min<unsigned>(width - (8 + 2 + range_width),
+                                     points.size());
+    long low = *min_element(points.begin(), points.end());
+    long high = *max_element(points.begin(), points.end());
+    unsigned levels = SHADES.length() - 1;
+    string line;
+    for (unsigned c = 0; c < columns; ++c) {
+        unsigned from = c * points.size() / columns;
+        unsigned to = (c + 1) * points.size() / columns;
+        long value = *max_element(points.begin() + from, points.begin() + to);
+        unsigned shade = levels;
+        if (high > low) {
+            shade = 1 + (value - low) * (levels - 1) / (high - low);
+        }
+        line += SHADES[shade];
+    }
+    char duration[32];
+    snprintf(duration, sizeof(duration), "%.3fs",
+             timeline.interval * points.size());
+    (*output) << "RSS:    |" << line << "|  " << byte_string(low * 1024.0)
+              << ".." << byte_string(high * 1024.0) << " in " << duration
+              << ", run " << run << endl;
+}
+
+void Timer::report_times(const vector<TimeSet> &all_results)
 {
     vector<TimeSet>::const_iterator it = all_results.begin();
     vector<TimeSet>::const_iterator end = all_results.end();
-    (*output).setf(ios::fixed);
-    (*output).precision(after_decimal);
     while (it != end) {
         report_time(*it);
         ++it;
@@ -209,6 +536,354 @@ void Timer::report_times(const vector<TimeSet> all_results)
 }
 
 
+static bool smaller_input(const pair<double, double> &a,
+                          const pair<double, double> &b)
+{
+    return a.first < b.first;
+}
+
+/*  Each TimeSet with a known size contributes one point, its average real
+ *  time.  Sets without a size (eg. tests run on stdin) are left out.
+ */
+void Timer::report_scaling(const vector<TimeSet> &all_results,
+                           double predict_n)
+{
+    vector< pair<double, double> > points;
+    vector<TimeSet>::const_iterator it = all_results.begin();
+    for ( ; it != all_results.end(); ++it) {
+        if (it->input_size < 0 || run_count(*it) == 0) continue;
+        double mean = summarize(*it, it->real, get_real).stats.mean();
+        points.push_back(make_pair(it->input_size,
+                                   correct(mean, get_real)));
+    }
+    sort(points.begin(), points.end(), smaller_input);
+    vector<double> sizes, times;
+    for (unsigned i = 0; i < points.size(); ++i) {
+        sizes.push_back(points[i].first);
+        times.push_back(points[i].second);
+    }
+
+    unsigned num_width = before_decimal + 1 + after_decimal;
+    (*output).setf(ios::fixed);
+    (*output).precision(after_decimal);
+    (*output) << before << "Scaling of real time with input size" << endl;
+    (*output) << setw(14) << std::right << "n" << repeat_char(' ', spaces)
+              << setw(num_width) << std::right << "AVG" << endl;
+    for (unsigned i = 0; i < points.size(); ++i) {
+        (*output) << setw(14) << std::right << setprecision(0) << sizes[i]
+                  << setprecision(after_decimal) << repeat_char(' ', spaces)
+                  << setw(num_width) << std::right << times[i] << "s" << endl;
+    }
+
+    vector<ComplexityFit> fits = fit_complexities(sizes, times);
+    if (fits.empty()) {
+        (*output) << "Not enough distinct input sizes to fit a complexity"
+                  << endl << after << endl;
+        return;
+    }
+    (*output) << endl;
+    for (unsigned i = 0; i < fits.size(); ++i) {
+        (*output) << (i == 0 ? "Best:   " : "        ")
+                  << setw(12) << std::left
+                  << complexity_name(fits[i].complexity) << std::right
+                  << "c = " << scientific << setprecision(3)
+                  << fits[i].constant << "s"
+                  << fixed << setprecision(1)
+                  << "   rms error " << 100.0 * fits[i].rms << "%" << endl;
+    }
+    (*output).precision(after_decimal);
+    if (predict_n > 0) {
+        (*output) << "Predicted real time at n = " << setprecision(0)
+                  << predict_n << setprecision(after_decimal) << ": "
+                  << fits[0].constant
+                     * complexity_term(fits[0].complexity, predict_n)
+                  << "s" << endl;
+    }
+    (*output) << after << endl;
+}
+
+
+/*  Only tests found in both sets are shown, and nothing at all if there are
+ *  none.  The change is relative to the previous time.
+ */
+void Timer::report_comparison(const vector<TimeSet> &previous,
+                              const vector<TimeSet> &latest)
+{
+    vector<string> names;
+    vector< pair<double, double> > times;
+    vector<TimeSet>::const_iterator now = latest.begin();
+    for ( ; now != latest.end(); ++now) {
+        if (run_count(*now) == 0) continue;
+        vector<TimeSet>::const_iterator then = previous.begin();
+        while (then != previous.end()
+               && (then->input_file != now->input_file
+                   || then->output_file != now->output_file)) {
+            ++then;
+        }
+        if (then == previous.end() || run_count(*then) == 0) continue;
+        names.push_back((now->test_name != "") ? now->test_name
+                        : now->output_file);
+        times.push_back(make_pair(
+            correct(summarize(*then, then->real, get_real).stats.mean(),
+                    get_real),
+            correct(summarize(*now, now->real, get_real).stats.mean(),
+                    get_real)));
+    }
+    if (names.empty()) return;
+
+    unsigned num_width = before_decimal + 2 + after_decimal;
+    (*output).setf(ios::fixed);
+    (*output).precision(after_decimal);
+    (*output) << before << "Average real time, previous and latest" << endl;
+    (*output) << setw(20) << std::left << "" << std::right
+              << repeat_char(' ', spaces) << setw(num_width) << "PREVIOUS"
+              << repeat_char(' ', spaces) << setw(num_width) << "LATEST"
+              << repeat_char(' ', spaces) << setw(8) << "CHANGE" << endl;
+    for (unsigned i = 0; i < names.size(); ++i) {
+        double old_time = times[i].first, new_time = times[i].second;
+        (*output) << setw(20) << std::left << names[i] << std::right
+                  << repeat_char(' ', spaces) << setw(num_width - 1)
+                  << old_time << "s" << repeat_char(' ', spaces)
+                  << setw(num_width - 1) << new_time << "s"
+                  << repeat_char(' ', spaces) << setw(7) << setprecision(1);
+        if (old_time > 0) {
+            (*output) << 100.0 * (new_time - old_time) / old_time << "%";
+        } else {
+            (*output) << "-" << " ";
+        }
+        (*output) << setprecision(after_decimal) << endl;
+    }
+    (*output) << after << endl;
+}
+
+
+/*  Returns the values as numbers, or nothing if any of them is not a
+ *  positive number.
+ */
+static vector<double> sweep_numbers(const vector<string> &values)
+{
+    vector<double> r_val;
+    for (unsigned i = 0; i < values.size(); ++i) {
+        char *end;
+        double x = strtod(values[i].c_str(), &end);
+        if (values[i] == "" || *end != '\0' || x <= 0) return vector<double>();
+        r_val.push_back(x);
+    }
+    return r_val;
+}
+
+/*  Finds the tests run in any of the passes, by their input and output
+ *  files, in the order they were first run, with the names to show them by.
+ */
+static void match_tests(const vector< vector<TimeSet> > &passes,
+                        vector< pair<string, string> > &keys,
+                        vector<string> &names)
+{
+    for (unsigned p = 0; p < passes.size(); ++p) {
+        for (unsigned t = 0; t < passes[p].size(); ++t) {
+            const TimeSet &set = passes[p][t];
+            pair<string, string> key(set.input_file, set.output_file);
+            if (run_count(set) == 0
+                || find(keys.begin(), keys.end(), key) != keys.end()) {
+                continue;
+            }
+            keys.push_back(key);
+            names.push_back((set.test_name != "") ? set.test_name
+                            : set.output_file);
+        }
+    }
+}
+
+/*  Returns the TimeSet of the test in the pass, or NULL if it has no runs
+ *  there.
+ */
+static const TimeSet *find_test(const vector<TimeSet> &pass,
+                                const pair<string, string> &key)
+{
+    for (unsigned t = 0; t < pass.size(); ++t) {
+        if (pass[t].input_file == key.first
+            && pass[t].output_file == key.second
+            && run_count(pass[t]) != 0) {
+            return &pass[t];
+        }
+    }
+    return NULL;
+}
+
+/*  Tests are matched across the passes by their input and output files, and
+ *  shown in the order they were first run.  A test with no runs in a pass
+ *  shows "-" there, and the first pass it has runs in is its baseline.
+ */
+void Timer::report_sweep(string parameter, const vector<string> &values,
+                         const vector< vector<TimeSet> > &passes)
+{
+    vector< pair<string, string> > keys;
+    vector<string> names;
+    match_tests(passes, keys, names);
+    if (keys.empty()) return;
+
+    vector<double> numbers = sweep_numbers(values);
+    unsigned column = before_decimal + 3 + after_decimal;
+    for (unsigned v = 0; v < values.size(); ++v) {
+        if (values[v].length() + 1 > column) column = values[v].length() + 1;
+    }
+    string between = repeat_char(' ', spaces);
+    (*output).setf(ios::fixed);
+    (*output).precision(after_decimal);
+    (*output) << before << "Sweep of " << parameter
+              << ": median real time" << endl;
+    (*output) << setw(20) << std::left << "" << std::right;
+    for (unsigned v = 0; v < values.size(); ++v) {
+        (*output) << between << setw(column) << values[v];
+    }
+    (*output) << endl;
+
+    for (unsigned k = 0; k < keys.size(); ++k) {
+        vector<double> median(passes.size(), -1), cpu(passes.size(), -1);
+        int base = -1;
+        for (unsigned p = 0; p < passes.size(); ++p) {
+            const TimeSet *set = find_test(passes[p], keys[k]);
+            if (set == NULL) continue;
+            median[p] = correct(summarize(*set, set->real, get_real)
+                                    .median.value(), get_real);
+            double real = correct(summarize(*set, set->real, get_real)
+                                      .stats.mean(), get_real);
+            double used = correct(summarize(*set, set->user, get_user)
+                                      .stats.mean(), get_user)
+                        + correct(summarize(*set, set->sys, get_sys)
+                                      .stats.mean(), get_sys);
+            if (real > 0) cpu[p] = used / real;
+            if (base < 0) base = p;
+        }
+        char cell[32];
+        (*output) << setw(20) << std::left << names[k] << std::right;
+        for (unsigned p = 0; p < passes.size(); ++p) {
+            if (median[p] < 0) snprintf(cell, sizeof(cell), "-");
+            else snprintf(cell, sizeof(cell), "%.*fs", after_decimal,
+                          median[p]);
+            (*output) << between << setw(column) << cell;
+        }
+        (*output) << endl << setw(20) << std::left << "  speedup"
+                  << std::right;
+        for (unsigned p = 0; p < passes.size(); ++p) {
+            if (median[p] <= 0) snprintf(cell, sizeof(cell), "-");
+            else snprintf(cell, sizeof(cell), "%.2fx",
+                          median[base] / median[p]);
+            (*output) << between << setw(column) << cell;
+        }
+        if (!numbers.empty()) {
+            (*output) << endl << setw(20) << std::left << "  efficiency"
+                      << std::right;
+            for (unsigned p = 0; p < passes.size(); ++p) {
+                if (median[p] <= 0) snprintf(cell, sizeof(cell), "-");
+                else snprintf(cell, sizeof(cell), "%.0f%%",
+                              100 * median[base] / median[p]
+                              / (numbers[p] / numbers[base]));
+                (*output) << between << setw(column) << cell;
+            }
+        }
+        (*output) << endl << setw(20) << std::left << "  CPU per second"
+                  << std::right;
+        for (unsigned p = 0; p < passes.size(); ++p) {
+            if (cpu[p] < 0) snprintf(cell, sizeof(cell), "-");
+            else snprintf(cell, sizeof(cell), "%.2f", cpu[p]);
+            (*output) << between << setw(column) << cell;
+        }
+        (*output) << endl;
+
+        int previous = base;
+        for (unsigned p = base + 1; p < passes.size() && !numbers.empty();
+             ++p) {
+            if (median[p] <= 0) continue;
+            double gain = median[previous] / median[p];
+            double ideal = numbers[p] / numbers[previous];
+            if (ideal > 1 && gain - 1 < (ideal - 1) / 4) {
+                snprintf(cell, sizeof(cell), "%.2fx", gain);
+                (*output) << "  scaling flattens at " << values[p] << " ("
+                          << cell << " over " << values[previous] << ")"
+                          << endl;
+                break;
+            }
+            previous = p;
+        }
+    }
+    (*output) << after << endl;
+}
+
+
+/*  Configurations are numbered in the order given, and listed above the
+ *  table, so that long ones do not widen it.  The last row sums the medians
+ *  of the tests run in every configuration, to pick the best overall.
+ */
+void Timer::report_matrix(const vector<string> &configurations,
+                          const vector< vector<TimeSet> > &passes)
+{
+    vector< pair<string, string> > keys;
+    vector<string> names;
+    match_tests(passes, keys, names);
+    if (keys.empty()) return;
+
+    unsigned column = before_decimal + 4 + after_decimal;
+    string between = repeat_char(' ', spaces);
+    char cell[32];
+    (*output) << before << "Matrix of median real time ("
+              << configurations.size() << " configurations):" << endl;
+    for (unsigned c = 0; c < configurations.size(); ++c) {
+        snprintf(cell, sizeof(cell), "#%u", c + 1);
+        (*output) << "  " << setw(5) << std::left << cell << std::right
+                  << configurations[c] << endl;
+    }
+    (*output) << setw(20) << "";
+    for (unsigned c = 0; c < configurations.size(); ++c) {
+        snprintf(cell, sizeof(cell), "#%u ", c + 1);
+        (*output) << between << setw(column) << cell;
+    }
+    (*output) << endl;
+
+    vector<double> total(passes.size(), 0);
+    bool any_complete = false;
+    for (unsigned k = 0; k <= keys.size(); ++k) {
+        vector<double> median(passes.size(), -1);
+        if (k < keys.size()) {
+            bool complete = true;
+            for (unsigned p = 0; p < passes.size(); ++p) {
+                const TimeSet *set = find_test(passes[p], keys[k]);
+                if (set == NULL) {
+                    complete = false;
+                    continue;
+                }
+                median[p] = correct(summarize(*set, set->real, get_real)
+                                        .median.value(), get_real);
+            }
+            for (unsigned p = 0; p < passes.size() && complete; ++p) {
+                total[p] += median[p];
+            }
+            if (complete) any_complete = true;
+            (*output) << setw(20) << std::left << names[k] << std::right;
+        } else {
+            if (!any_complete || keys.size() < 2) break;
+            median = total;
+            (*output) << setw(20) << std::left << "all tests (sum)"
+                      << std::right;
+        }
+        int best = -1;
+        for (unsigned p = 0; p < passes.size(); ++p) {
+            if (median[p] >= 0 && (best < 0 || median[p] < median[best])) {
+                best = p;
+            }
+        }
+        for (unsigned p = 0; p < passes.size(); ++p) {
+            if (median[p] < 0) snprintf(cell, sizeof(cell), "- ");
+            else snprintf(cell, sizeof(cell), "%.*fs%c", after_decimal,
+                          median[p], ((int) p == best) ? '*' : ' ');
+            (*output) << between << setw(column) << cell;
+        }
+        (*output) << endl;
+    }
+    (*output) << "* the fastest configuration for the test" << endl;
+    (*output) << after << endl;
+}
+
 
 Timer &Timer::report_only_avg()
 {
@@ -233,6 +908,109 @@ Timer &Timer::report_all()
 }
 
 
+Timer &Timer::report_statistics()
+{
+    report_stats = true;
+    return *this;
+}
+
+
+Timer &Timer::report_memory()
+{
+    report_mem = true;
+    return *this;
+}
+
+
+Timer &Timer::report_histograms(HistogramScale scale)
+{
+    histogram = scale;
+    return *this;
+}
+
+
+static void set_seconds(double t, unsigned &sec, unsigned &usec)
+{
+    if (t < 0) t = 0;
+    sec = (unsigned) t;
+    usec = (unsigned) ((t - sec) * 1000000.0 + 0.5);
+    if (usec >= 1000000) {
+        ++sec;
+        usec -= 1000000;
+    }
+}
+
+/*  The overhead subtracted is the median of the calibration runs, which is
+ *  less disturbed than the mean by the occasional slow spawn.
+ */
+Timer &Timer::subtract_overhead(const TimeSet &calibration)
+{
+    if (run_count(calibration) == 0) return *this;
+    MetricSummary real = summarize(calibration, calibration.real, get_real);
+    MetricSummary user = summarize(calibration, calibration.user, get_user);
+    MetricSummary sys = summarize(calibration, calibration.sys, get_sys);
+    set_seconds(real.median.value(), overhead.wall_sec, overhead.wall_usec);
+    set_seconds(user.median.value(), overhead.user_sec, overhead.user_usec);
+    set_seconds(sys.median.value(), overhead.sys_sec, overhead.sys_usec);
+    overhead.max_rss_kb = 0;
+    overhead.exit_code = 0;
+    subtract = true;
+    return *this;
+}
+
+
+Timer &Timer::add_condition(string name, string value)
+{
+    conditions.push_back(make_pair(name, value));
+    return *this;
+}
+
+
+void Timer::report_conditions()
+{
+    if (conditions.empty()) return;
+    unsigned name_width = 0;
+    for (unsigned i = 0; i < conditions.size(); ++i) {
+        if (conditions[i].first.length() > name_width) {
+            name_width = conditions[i].first.length();
+        }
+    }
+    (*output) << "Conditions:" << endl;
+    for (unsigned i = 0; i < conditions.size(); ++i) {
+        (*output) << "  " << conditions[i].first << ":"
+                  << repeat_char(' ', name_width + 2
+                                      - conditions[i].first.length())
+                  << conditions[i].second << endl;
+    }
+    (*output) << endl;
+}
+
+
+/*  The calibration figures are always reported with their spread, and
+ *  without any overhead taken off, since they are the overhead.
+ */
+void Timer::report_calibration(const TimeSet &calibration)
+{
+    if (run_count(calibration) == 0) return;
+    bool was_subtracting = subtract;
+    bool had_stats = report_stats;
+    subtract = false;
+    report_stats = true;
+    (*output).setf(ios::fixed);
+    (*output).precision(after_decimal);
+    (*output) << before << "Harness overhead (" << run_count(calibration)
+              << " runs of " << make_header(calibration) << ")" << endl;
+    report_summary(calibration);
+    if (was_subtracting) {
+        (*output) << "The median overhead is subtracted from the times below"
+                  << endl;
+    }
+    (*output) << after << endl;
+    subtract = was_subtracting;
+    report_stats = had_stats;
+}
+
+
 Timer &Timer::precision_after_decimal(unsigned p)
 {
     after_decimal = p;
@@ -279,7 +1057,15 @@ Timer &Timer::set_footer(std::string foot)
 }
 
 
-string Timer::make_header(TimeSet test)
+double Timer::correct(double t, double (*get_num)(ProgramInfo))
+{
+    if (!subtract) return t;
+    t -= get_num(overhead);
+    return (t < 0) ? 0 : t;
+}
+
+
+string Timer::make_header(const TimeSet &test)
 {
     if (test.test_name != "") return test.test_name;
     if (test.input_file != "") return test.input_file;
@@ -5,6 +5,10 @@
  *    to translate a ProgramInfo struct into well-formatted output.          *
  *    It also contains the definition of a TimeSet struct, which can be      *
  *    useful for storing the results of a single test, run several times.    *
+ *    Besides the runs themselves, a TimeSet keeps a constant-size summary   *
+ *    of each time (see statistics.h).  Runs added with add_run() update the *
+ *    summaries, and need not be kept, so a test can be reported without     *
+ *    storing every run.                                                     *
  *  One need only create an object of this type, call some methods, if       *
  *    desired, to determine how to format the output and what to report,     *
  *    and finally call one of the report methods.                            *
@@ -15,39 +19,143 @@
  *    TimeSet.  It precedes the report with the name of the test, input file *
  *    output file, and/or err file.  It then prints each run of the test as  *
  *    a column in a table, where the rows are wall, user, and system.  It    *
- *    can then output another column with the average time.                  *
+ *    can then output another column with the average time.  If statistics  *
+ *    are requested, the standard deviation, median, and 90th percentile     *
+ *    follow the average.  The peak memory of the runs may be reported on a  *
+ *    line of its own.  If histograms are requested, each time is then    *
+ *    drawn as a one-line histogram of its runs, as wide as the line width   *
+ *    allows, so that eg. bimodal times stand out.  If the test was          *
+ *    profiled (see profile.h), its hottest functions are listed last, and   *
+ *    if its system calls were counted, the most frequent follow.  The I/O   *
+ *    of the runs, where it was measured, is given after the memory, and     *
+ *    then, if memory was sampled over time, the timeline of the run that    *
+ *    peaked highest, drawn as a one-line sparkline.                         *
  *  Timer::report_times() prints to cout the information stored in many      *
  *    TimeSet structs.  It simply calls Timer::report_time() on each.        *
+ *  Timer::report_conditions() prints to cout the conditions the tests were  *
+ *    run under (eg. warmup runs or CPU affinity), as given to               *
+ *    Timer::add_condition(), to head the timing report.                     *
+ *  Timer::report_calibration() prints to cout a summary of a TimeSet         *
+ *    holding runs of a trivial program, which measure the fixed cost of     *
+ *    starting, timing, and reaping a process.  If that cost was passed to   *
+ *    Timer::subtract_overhead(), its median is taken off every reported     *
+ *    time (a time is never reported as below zero).                         *
+ *  Timer::report_scaling() prints to cout how the average real time of     *
+ *    many TimeSets grows with their input sizes, along with the best        *
+ *    fitting complexity class and a prediction for a larger size.           *
+ *  Timer::report_comparison() prints to cout the average real time of each  *
+ *    test in two sets of TimeSets side by side (eg. before and after a      *
+ *    change), matching tests by their input and output files.               *
+ *  Timer::report_sweep() prints to cout how the median real time of each    *
+ *    test changed over the values of a swept parameter (eg. a thread        *
+ *    count), given the TimeSets of one pass over the tests for each value:  *
+ *    the speedup over the first value, the parallel efficiency (speedup per *
+ *    unit of the value, when the values are numbers), and the CPU used per  *
+ *    second of real time.  It points out where a test stops scaling: the    *
+ *    first value that gains less than a quarter of what its step from the   *
+ *    one before could have.                                                 *
+ *  Timer::report_matrix() prints to cout a table of the median real time of *
+ *    each test in each of a number of configurations (eg. combinations of   *
+ *    flags), given one pass over the tests for each, marking the fastest    *
+ *    configuration of each test, and of all the tests together.             *
  *                                                                           *
  *  TO DO:                                                                   *
 \*---------------------------------------------------------------------------*/
 #ifndef TIMER_H_INCLUDED
 #define TIMER_H_INCLUDED
+#include <map>
 #include <ostream>
 #include <string>
+#include <utility>
 #include <vector>
 #include "execute-process.h"
+#include "statistics.h"
+
+enum HistogramScale {
+    HISTOGRAM_NONE,
+    HISTOGRAM_AUTO,     /* logarithmic if the times span a factor of 10 */
+    HISTOGRAM_LINEAR,
+    HISTOGRAM_LOG
+};
+
+struct MetricSummary {
+    RunningStats stats;
+    P2Quantile median;
+    P2Quantile p90;
+
+    MetricSummary() : median(0.5), p90(0.9) {}
+    void add(double x) { stats.add(x); median.add(x); p90.add(x); }
+};
+
+/*  The averages of the I/O counts of the runs that measured them.
+ */
+struct IoSummary {
+    RunningStats rchar;
+    RunningStats wchar;
+    RunningStats read_bytes;
+    RunningStats write_bytes;
+    RunningStats syscr;
+    RunningStats syscw;
+
+    void add(const IoUsage &io);
+};
 
 struct TimeSet {
     std::vector<ProgramInfo> runs;
+    MetricSummary real;
+    MetricSummary user;
+    MetricSummary sys;
+    MetricSummary memory;   /* peak memory, in kilobytes */
+    IoSummary io;
+    MemoryTimeline memory_timeline;
+                            /* of the run that peaked highest, if sampled */
+    unsigned memory_timeline_run;
     std::string input_file;
     std::string output_file;
     std::string err_file;
     std::string test_name;
+    double input_size;      /* negative if unknown */
+    std::vector< std::pair<std::string, double> > hot_functions;
+                            /* with their shares of the samples, if any */
+    std::map<std::string, unsigned long> syscalls;
+                            /* made by a traced run, if any, by name */
+
+    TimeSet();
 };
 
+/*  Adds _run_ to the summaries of _set_, and to _set_.runs as well unless
+ *    _keep_raw_ is false.
+ */
+void add_run(TimeSet &set, const ProgramInfo &run, bool keep_raw = true);
+
 class Timer
 {
 public:
     Timer();
 
-    void report_run(const ProgramInfo result);
-    void report_time(const TimeSet results);
-    void report_times(const std::vector<TimeSet> all_results);
+    void report_run(const ProgramInfo &result);
+    void report_time(const TimeSet &results);
+    void report_times(const std::vector<TimeSet> &all_results);
+    void report_scaling(const std::vector<TimeSet> &all_results,
+                        double predict_n = 0);
+    void report_comparison(const std::vector<TimeSet> &previous,
+                           const std::vector<TimeSet> &latest);
+    void report_sweep(std::string parameter,
+                      const std::vector<std::string> &values,
+                      const std::vector< std::vector<TimeSet> > &passes);
+    void report_matrix(const std::vector<std::string> &configurations,
+                       const std::vector< std::vector<TimeSet> > &passes);
 
     Timer &report_only_avg();
     Timer &dont_report_avg();
     Timer &report_all();
+    Timer &report_statistics();
+    Timer &report_memory();
+    Timer &report_histograms(HistogramScale scale = HISTOGRAM_AUTO);
+    Timer &subtract_overhead(const TimeSet &calibration);
+    Timer &add_condition(std::string name, std::string value);
+    void report_conditions();
+    void report_calibration(const TimeSet &calibration);
     Timer &precision_after_decimal(unsigned p);
     Timer &precision_before_decimal(unsigned p);
     Timer &line_width(unsigned w);
@@ -61,17 +169,33 @@ private:
     std::string after;
     bool report_avg;
     bool report_all_times;
+    bool report_stats;
+    bool report_mem;
+    HistogramScale histogram;
+    bool subtract;
+    ProgramInfo overhead;
+    std::vector< std::pair<std::string, std::string> > conditions;
     unsigned before_decimal;
     unsigned after_decimal;
     unsigned spaces;
     unsigned width;
     std::ostream *output;
-    std::string make_header(TimeSet test);
-    double print_line(const TimeSet times, int start, int end,
+    std::string make_header(const TimeSet &test);
+    double correct(double t, double (*get_num)(ProgramInfo));
+    double print_line(const TimeSet &times, int start, int end,
                       std::string seperator, std::string final,
                       double (*get_num)(ProgramInfo));
-    void report_runs(const TimeSet results);
-    void report_avg_alone(const TimeSet results);
+    void report_runs(const TimeSet &results);
+    void report_avg_alone(const TimeSet &results);
+    void report_summary(const TimeSet &results);
+    void report_histogram(const TimeSet &results);
+    void report_memory_line(const TimeSet &results);
+    void report_io_line(const TimeSet &results);
+    void report_memory_timeline(const TimeSet &results);
+    void report_hot_functions(const TimeSet &results);
+    void report_syscalls(const TimeSet &results);
+    std::string sparkline(const std::vector<double> &values, unsigned buckets,
+                          double low, double high, bool log_scale);
     void verify_dimensions(unsigned num_tests);
     std::string repeat_char(char c, int times);
 };
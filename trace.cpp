@@ -0,0 +1,188 @@
+/*---------------------------------------------------------------------------*\
+ *  trace.cpp                                                                *
+ *  Spans are kept in memory, under one lock, and written out only by        *
+ *    write_trace(), so that recording them costs no more than reading the   *
+ *    clock and adding to a vector.  Slot tracks are numbered after the      *
+ *    harness's own, and named when written.                                 *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <vector>
+#include "trace.h"
+using namespace std;
+
+static const unsigned FIRST_SLOT_TRACK = 16;
+
+struct TraceEvent {
+    const char *name;
+    const char *category;
+    unsigned track;
+    double start;
+    double end;
+    string detail;
+};
+
+/*  tracing_on is only set before other threads are started, so it is read
+ *  without the lock.
+ */
+static bool tracing_on = false;
+static timespec epoch;
+static mutex events_lock;
+static vector<TraceEvent> events;
+static thread_local unsigned thread_track = TRACE_HARNESS_TRACK;
+
+
+void start_tracing()
+{
+    clock_gettime(CLOCK_MONOTONIC, &epoch);
+    tracing_on = true;
+}
+
+
+bool tracing()
+{
+    return tracing_on;
+}
+
+
+double trace_time(const timespec &monotonic)
+{
+    return (monotonic.tv_sec - epoch.tv_sec) * 1e6
+         + (monotonic.tv_nsec - epoch.tv_nsec) / 1e3;
+}
+
+
+double trace_now()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return trace_time(now);
+}
+
+
+unsigned trace_slot_track(unsigned slot)
+{
+    return FIRST_SLOT_TRACK + slot;
+}
+
+
+void set_trace_track(unsigned track)
+{
+    thread_track = track;
+}
+
+
+void trace_event(const char *name, const char *category, unsigned track,
+                 double start, double end, const string &detail)
+{
+    if (!tracing_on) return;
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.track = track;
+    event.start = start;
+    event.end = end;
+    event.detail = detail;
+    lock_guard<mutex> guard(events_lock);
+    events.push_back(event);
+}
+
+
+static string json_string(const string &s)
+{
+    string r_val = "\"";
+    for (unsigned i = 0; i < s.size(); ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            r_val += '\\';
+            r_val += c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            r_val += escaped;
+        } else {
+            r_val += c;
+        }
+    }
+    return r_val + "\"";
+}
+
+static string track_name(unsigned track)
+{
+    if (track == TRACE_HARNESS_TRACK) return "harness";
+    if (track == TRACE_LOOP_TRACK) return "process loop";
+    char name[32];
+    snprintf(name, sizeof(name), "slot %u", track - FIRST_SLOT_TRACK);
+    return name;
+}
+
+
+/*  write_trace()
+ *  Each track is given as a thread of one process, named and sorted by
+ *  metadata events, and each span as a complete ("X") event.
+ */
+void write_trace(string filename)
+{
+    FILE *file = fopen(filename.c_str(), "w");
+    if (file == NULL) {
+        throw string("cannot open trace file \"") + filename + "\": "
+              + strerror(errno);
+    }
+    lock_guard<mutex> guard(events_lock);
+    set<unsigned> tracks;
+    for (unsigned i = 0; i < events.size(); ++i) {
+        tracks.insert(events[i].track);
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"args\":{\"name\":\"evaluate\"}}");
+    for (set<unsigned>::iterator it = tracks.begin(); it != tracks.end();
+         ++it) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%u,\"args\":{\"name\":%s}}", *it,
+                json_string(track_name(*it)).c_str());
+        fprintf(file, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\","
+                "\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+                *it, *it);
+    }
+    for (unsigned i = 0; i < events.size(); ++i) {
+        const TraceEvent &event = events[i];
+        fprintf(file, ",\n{\"name\":%s,\"cat\":%s,\"ph\":\"X\",\"pid\":1,"
+                "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                json_string(event.name).c_str(),
+                json_string(event.category).c_str(), event.track,
+                event.start, event.end - event.start);
+        if (event.detail != "") {
+            fprintf(file, ",\"args\":{\"detail\":%s}",
+                    json_string(event.detail).c_str());
+        }
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file)) {
+        throw string("cannot write trace file \"") + filename + "\": "
+              + strerror(errno);
+    }
+}
+
+
+TraceSpan::TraceSpan(const char *name, const char *category,
+                     const string &detail)
+    : name(name), category(category)
+{
+    if (!tracing_on) return;
+    this->detail = detail;
+    start = trace_now();
+}
+
+
+TraceSpan::~TraceSpan()
+{
+    if (!tracing_on) return;
+    trace_event(name, category, thread_track, start, trace_now(), detail);
+}
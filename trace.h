@@ -0,0 +1,75 @@
+/*---------------------------------------------------------------------------*\
+ *  trace.h                                                                  *
+ *  This file contains the interface for the trace module, which records     *
+ *    where the harness spends its time (finding tests, making temporary     *
+ *    files, starting processes, comparing output, reporting), and the       *
+ *    lifetime of every process it runs, as spans on a timeline that can be  *
+ *    written in the Chrome trace event format, for viewing in Perfetto or   *
+ *    chrome://tracing.                                                      *
+ *  Nothing is recorded until start_tracing() is called; until then, a       *
+ *    TraceSpan costs one test of a flag.                                    *
+ *                                                                           *
+ *  The timeline has one track for each thread of the harness that records  *
+ *    spans (the main thread, and the process loop's), and one for each      *
+ *    slot that a process can run in, so that a track with gaps is a slot    *
+ *    left idle.  Spans go on the track set for their thread with            *
+ *    set_trace_track(), which is the harness's unless changed.              *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <ctime>
+#include <string>
+
+enum {
+    TRACE_HARNESS_TRACK = 0,
+    TRACE_LOOP_TRACK = 1
+};
+
+void start_tracing();
+bool tracing();
+
+/*  Times on the timeline, in microseconds since tracing started.
+ */
+double trace_now();
+double trace_time(const timespec &monotonic);
+
+/*  The track for processes running in slot _slot_ (counted from 0).
+ */
+unsigned trace_slot_track(unsigned slot);
+void set_trace_track(unsigned track);
+
+/*  Records a span from _start_ to _end_ on _track_.  _detail_ is shown
+ *  with the span (eg. the test it was for), unless empty.
+ */
+void trace_event(const char *name, const char *category, unsigned track,
+                 double start, double end,
+                 const std::string &detail = std::string());
+
+/*  Writes every span recorded so far to _filename_.  Throws a string if
+ *  the file cannot be written.
+ */
+void write_trace(std::string filename);
+
+/*  A span on the calling thread's track, from construction to destruction.
+ */
+class TraceSpan
+{
+public:
+    TraceSpan(const char *name, const char *category,
+              const std::string &detail = std::string());
+    ~TraceSpan();
+
+private:
+    const char *name;
+    const char *category;
+    std::string detail;
+    double start;
+
+    TraceSpan(const TraceSpan &);
+    TraceSpan &operator=(const TraceSpan &);
+};
+
+#endif
@@ -0,0 +1,154 @@
+/*---------------------------------------------------------------------------*\
+ *  watch.cpp                                                                *
+ *  Files are watched through the directories that hold them, since a watch  *
+ *    on a file itself follows its inode, and is lost when a new file is     *
+ *    renamed over it.  A directory is watched once, however many of its     *
+ *    files are wanted; events for other files in it are ignored.            *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <boost/filesystem.hpp>
+#include "watch.h"
+using namespace std;
+
+static const uint32_t EVENTS = IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE
+                             | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+
+
+FileWatcher::FileWatcher()
+{
+    structure_changed = false;
+    fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd < 0) {
+        throw string("cannot watch for changes: ") + strerror(errno);
+    }
+}
+
+
+FileWatcher::~FileWatcher()
+{
+    close(fd);
+}
+
+
+/*  Returns the watch descriptor for _dir_, adding the watch if need be.
+ *  Throws a string if the directory cannot be watched.
+ */
+int FileWatcher::add_watch(string dir)
+{
+    int wd = inotify_add_watch(fd, dir.c_str(), EVENTS | IN_ONLYDIR);
+    if (wd < 0) {
+        throw string("cannot watch \"") + dir + "\": " + strerror(errno);
+    }
+    if (!dirs.count(wd)) {
+        dirs[wd].path = dir;
+        dirs[wd].all_files = false;
+        dirs[wd].recursive = false;
+    }
+    return wd;
+}
+
+
+void FileWatcher::watch_file(string path)
+{
+    namespace fs = boost::filesystem;
+    fs::path file(path);
+    string dir = file.parent_path().generic_string();
+    int wd = add_watch((dir == "") ? "." : dir);
+    dirs[wd].names.insert(file.filename().native());
+}
+
+
+void FileWatcher::watch_directory(string dir, bool recursive)
+{
+    namespace fs = boost::filesystem;
+    if (dir == "") dir = ".";
+    int wd = add_watch(dir);
+    dirs[wd].all_files = true;
+    dirs[wd].recursive = dirs[wd].recursive || recursive;
+    if (!recursive) return;
+    boost::system::error_code err;
+    fs::recursive_directory_iterator it(dir, err), end;
+    for ( ; !err && it != end; it.increment(err)) {
+        if (fs::is_directory(it->symlink_status())) {
+            int sub = add_watch(it->path().generic_string());
+            dirs[sub].all_files = true;
+            dirs[sub].recursive = true;
+        }
+    }
+}
+
+
+/*  Reads all the events waiting, adding the paths they concern to
+ *  _changed_.  Returns false if there were none.
+ */
+bool FileWatcher::read_events(set<string> &changed)
+{
+    char buffer[16384]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool any = false;
+    ssize_t got;
+    while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + got; ) {
+            inotify_event *event = (inotify_event *) p;
+            p += sizeof(inotify_event) + event->len;
+            map<int, WatchedDir>::iterator dir = dirs.find(event->wd);
+            if (dir == dirs.end() || event->len == 0) continue;
+            string name = event->name;
+            string path = dir->second.path + "/" + name;
+            if ((event->mask & IN_ISDIR) && (event->mask & IN_CREATE)
+                && dir->second.recursive) {
+                try {
+                    watch_directory(path, true);
+                } catch (string err) {
+                    // It may already be gone again
+                }
+                structure_changed = true;
+                any = true;
+                continue;
+            }
+            if (!dir->second.all_files && !dir->second.names.count(name)) {
+                continue;
+            }
+            if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                               | IN_MOVED_TO)) {
+                structure_changed = true;
+            }
+            changed.insert(path);
+            any = true;
+        }
+    }
+    return any;
+}
+
+
+vector<string> FileWatcher::wait(unsigned settle_ms)
+{
+    set<string> changed;
+    structure_changed = false;
+    pollfd waiting;
+    waiting.fd = fd;
+    waiting.events = POLLIN;
+    bool any = false;
+    while (!any) {
+        if (poll(&waiting, 1, -1) < 0 && errno != EINTR) break;
+        any = read_events(changed);
+    }
+    int ready;
+    while ((ready = poll(&waiting, 1, settle_ms)) != 0) {
+        if (ready < 0 && errno != EINTR) break;
+        read_events(changed);
+    }
+    return vector<string>(changed.begin(), changed.end());
+}
+
+
+bool FileWatcher::files_added_or_removed() const
+{
+    return structure_changed;
+}
@@ -0,0 +1,57 @@
+/*---------------------------------------------------------------------------*\
+ *  watch.h                                                                  *
+ *  This file contains the interface for the FileWatcher class, which waits  *
+ *    for files and directories to change, using inotify.                    *
+ *                                                                           *
+ *  FileWatcher::watch_file() watches a single file.  It keeps watching the  *
+ *    same path even if the file is replaced (eg. by a linker or an editor   *
+ *    writing a new file and renaming it over the old one).                  *
+ *  FileWatcher::watch_directory() watches every file in a directory, and,   *
+ *    if asked, in its subdirectories, including ones made later.            *
+ *  FileWatcher::wait() blocks until something watched changes, then keeps   *
+ *    gathering changes until none have come for settle_ms milliseconds, so  *
+ *    that eg. a whole rebuild is seen as one change.  It returns the paths  *
+ *    that changed.  FileWatcher::files_added_or_removed() tells whether any *
+ *    of those changes made, removed, or renamed a file.                     *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#ifndef WATCH_H_INCLUDED
+#define WATCH_H_INCLUDED
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class FileWatcher
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    void watch_file(std::string path);
+    void watch_directory(std::string dir, bool recursive);
+
+    std::vector<std::string> wait(unsigned settle_ms);
+    bool files_added_or_removed() const;
+
+private:
+    struct WatchedDir {
+        std::string path;
+        bool all_files;
+        bool recursive;
+        std::set<std::string> names;
+    };
+    int fd;
+    bool structure_changed;
+    std::map<int, WatchedDir> dirs;
+
+    int add_watch(std::string dir);
+    bool read_events(std::set<std::string> &changed);
+
+    FileWatcher(const FileWatcher &);
+    FileWatcher &operator=(const FileWatcher &);
+};
+
+#endif
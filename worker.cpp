@@ -0,0 +1,632 @@
+/*---------------------------------------------------------------------------*\
+ *  worker.cpp                                                               *
+ *  Jobs and results are sent as messages of "key value" lines, ended by an  *
+ *    empty line.  Backslashes, tabs, and newlines in values are escaped     *
+ *    with a backslash, so that any path or argument can be sent.            *
+ *  Each connection a worker accepts is served by a forked child, since      *
+ *    execute_process() keeps state for the one child it is running.  The    *
+ *    worker reaps finished children whenever it accepts a connection.       *
+ *    While a job runs, a thread watches its connection, and if the other    *
+ *    end closes it, sends the worker SIGTERM, which execute_process()       *
+ *    passes on to the process it is running.                                *
+ *  The sending side uses one thread per connection, and a single lock over  *
+ *    the queues, which is held only to pick or put back a job.              *
+ *                                                                           *
+ *  TO DO:                                                                   *
+\*---------------------------------------------------------------------------*/
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "worker.h"
+#include "tester.h"
+#include "trace.h"
+using namespace std;
+
+typedef vector< pair<string, string> > Message;
+
+
+static string escape(const string &value)
+{
+    string r_val;
+    for (unsigned i = 0; i < value.length(); ++i) {
+        switch (value[i]) {
+        case '\\': r_val += "\\\\"; break;
+        case '\n': r_val += "\\n"; break;
+        case '\t': r_val += "\\t"; break;
+        default:   r_val += value[i];
+        }
+    }
+    return r_val;
+}
+
+static string unescape_value(const string &value)
+{
+    string r_val;
+    for (unsigned i = 0; i < value.length(); ++i) {
+        if (value[i] != '\\' || i + 1 == value.length()) {
+            r_val += value[i];
+            continue;
+        }
+        char c = value[++i];
+        r_val += (c == 'n') ? '\n' : (c == 't') ? '\t' : c;
+    }
+    return r_val;
+}
+
+template <class T>
+static string to_text(T value)
+{
+    stringstream ss;
+    ss.precision(17);
+    ss << value;
+    return ss.str();
+}
+
+/*  A connection over which whole messages are sent and received.
+ */
+class Channel
+{
+public:
+    Channel(int fd) : fd(fd) {}
+    ~Channel() { if (fd >= 0) ::close(fd); }
+
+    int descriptor() const { return fd; }
+
+    bool send(const Message &message)
+    {
+        string text;
+        for (unsigned i = 0; i < message.size(); ++i) {
+            text += message[i].first + " " + escape(message[i].second) + "\n";
+        }
+        text += "\n";
+        const char *p = text.data();
+        size_t left = text.length();
+        while (left > 0) {
+            ssize_t sent = ::send(fd, p, left, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return false;
+            p += sent;
+            left -= sent;
+        }
+        return true;
+    }
+
+    /*  Returns false if the connection closed or failed before a whole
+     *  message arrived.
+     */
+    bool receive(Message &message)
+    {
+        message.clear();
+        string line;
+        while (read_line(line)) {
+            if (line == "") return true;
+            string::size_type space = line.find(' ');
+            if (space == string::npos) space = line.length();
+            string value = (space < line.length())
+                         ? line.substr(space + 1) : "";
+            message.push_back(make_pair(line.substr(0, space),
+                                        unescape_value(value)));
+        }
+        return false;
+    }
+
+private:
+    int fd;
+    string pending;
+
+    bool read_line(string &line)
+    {
+        string::size_type newline;
+        while ((newline = pending.find('\n')) == string::npos) {
+            char block[4096];
+            ssize_t got = ::recv(fd, block, sizeof(block), 0);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            pending.append(block, got);
+        }
+        line = pending.substr(0, newline);
+        pending.erase(0, newline + 1);
+        return true;
+    }
+
+    Channel(const Channel &);
+    Channel &operator=(const Channel &);
+};
+
+
+static Message encode_job(const Job &job)
+{
+    Message m;
+    m.push_back(make_pair("program", job.program));
+    for (unsigned i = 0; i < job.args.size(); ++i) {
+        m.push_back(make_pair("arg", job.args[i]));
+    }
+    m.push_back(make_pair("input", job.input_file));
+    m.push_back(make_pair("output", job.output_file));
+    m.push_back(make_pair("error", job.err_file));
+    m.push_back(make_pair("exit", to_text(job.exit_code)));
+    m.push_back(make_pair("check", to_text(job.check)));
+    m.push_back(make_pair("spaces", to_text(job.ignore_space)));
+    m.push_back(make_pair("ignore", job.ignore_chars));
+    m.push_back(make_pair("max-cpu", to_text(job.max_cpu_time)));
+    m.push_back(make_pair("max-real", to_text(job.max_real_time)));
+    for (unsigned i = 0; i < job.cpus.size(); ++i) {
+        m.push_back(make_pair("cpu", to_text(job.cpus[i])));
+    }
+    m.push_back(make_pair("nice", to_text(job.nice)));
+    m.push_back(make_pair("fifo", to_text(job.fifo_priority)));
+    m.push_back(make_pair("cgroup", to_text(job.use_cgroup)));
+    m.push_back(make_pair("drop-cache", to_text(job.drop_input_cache)));
+    for (unsigned i = 0; i < job.environment.size(); ++i) {
+        m.push_back(make_pair("env", job.environment[i]));
+    }
+    return m;
+}
+
+static Job decode_job(const Message &m)
+{
+    Job job;
+    job.exit_code = -1;
+    job.check = false;
+    job.ignore_space = false;
+    job.max_cpu_time = job.max_real_time = 0;
+    job.nice = 0;
+    job.fifo_priority = 0;
+    job.use_cgroup = job.drop_input_cache = false;
+    for (unsigned i = 0; i < m.size(); ++i) {
+        const string &key = m[i].first, &value = m[i].second;
+        if (key == "program") job.program = value;
+        else if (key == "arg") job.args.push_back(value);
+        else if (key == "input") job.input_file = value;
+        else if (key == "output") job.output_file = value;
+        else if (key == "error") job.err_file = value;
+        else if (key == "exit") job.exit_code = atoi(value.c_str());
+        else if (key == "check") job.check = value == "1";
+        else if (key == "spaces") job.ignore_space = value == "1";
+        else if (key == "ignore") job.ignore_chars = value;
+        else if (key == "max-cpu") job.max_cpu_time = atof(value.c_str());
+        else if (key == "max-real") job.max_real_time = atof(value.c_str());
+        else if (key == "cpu") job.cpus.push_back(atoi(value.c_str()));
+        else if (key == "nice") job.nice = atoi(value.c_str());
+        else if (key == "fifo") job.fifo_priority = atoi(value.c_str());
+        else if (key == "cgroup") job.use_cgroup = value == "1";
+        else if (key == "drop-cache") job.drop_input_cache = value == "1";
+        else if (key == "env") job.environment.push_back(value);
+    }
+    return job;
+}
+
+static Message encode_result(const JobResult &result)
+{
+    Message m;
+    m.push_back(make_pair("ran", to_text(result.ran)));
+    if (!result.ran) {
+        m.push_back(make_pair("error", result.error));
+        return m;
+    }
+    const ProgramInfo &info = result.info;
+    m.push_back(make_pair("info", to_text(info.wall_sec) + " "
+                          + to_text(info.wall_usec) + " "
+                          + to_text(info.user_sec) + " "
+                          + to_text(info.user_usec) + " "
+                          + to_text(info.sys_sec) + " "
+                          + to_text(info.sys_usec) + " "
+                          + to_text(info.max_rss_kb) + " "
+                          + to_text(info.exit_code)));
+    m.push_back(make_pair("passed", to_text(result.passed)));
+    for (unsigned i = 0; i < result.failures.size(); ++i) {
+        m.push_back(make_pair("failure", result.failures[i]));
+    }
+    return m;
+}
+
+static bool decode_result(const Message &m, JobResult *result)
+{
+    bool has_info = false;
+    result->ran = false;
+    result->passed = false;
+    result->cancelled = false;
+    result->failures.clear();
+    for (unsigned i = 0; i < m.size(); ++i) {
+        const string &key = m[i].first, &value = m[i].second;
+        if (key == "ran") result->ran = value == "1";
+        else if (key == "error") result->error = value;
+        else if (key == "passed") result->passed = value == "1";
+        else if (key == "failure") result->failures.push_back(value);
+        else if (key == "info") {
+            ProgramInfo &info = result->info;
+            stringstream ss(value);
+            if (ss >> info.wall_sec >> info.wall_usec >> info.user_sec
+                   >> info.user_usec >> info.sys_sec >> info.sys_usec
+                   >> info.max_rss_kb >> info.exit_code) {
+                has_info = true;
+            }
+        }
+    }
+    return !result->ran || has_info;
+}
+
+
+/*  Runs one job, with its output and error stream going to the given
+ *  temporary files, and judges it as evaluate would.
+ */
+static JobResult run_job(const Job &job, const string &temp_out,
+                         const string &temp_err)
+{
+    JobResult result;
+    result.ran = false;
+    result.passed = false;
+    result.cancelled = false;
+    vector<char *> argv;
+    argv.push_back(const_cast<char *>(job.program.c_str()));
+    for (unsigned i = 0; i < job.args.size(); ++i) {
+        argv.push_back(const_cast<char *>(job.args[i].c_str()));
+    }
+    argv.push_back(NULL);
+    ProcessOptions process;
+    process.max_cpu_time = job.max_cpu_time;
+    process.max_real_time = job.max_real_time;
+    process.cpus = job.cpus;
+    process.nice = job.nice;
+    process.fifo_priority = job.fifo_priority;
+    process.use_cgroup = job.use_cgroup;
+    process.drop_input_cache = job.drop_input_cache;
+    process.environment = job.environment;
+    string input = (job.input_file == "") ? "/dev/null" : job.input_file;
+    try {
+        result.info = execute_process(job.program, &argv[0], input,
+                                      temp_out, temp_err, process);
+    } catch (string err) {
+        result.error = err;
+        return result;
+    }
+    result.ran = true;
+    if (!job.check) return result;
+
+    Tester tes;
+    if (job.ignore_space) tes.ignore_whitespace();
+    tes.ignore_chars(job.ignore_chars);
+    Tester err_tes = tes;
+    tes.set_benchmark_file(job.output_file).set_comparison_file(temp_out);
+    string verdict = tes.run_verbosely();
+    if (verdict != "" && verdict != "Passed") {
+        result.failures.push_back(verdict);
+    }
+    if (job.err_file != "") {
+        err_tes.set_benchmark_file(job.err_file)
+               .set_comparison_file(temp_err);
+        string err_verdict = err_tes.run_verbosely();
+        if (err_verdict != "" && err_verdict != "Passed") {
+            result.failures.push_back("On error stream: " + err_verdict);
+        }
+    }
+    if (job.exit_code >= 0 && result.info.exit_code != job.exit_code) {
+        result.failures.push_back("Expected exit code "
+                                  + to_text(job.exit_code) + ", got "
+                                  + to_text(result.info.exit_code));
+    }
+    result.passed = result.failures.empty();
+    return result;
+}
+
+static string make_temp()
+{
+    char name[] = "/tmp/evaluate-worker-XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0) return "";
+    close(fd);
+    return name;
+}
+
+/*  Waits until either the connection _fd_ is closed by the other end, in
+ *  which case the running job is ended, or _stop_fd_ becomes readable.
+ */
+static void watch_for_hangup(int fd, int stop_fd)
+{
+    pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = POLLRDHUP;
+    fds[1].fd = stop_fd;
+    fds[1].events = POLLIN;
+    while (poll(fds, 2, -1) < 0 && errno == EINTR) {
+        // Wait again
+    }
+    if (fds[1].revents == 0
+        && (fds[0].revents & (POLLRDHUP | POLLHUP | POLLERR))) {
+        kill(getpid(), SIGTERM);
+    }
+}
+
+static void serve_connection(int fd)
+{
+    Channel channel(fd);
+    string temp_out = make_temp();
+    string temp_err = make_temp();
+    Message message;
+    while (channel.receive(message)) {
+        JobResult result;
+        if (temp_out == "" || temp_err == "") {
+            result.ran = false;
+            result.cancelled = false;
+            result.error = "worker could not make temporary files";
+        } else {
+            int stop[2];
+            bool watched = pipe2(stop, O_CLOEXEC) == 0;
+            thread watcher;
+            if (watched) {
+                watcher = thread(watch_for_hangup, channel.descriptor(),
+                                 stop[0]);
+            }
+            result = run_job(decode_job(message), temp_out, temp_err);
+            if (watched) {
+                if (write(stop[1], "", 1) < 0) {
+                    // The watcher is ended by the close below anyway
+                }
+                close(stop[1]);
+                watcher.join();
+                close(stop[0]);
+            }
+        }
+        if (!channel.send(encode_result(result))) break;
+    }
+    if (temp_out != "") unlink(temp_out.c_str());
+    if (temp_err != "") unlink(temp_err.c_str());
+}
+
+static bool fill_address(const string &path, sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (path.length() >= sizeof(address->sun_path)) return false;
+    strcpy(address->sun_path, path.c_str());
+    return true;
+}
+
+
+/*  Only returns by throwing a string, if the socket cannot be set up.
+ */
+void serve_jobs(string socket_path)
+{
+    sockaddr_un address;
+    if (!fill_address(socket_path, &address)) {
+        throw string("socket path too long: ") + socket_path;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) throw string("cannot make socket: ") + strerror(errno);
+    unlink(socket_path.c_str());
+    if (bind(listener, (sockaddr *) &address, sizeof(address))
+        || listen(listener, 64)) {
+        string err = strerror(errno);
+        close(listener);
+        throw string("cannot listen on ") + socket_path + ": " + err;
+    }
+    while (true) {
+        int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        while (waitpid(-1, NULL, WNOHANG) > 0) {
+            // Reap connections that have finished
+        }
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            string err = strerror(errno);
+            close(listener);
+            throw string("cannot accept connections: ") + err;
+        }
+        pid_t child = fork();
+        if (child == 0) {
+            close(listener);
+            serve_connection(fd);
+            _exit(0);
+        }
+        close(fd);
+    }
+}
+
+
+static const unsigned RECONNECT_TRIES = 5;
+static const unsigned RECONNECT_DELAY_MS = 100;
+
+/*  The state shared by the threads of run_remote_jobs().
+ */
+struct Dispatch {
+    const vector<Job> *jobs;
+    vector<JobResult> *results;
+    unsigned max_attempts;
+    mutex lock;
+    condition_variable changed;
+    vector< deque<unsigned> > queues;   /* one per connection */
+    vector<unsigned> attempts;
+    vector<bool> done;
+    vector<int> sockets;                /* -1 once a connection is closed */
+    unsigned in_flight;
+    bool fail_fast;
+    bool stopped;
+};
+
+/*  Stops every job: empties the queues, and closes the other connections
+ *  so that the jobs running on them are ended.  Must be called with the
+ *  lock.
+ */
+static void stop_jobs(Dispatch &dispatch, unsigned slot)
+{
+    dispatch.stopped = true;
+    for (unsigned q = 0; q < dispatch.queues.size(); ++q) {
+        dispatch.queues[q].clear();
+        if (q != slot && dispatch.sockets[q] >= 0) {
+            shutdown(dispatch.sockets[q], SHUT_RDWR);
+        }
+    }
+}
+
+/*  Takes the next job for connection _slot_: its own first, otherwise one
+ *  from the back of the longest queue.  Waits while queues are empty but
+ *  jobs are still running elsewhere, since those may be put back.  Returns
+ *  false once there is nothing left to do.  Must be called with the lock.
+ */
+static bool next_job(Dispatch &dispatch, unsigned slot,
+                     unique_lock<mutex> &guard, unsigned *job)
+{
+    while (true) {
+        if (!dispatch.queues[slot].empty()) {
+            *job = dispatch.queues[slot].front();
+            dispatch.queues[slot].pop_front();
+            return true;
+        }
+        unsigned longest = slot;
+        for (unsigned q = 0; q < dispatch.queues.size(); ++q) {
+            if (dispatch.queues[q].size() > dispatch.queues[longest].size()) {
+                longest = q;
+            }
+        }
+        if (!dispatch.queues[longest].empty()) {
+            *job = dispatch.queues[longest].back();
+            dispatch.queues[longest].pop_back();
+            return true;
+        }
+        if (dispatch.in_flight == 0) return false;
+        dispatch.changed.wait(guard);
+    }
+}
+
+static int connect_to(const string &endpoint)
+{
+    sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && (!fill_address(endpoint, &address)
+                    || connect(fd, (sockaddr *) &address, sizeof(address)))) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/*  Sends jobs over the connection _fd_ for _slot_ until there are none
+ *  left, and closes it.  Returns true if the connection was lost first, in
+ *  which case the job it was running has been put back at the front of the
+ *  slot's queue, unless it has been tried max_attempts times.
+ */
+static bool send_jobs(Dispatch &dispatch, unsigned slot, int fd)
+{
+    Channel channel(fd);
+    unique_lock<mutex> guard(dispatch.lock);
+    if (dispatch.stopped) return false;
+    dispatch.sockets[slot] = fd;
+    bool lost = false;
+    unsigned job;
+    while (!lost && next_job(dispatch, slot, guard, &job)) {
+        ++dispatch.attempts[job];
+        ++dispatch.in_flight;
+        guard.unlock();
+
+        Message reply;
+        JobResult result;
+        double sent = trace_now();
+        bool answered = channel.send(encode_job((*dispatch.jobs)[job]))
+                        && channel.receive(reply)
+                        && decode_result(reply, &result);
+        trace_event("job", "child", trace_slot_track(slot), sent,
+                    trace_now(), (*dispatch.jobs)[job].input_file);
+
+        guard.lock();
+        --dispatch.in_flight;
+        dispatch.changed.notify_all();
+        if (answered) {
+            (*dispatch.results)[job] = result;
+            dispatch.done[job] = true;
+            if (dispatch.fail_fast && (*dispatch.jobs)[job].check
+                && !(result.ran && result.passed)) {
+                stop_jobs(dispatch, slot);
+            }
+        } else if (dispatch.stopped) {
+            break;
+        } else if (dispatch.attempts[job] < dispatch.max_attempts) {
+            dispatch.queues[slot].push_front(job);
+            lost = true;
+        } else {
+            JobResult &failed = (*dispatch.results)[job];
+            failed.ran = false;
+            failed.error = "lost " + to_text(dispatch.attempts[job])
+                         + " times with its worker";
+            dispatch.done[job] = true;
+            lost = true;
+        }
+    }
+    dispatch.sockets[slot] = -1;
+    return lost;
+}
+
+/*  A lost connection is made again, trying a few times, before its slot
+ *  takes any more jobs.  If it cannot be, the jobs left in the slot's queue
+ *  are taken by the other slots.
+ */
+static void dispatch_to(Dispatch &dispatch, unsigned slot, string endpoint)
+{
+    int fd = connect_to(endpoint);
+    while (fd >= 0 && send_jobs(dispatch, slot, fd)) {
+        fd = -1;
+        for (unsigned tries = 0; tries < RECONNECT_TRIES && fd < 0; ++tries) {
+            timespec delay = { 0, RECONNECT_DELAY_MS * 1000000L };
+            nanosleep(&delay, NULL);
+            fd = connect_to(endpoint);
+        }
+    }
+}
+
+
+/*  A job that could not be run at all, because no worker could be reached,
+ *  is given as not having run.
+ */
+void run_remote_jobs(const vector<string> &endpoints,
+                     const vector<Job> &jobs, vector<JobResult> &results,
+                     bool fail_fast, unsigned max_attempts)
+{
+    Dispatch dispatch;
+    dispatch.jobs = &jobs;
+    dispatch.results = &results;
+    dispatch.max_attempts = max_attempts;
+    dispatch.queues.resize(endpoints.size());
+    dispatch.attempts.assign(jobs.size(), 0);
+    dispatch.done.assign(jobs.size(), false);
+    dispatch.sockets.assign(endpoints.size(), -1);
+    dispatch.in_flight = 0;
+    dispatch.fail_fast = fail_fast;
+    dispatch.stopped = false;
+    results.assign(jobs.size(), JobResult());
+    for (unsigned i = 0; i < jobs.size() && !endpoints.empty(); ++i) {
+        dispatch.queues[i % endpoints.size()].push_back(i);
+    }
+
+    vector<thread> pool;
+    for (unsigned s = 0; s < endpoints.size(); ++s) {
+        pool.push_back(thread(dispatch_to, ref(dispatch), s, endpoints[s]));
+    }
+    for (unsigned s = 0; s < pool.size(); ++s) pool[s].join();
+
+    for (unsigned i = 0; i < jobs.size(); ++i) {
+        if (dispatch.done[i]) continue;
+        results[i].ran = false;
+        results[i].cancelled = dispatch.stopped;
+        if (dispatch.stopped) {
+            results[i].error = "cancelled after a failure";
+        } else if (dispatch.attempts[i] > 0) {
+            results[i].error = "lost with its worker, which could not be "
+                               "reached again";
+        } else {
+            results[i].error = "no worker could be reached";
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*---------------------------------------------------------------------------*\
+ *  worker.h                                                                 *
+ *  This file contains the interface for the worker module, which lets tests *
+ *    be run by other evaluate processes, called workers, listening on Unix  *
+ *    domain sockets.  A job is one run of one test; a worker runs it with   *
+ *    execute_process(), judges its output with a Tester, and sends back     *
+ *    the ProgramInfo and the verdict.                                       *
+ *                                                                           *
+ *  serve_jobs() makes this process a worker.  It listens on a socket, and   *
+ *    serves each connection in a child process of its own, one job at a    *
+ *    time, until the other end closes it.                                   *
+ *  run_remote_jobs() hands a list of jobs out to workers.  Each endpoint    *
+ *    given is one connection, so an endpoint may be given more than once    *
+ *    to run several jobs on it at a time.  The jobs are first dealt out     *
+ *    evenly; a connection that runs out of jobs then takes them from the    *
+ *    back of the longest remaining queue.  A job whose connection fails is  *
+ *    put back, up to max_attempts times in all, to be run once the          *
+ *    connection is made again, or by another connection if it cannot be.    *
+ *    With _fail_fast_, the first checked job to fail stops the rest: no     *
+ *    more are sent, and the connections running others are closed, which    *
+ *    makes their workers kill the processes they are running.               *
+ *                                                                           *
+ *  Paths are sent as they are, so workers must see the same files as the   *
+ *    process that sends them jobs, at the same paths.  A job carries the    *
+ *    ProcessOptions a run is made with, save those that measure more than   *
+ *    a ProgramInfo's times (eg. I/O, profiles), which are not sent back.     *
+ *                                                                           *
+ *  TO DO:                                                                   *
+ *   - Accept TCP endpoints as well                                          *
+\*---------------------------------------------------------------------------*/
+#ifndef WORKER_H_INCLUDED
+#define WORKER_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include "execute-process.h"
+
+struct Job {
+    std::string program;
+    std::vector<std::string> args;
+    std::string input_file;     /* empty for no input */
+    std::string output_file;    /* expected output */
+    std::string err_file;       /* expected error output, or empty */
+    int exit_code;              /* expected exit code, or negative for any */
+    bool check;                 /* whether to judge the run at all */
+    bool ignore_space;
+    std::string ignore_chars;
+    double max_cpu_time;
+    double max_real_time;
+    std::vector<int> cpus;      /* to run on, or empty for any */
+    int nice;
+    unsigned fifo_priority;     /* or 0 for the usual scheduling */
+    bool use_cgroup;
+    bool drop_input_cache;
+    std::vector<std::string> environment;   /* "NAME=value" settings */
+};
+
+struct JobResult {
+    bool ran;                   /* false if the job could not be run */
+    std::string error;          /* why not */
+    ProgramInfo info;
+    bool passed;
+    std::vector<std::string> failures;
+    bool cancelled;             /* not run, because another job failed */
+};
+
+void serve_jobs(std::string socket_path);
+void run_remote_jobs(const std::vector<std::string> &endpoints,
+                     const std::vector<Job> &jobs,
+                     std::vector<JobResult> &results,
+                     bool fail_fast = false, unsigned max_attempts = 3);
+
+#endif